@@ -0,0 +1,43 @@
+# Writes a SPIR-V binary as a constexpr uint32_t array into a C++ header
+#
+# Usage: cmake -DINPUT=<file.spv> -DOUTPUT=<file.h> -DNAME=<identifier> -P embed_spirv.cmake
+
+if(NOT INPUT OR NOT OUTPUT OR NOT NAME)
+    message(FATAL_ERROR "embed_spirv.cmake requires INPUT, OUTPUT and NAME")
+endif()
+
+file(READ ${INPUT} SPIRV_HEX HEX)
+string(LENGTH "${SPIRV_HEX}" SPIRV_HEX_LENGTH)
+math(EXPR SPIRV_REMAINDER "${SPIRV_HEX_LENGTH} % 8")
+if(SPIRV_HEX_LENGTH EQUAL 0 OR NOT SPIRV_REMAINDER EQUAL 0)
+    message(FATAL_ERROR "${INPUT} is not a valid SPIR-V binary")
+endif()
+
+# SPIR-V words are stored little endian
+string(REGEX MATCHALL "........" SPIRV_BYTES "${SPIRV_HEX}")
+set(SPIRV_WORDS "")
+set(WORDS_IN_LINE 0)
+foreach(BYTES ${SPIRV_BYTES})
+    string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1" WORD ${BYTES})
+    if(WORDS_IN_LINE EQUAL 0)
+        string(APPEND SPIRV_WORDS "\n   ")
+    endif()
+    string(APPEND SPIRV_WORDS " ${WORD},")
+    math(EXPR WORDS_IN_LINE "(${WORDS_IN_LINE} + 1) % 8")
+endforeach()
+
+get_filename_component(INPUT_NAME ${INPUT} NAME)
+string(TOUPPER "${NAME}_H_" GUARD)
+file(WRITE ${OUTPUT}
+"// Generated from ${INPUT_NAME} by embed_spirv.cmake, do not edit
+
+#ifndef ${GUARD}
+#define ${GUARD}
+
+#include <cstdint>
+
+constexpr uint32_t ${NAME}[] = {${SPIRV_WORDS}
+};
+
+#endif
+")
@@ -7,6 +7,9 @@
 
 #include <iostream>
 
+#include "shader.frag.spv.h"
+#include "shader.vert.spv.h"
+
 bool HelloTriangle::CreateRenderPass() {
   VkAttachmentDescription attachment_descriptions[] = {{
       0,                             // VkAttachmentDescriptionFlags   flags
@@ -17,7 +20,7 @@ bool HelloTriangle::CreateRenderPass() {
       VK_ATTACHMENT_LOAD_OP_DONT_CARE,   // VkAttachmentLoadOp stencilLoadOp
       VK_ATTACHMENT_STORE_OP_DONT_CARE,  // VkAttachmentStoreOp stencilStoreOp
       VK_IMAGE_LAYOUT_UNDEFINED,         // VkImageLayout initialLayout;
-      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR    // VkImageLayout finalLayout
+      GetSwapChain().PresentLayout       // VkImageLayout finalLayout
   }};
 
   VkAttachmentReference color_attachment_references[] = {{
@@ -65,21 +68,11 @@ bool HelloTriangle::CreateFramebuffers() {
   framebuffers_.resize(swap_chain_images.size());
 
   for (size_t i = 0; i < swap_chain_images.size(); ++i) {
-    VkFramebufferCreateInfo framebuffer_create_info = {
-        VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,  // VkStructureType sType
-        nullptr,       // const void                    *pNext
-        0,             // VkFramebufferCreateFlags       flags
-        render_pass_,  // VkRenderPass                   renderPass
-        1,             // uint32_t                       attachmentCount
-        &swap_chain_images[i].View,  // const VkImageView *pAttachments
-        800,                         // uint32_t                       width
-        600,                         // uint32_t                       height
-        1                            // uint32_t                       layers
-    };
-
-    if (vkCreateFramebuffer(GetDevice(), &framebuffer_create_info, nullptr,
-                            &framebuffers_[i]) != VK_SUCCESS) {
-      std::cout << "Could not create a framebuffer!" << std::endl;
+    // Framebuffers are owned by the common cache and released with the swap
+    // chain images they reference
+    framebuffers_[i] =
+        GetFramebuffer(render_pass_, &swap_chain_images[i].View, 1);
+    if (framebuffers_[i] == VK_NULL_HANDLE) {
       return false;
     }
   }
@@ -89,10 +82,10 @@ bool HelloTriangle::CreateFramebuffers() {
 bool HelloTriangle::CreatePipeline() {
   Tools::AutoDeleter<VkShaderModule, PFN_vkDestroyShaderModule>
       vertex_shader_module =
-          CreateShaderModule("data/2.1.hello_triangle/shader.vert.spv");
+          CreateShaderModule(shader_vert_spv, sizeof(shader_vert_spv));
   Tools::AutoDeleter<VkShaderModule, PFN_vkDestroyShaderModule>
       fragment_shader_module =
-          CreateShaderModule("data/2.1.hello_triangle/shader.frag.spv");
+          CreateShaderModule(shader_frag_spv, sizeof(shader_frag_spv));
 
   if (!vertex_shader_module || !fragment_shader_module) {
     return false;
@@ -144,35 +137,15 @@ bool HelloTriangle::CreatePipeline() {
       VK_FALSE                              // VkBool32 primitiveRestartEnable
   };
 
-  VkViewport viewport = {
-      0.0f,    // float                                          x
-      0.0f,    // float                                          y
-      800.0f,  // float                                          width
-      600.0f,  // float                                          height
-      0.0f,    // float                                          minDepth
-      1.0f     // float                                          maxDepth
-  };
-
-  VkRect2D scissor = {{
-                          // VkOffset2D offset
-                          0,  // int32_t x
-                          0  // int32_t                                        y
-                      },
-                      {
-                          // VkExtent2D extent
-                          800,  // int32_t width
-                          600   // int32_t height
-                      }};
-
   VkPipelineViewportStateCreateInfo viewport_state_create_info = {
       VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,  // VkStructureType
                                                               // sType
       nullptr,  // const void                                    *pNext
       0,        // VkPipelineViewportStateCreateFlags             flags
       1,        // uint32_t                                       viewportCount
-      &viewport,  // const VkViewport                              *pViewports
-      1,          // uint32_t                                       scissorCount
-      &scissor    // const VkRect2D                                *pScissors
+      nullptr,  // const VkViewport                              *pViewports
+      1,        // uint32_t                                       scissorCount
+      nullptr   // const VkRect2D                                *pScissors
   };
 
   VkPipelineRasterizationStateCreateInfo rasterization_state_create_info = {
@@ -231,6 +204,23 @@ bool HelloTriangle::CreatePipeline() {
       {0.0f, 0.0f, 0.0f, 0.0f}        // float blendConstants[4]
   };
 
+  // Viewport and scissor are set while recording, so the pipeline does not
+  // depend on the swap chain extent and survives window resizes
+  std::vector<VkDynamicState> dynamic_states = {
+      VK_DYNAMIC_STATE_VIEWPORT,
+      VK_DYNAMIC_STATE_SCISSOR,
+  };
+
+  VkPipelineDynamicStateCreateInfo dynamic_state_create_info = {
+      VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,  // VkStructureType
+                                                             // sType
+      nullptr,  // const void                                    *pNext
+      0,        // VkPipelineDynamicStateCreateFlags              flags
+      static_cast<uint32_t>(
+          dynamic_states.size()),  // uint32_t dynamicStateCount
+      dynamic_states.data()        // const VkDynamicState *pDynamicStates
+  };
+
   Tools::AutoDeleter<VkPipelineLayout, PFN_vkDestroyPipelineLayout>
       pipeline_layout = CreatePipelineLayout();
   if (!pipeline_layout) {
@@ -266,7 +256,8 @@ bool HelloTriangle::CreatePipeline() {
       &color_blend_state_create_info,  // const
                                        // VkPipelineColorBlendStateCreateInfo
                                        // *pColorBlendState
-      nullptr,  // const VkPipelineDynamicStateCreateInfo        *pDynamicState
+      &dynamic_state_create_info,  // const VkPipelineDynamicStateCreateInfo
+                                   // *pDynamicState
       pipeline_layout.Get(),  // VkPipelineLayout layout
       render_pass_,           // VkRenderPass renderPass
       0,               // uint32_t                                       subpass
@@ -274,9 +265,11 @@ bool HelloTriangle::CreatePipeline() {
       -1  // int32_t                                        basePipelineIndex
   };
 
-  if (vkCreateGraphicsPipelines(GetDevice(), VK_NULL_HANDLE, 1,
-                                &pipeline_create_info, nullptr,
-                                &graphics_pipeline_) != VK_SUCCESS) {
+  if (!LoadPipelineCache("data/2.1.hello_triangle/pipeline_cache.bin")) {
+    return false;
+  }
+
+  if (!CreateGraphicsPipeline(pipeline_create_info, &graphics_pipeline_)) {
     std::cout << "Could not create graphics pipeline!" << std::endl;
     return false;
   }
@@ -284,25 +277,19 @@ bool HelloTriangle::CreatePipeline() {
 }
 
 Tools::AutoDeleter<VkShaderModule, PFN_vkDestroyShaderModule>
-HelloTriangle::CreateShaderModule(const char* filename) {
-  const std::vector<char> code = Tools::GetBinaryFileContents(filename);
-  if (code.size() == 0) {
-    return Tools::AutoDeleter<VkShaderModule, PFN_vkDestroyShaderModule>();
-  }
-
+HelloTriangle::CreateShaderModule(const uint32_t* code, size_t code_size) {
   VkShaderModuleCreateInfo shader_module_create_info = {
       VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,  // VkStructureType sType
       nullptr,      // const void                    *pNext
       0,            // VkShaderModuleCreateFlags      flags
-      code.size(),  // size_t                         codeSize
-      reinterpret_cast<const uint32_t*>(code.data())  // const uint32_t *pCode
+      code_size,    // size_t                         codeSize
+      code          // const uint32_t                *pCode
   };
 
   VkShaderModule shader_module;
   if (vkCreateShaderModule(GetDevice(), &shader_module_create_info, nullptr,
                            &shader_module) != VK_SUCCESS) {
-    std::cout << "Could not create shader module from a \"" << filename
-              << "\" file!" << std::endl;
+    std::cout << "Could not create shader module!" << std::endl;
     return Tools::AutoDeleter<VkShaderModule, PFN_vkDestroyShaderModule>();
   }
 
@@ -333,81 +320,13 @@ HelloTriangle::CreatePipelineLayout() {
       pipeline_layout, vkDestroyPipelineLayout, GetDevice());
 }
 
-bool HelloTriangle::CreateSemaphores() {
-  VkSemaphoreCreateInfo semaphore_create_info = {
-      VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,  // VkStructureType sType
-      nullptr,  // const void*              pNext
-      0         // VkSemaphoreCreateFlags   flags
-  };
-
-  if ((vkCreateSemaphore(GetDevice(), &semaphore_create_info, nullptr,
-                         &image_available_semaphore_) != VK_SUCCESS) ||
-      (vkCreateSemaphore(GetDevice(), &semaphore_create_info, nullptr,
-                         &rendering_finished_femaphore_) != VK_SUCCESS)) {
-    std::cout << "Could not create semaphores!" << std::endl;
-    return false;
-  }
-
-  return true;
-}
-
-bool HelloTriangle::CreateCommandBuffers() {
-  if (!CreateCommandPool(GetGraphicsQueue().FamilyIndex,
-                         &graphics_command_pool_)) {
-    std::cout << "Could not create command pool!" << std::endl;
-    return false;
-  }
-
-  uint32_t image_count = static_cast<uint32_t>(GetSwapChain().Images.size());
-  graphics_command_buffers_.resize(image_count, VK_NULL_HANDLE);
-
-  if (!AllocateCommandBuffers(graphics_command_pool_, image_count,
-                              graphics_command_buffers_.data())) {
-    std::cout << "Could not allocate command buffers!" << std::endl;
-    return false;
-  }
-  return true;
-}
-
-bool HelloTriangle::CreateCommandPool(uint32_t queue_family_index,
-                                      VkCommandPool* pool) {
-  VkCommandPoolCreateInfo cmd_pool_create_info = {
-      VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,  // VkStructureType sType
-      nullptr,            // const void                    *pNext
-      0,                  // VkCommandPoolCreateFlags       flags
-      queue_family_index  // uint32_t                       queueFamilyIndex
-  };
-
-  if (vkCreateCommandPool(GetDevice(), &cmd_pool_create_info, nullptr, pool) !=
-      VK_SUCCESS) {
-    return false;
-  }
-  return true;
-}
-
-bool HelloTriangle::AllocateCommandBuffers(VkCommandPool pool, uint32_t count,
-                                           VkCommandBuffer* command_buffers) {
-  VkCommandBufferAllocateInfo command_buffer_allocate_info = {
-      VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,  // VkStructureType sType
-      nullptr,  // const void                    *pNext
-      pool,     // VkCommandPool                  commandPool
-      VK_COMMAND_BUFFER_LEVEL_PRIMARY,  // VkCommandBufferLevel           level
-      count  // uint32_t                       bufferCount
-  };
-
-  if (vkAllocateCommandBuffers(GetDevice(), &command_buffer_allocate_info,
-                               command_buffers) != VK_SUCCESS) {
-    return false;
-  }
-  return true;
-}
-
-bool HelloTriangle::RecordCommandBuffers() {
+bool HelloTriangle::RecordCommandBuffer(VkCommandBuffer command_buffer,
+                                        uint32_t image_index) {
   VkCommandBufferBeginInfo graphics_commandd_buffer_begin_info = {
       VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,  // VkStructureType sType
       nullptr,  // const void                            *pNext
-      VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,  // VkCommandBufferUsageFlags
-                                                     // flags
+      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,  // VkCommandBufferUsageFlags
+                                                    // flags
       nullptr  // const VkCommandBufferInheritanceInfo  *pInheritanceInfo
   };
 
@@ -423,171 +342,151 @@ bool HelloTriangle::RecordCommandBuffers() {
       {0.2f, 0.3f, 0.3f, 1.0f},  // VkClearColorValue              color
   };
 
-  const std::vector<ImageParameters>& swap_chain_images = GetSwapChain().Images;
+  const ImageParameters& image = GetSwapChain().Images[image_index];
+
+  vkBeginCommandBuffer(command_buffer, &graphics_commandd_buffer_begin_info);
+
+  if (GetPresentQueue().Handle != GetGraphicsQueue().Handle) {
+    VkImageMemoryBarrier barrier_from_present_to_draw = {
+        VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,  // VkStructureType sType
+        nullptr,                    // const void                    *pNext
+        VK_ACCESS_MEMORY_READ_BIT,  // VkAccessFlags srcAccessMask
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,  // VkAccessFlags dstAccessMask
+        VK_IMAGE_LAYOUT_UNDEFINED,             // VkImageLayout oldLayout
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,       // VkImageLayout newLayout
+        GetPresentQueue().FamilyIndex,         // uint32_t srcQueueFamilyIndex
+        GetGraphicsQueue().FamilyIndex,        // uint32_t dstQueueFamilyIndex
+        image.Handle,                          // VkImage image
+        image_subresource_range  // VkImageSubresourceRange subresourceRange
+    };
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0,
+                         nullptr, 0, nullptr, 1, &barrier_from_present_to_draw);
+  }
 
-  for (size_t i = 0; i < graphics_command_buffers_.size(); ++i) {
-    vkBeginCommandBuffer(graphics_command_buffers_[i],
-                         &graphics_commandd_buffer_begin_info);
-
-    if (GetPresentQueue().Handle != GetGraphicsQueue().Handle) {
-      VkImageMemoryBarrier barrier_from_present_to_draw = {
-          VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,  // VkStructureType sType
-          nullptr,                    // const void                    *pNext
-          VK_ACCESS_MEMORY_READ_BIT,  // VkAccessFlags srcAccessMask
-          VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,  // VkAccessFlags dstAccessMask
-          VK_IMAGE_LAYOUT_UNDEFINED,             // VkImageLayout oldLayout
-          VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,       // VkImageLayout newLayout
-          GetPresentQueue().FamilyIndex,         // uint32_t srcQueueFamilyIndex
-          GetGraphicsQueue().FamilyIndex,        // uint32_t dstQueueFamilyIndex
-          swap_chain_images[i].Handle,  // VkImage                        image
-          image_subresource_range  // VkImageSubresourceRange subresourceRange
-      };
-      vkCmdPipelineBarrier(graphics_command_buffers_[i],
-                           VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                           VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0,
-                           nullptr, 0, nullptr, 1,
-                           &barrier_from_present_to_draw);
-    }
+  VkRenderPassBeginInfo render_pass_begin_info = {
+      VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,  // VkStructureType sType
+      nullptr,                     // const void *pNext
+      render_pass_,                // VkRenderPass renderPass
+      framebuffers_[image_index],  // VkFramebuffer framebuffer
+      {                            // VkRect2D renderArea
+       {
+           // VkOffset2D                     offset
+           0,  // int32_t                        x
+           0   // int32_t                        y
+       },
+       GetSwapChain().Extent},  // VkExtent2D extent
+      1,            // uint32_t                       clearValueCount
+      &clear_value  // const VkClearValue            *pClearValues
+  };
 
-    VkRenderPassBeginInfo render_pass_begin_info = {
-        VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,  // VkStructureType sType
-        nullptr,           // const void                    *pNext
-        render_pass_,      // VkRenderPass                   renderPass
-        framebuffers_[i],  // VkFramebuffer                  framebuffer
-        {                  // VkRect2D                       renderArea
-         {
-             // VkOffset2D                     offset
-             0,  // int32_t                        x
-             0   // int32_t                        y
-         },
-         {
-             // VkExtent2D                     extent
-             800,  // int32_t                        width
-             600,  // int32_t                        height
-         }},
-        1,            // uint32_t                       clearValueCount
-        &clear_value  // const VkClearValue            *pClearValues
-    };
+  vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info,
+                       VK_SUBPASS_CONTENTS_INLINE);
 
-    vkCmdBeginRenderPass(graphics_command_buffers_[i], &render_pass_begin_info,
-                         VK_SUBPASS_CONTENTS_INLINE);
-
-    vkCmdBindPipeline(graphics_command_buffers_[i],
-                      VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_);
-
-    vkCmdDraw(graphics_command_buffers_[i], 3, 1, 0, 0);
-
-    vkCmdEndRenderPass(graphics_command_buffers_[i]);
-
-    if (GetGraphicsQueue().Handle != GetPresentQueue().Handle) {
-      VkImageMemoryBarrier barrier_from_draw_to_present = {
-          VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,  // VkStructureType sType
-          nullptr,  // const void                  *pNext
-          VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,  // VkAccessFlags srcAccessMask
-          VK_ACCESS_MEMORY_READ_BIT,             // VkAccessFlags dstAccessMask
-          VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,       // VkImageLayout oldLayout
-          VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,       // VkImageLayout newLayout
-          GetGraphicsQueue().FamilyIndex,        // uint32_t srcQueueFamilyIndex
-          GetPresentQueue().FamilyIndex,         // uint32_t dstQueueFamilyIndex
-          swap_chain_images[i].Handle,  // VkImage                      image
-          image_subresource_range  // VkImageSubresourceRange subresourceRange
-      };
-      vkCmdPipelineBarrier(graphics_command_buffers_[i],
-                           VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                           VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
-                           0, nullptr, 1, &barrier_from_draw_to_present);
-    }
-    if (vkEndCommandBuffer(graphics_command_buffers_[i]) != VK_SUCCESS) {
-      std::cout << "Could not record command buffer!" << std::endl;
-      return false;
-    }
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    graphics_pipeline_);
+
+  VkViewport viewport = {
+      0.0f,  // float                                          x
+      0.0f,  // float                                          y
+      static_cast<float>(
+          GetSwapChain().Extent.width),  // float width
+      static_cast<float>(
+          GetSwapChain().Extent.height),  // float height
+      0.0f,  // float                                          minDepth
+      1.0f   // float                                          maxDepth
+  };
+  vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+  VkRect2D scissor = {{
+                          // VkOffset2D                             offset
+                          0,  // int32_t                                x
+                          0   // int32_t                                y
+                      },
+                      GetSwapChain().Extent};  // VkExtent2D extent
+  vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+  vkCmdDraw(command_buffer, 3, 1, 0, 0);
+
+  vkCmdEndRenderPass(command_buffer);
+
+  if (GetGraphicsQueue().Handle != GetPresentQueue().Handle) {
+    VkImageMemoryBarrier barrier_from_draw_to_present = {
+        VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,  // VkStructureType sType
+        nullptr,  // const void                  *pNext
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,  // VkAccessFlags srcAccessMask
+        VK_ACCESS_MEMORY_READ_BIT,             // VkAccessFlags dstAccessMask
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,       // VkImageLayout oldLayout
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,       // VkImageLayout newLayout
+        GetGraphicsQueue().FamilyIndex,        // uint32_t srcQueueFamilyIndex
+        GetPresentQueue().FamilyIndex,         // uint32_t dstQueueFamilyIndex
+        image.Handle,                          // VkImage image
+        image_subresource_range  // VkImageSubresourceRange subresourceRange
+    };
+    vkCmdPipelineBarrier(command_buffer,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &barrier_from_draw_to_present);
+  }
+  if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+    std::cout << "Could not record command buffer!" << std::endl;
+    return false;
   }
   return true;
 }
 
 void HelloTriangle::ChildClear() {
   if (GetDevice() != VK_NULL_HANDLE) {
-    vkDeviceWaitIdle(GetDevice());
-
-    if ((graphics_command_buffers_.size() > 0) &&
-        (graphics_command_buffers_[0] != VK_NULL_HANDLE)) {
-      vkFreeCommandBuffers(
-          GetDevice(), graphics_command_pool_,
-          static_cast<uint32_t>(graphics_command_buffers_.size()),
-          graphics_command_buffers_.data());
-      graphics_command_buffers_.clear();
-    }
+    // Frames in flight may still use them; the base class flushes the queue
+    // after waiting for the device when it gets destroyed
+    uint64_t last_use = GetTimeline().GetLastSignaledValue();
 
-    if (graphics_command_pool_ != VK_NULL_HANDLE) {
-      vkDestroyCommandPool(GetDevice(), graphics_command_pool_, nullptr);
-      graphics_command_pool_ = VK_NULL_HANDLE;
-    }
-
-    if (graphics_pipeline_ != VK_NULL_HANDLE) {
-      vkDestroyPipeline(GetDevice(), graphics_pipeline_, nullptr);
-      graphics_pipeline_ = VK_NULL_HANDLE;
-    }
+    // Both are handed to the deletion queue when leaving this scope
+    Tools::AutoDeleter<VkPipeline, PFN_vkDestroyPipeline> graphics_pipeline(
+        graphics_pipeline_, vkDestroyPipeline, GetDevice());
+    graphics_pipeline.Defer(&GetDeletionQueue(), last_use);
+    graphics_pipeline_ = VK_NULL_HANDLE;
 
-    if (render_pass_ != VK_NULL_HANDLE) {
-      vkDestroyRenderPass(GetDevice(), render_pass_, nullptr);
-      render_pass_ = VK_NULL_HANDLE;
-    }
+    Tools::AutoDeleter<VkRenderPass, PFN_vkDestroyRenderPass> render_pass(
+        render_pass_, vkDestroyRenderPass, GetDevice());
+    render_pass.Defer(&GetDeletionQueue(), last_use);
+    render_pass_ = VK_NULL_HANDLE;
 
-    for (size_t i = 0; i < framebuffers_.size(); ++i) {
-      if (framebuffers_[i] != VK_NULL_HANDLE) {
-        vkDestroyFramebuffer(GetDevice(), framebuffers_[i], nullptr);
-        framebuffers_[i] = VK_NULL_HANDLE;
-      }
-    }
     framebuffers_.clear();
   }
 }
 
 bool HelloTriangle::ChildOnWindowSizeChanged() {
-  if (!CreateRenderPass()) {
-    return false;
-  }
-  if (!CreateFramebuffers()) {
-    return false;
-  }
-  if (!CreatePipeline()) {
-    return false;
-  }
-  if (!CreateCommandBuffers()) {
-    return false;
-  }
-  if (!RecordCommandBuffers()) {
-    return false;
+  // The render pass and the pipeline are cleared only when the swap chain
+  // format changed; framebuffers always follow the new image views
+  if (render_pass_ == VK_NULL_HANDLE) {
+    if (!CreateRenderPass()) {
+      return false;
+    }
+    if (!CreatePipeline()) {
+      return false;
+    }
   }
-
-  return true;
+  return CreateFramebuffers();
 }
 
 HelloTriangle::~HelloTriangle() {
   ChildClear();
 
-  if (GetDevice() != VK_NULL_HANDLE) {
-    vkDeviceWaitIdle(GetDevice());
-
-    if (image_available_semaphore_ != VK_NULL_HANDLE) {
-      vkDestroySemaphore(GetDevice(), image_available_semaphore_, nullptr);
-    }
-
-    if (rendering_finished_femaphore_ != VK_NULL_HANDLE) {
-      vkDestroySemaphore(GetDevice(), rendering_finished_femaphore_, nullptr);
-    }
-  }
 }
 
 HelloTriangle::HelloTriangle() {}
 
 bool HelloTriangle::Draw() {
-  VkSwapchainKHR swap_chain = GetSwapChain().Handle;
+  FrameContext *frame = BeginFrame();
+  if (frame == nullptr) {
+    return false;
+  }
   uint32_t image_index;
 
-  VkResult result = vkAcquireNextImageKHR(GetDevice(), swap_chain, UINT64_MAX,
-                                          image_available_semaphore_,
-                                          VK_NULL_HANDLE, &image_index);
+  VkResult result =
+      AcquireNextImage(frame->ImageAvailableSemaphore, &image_index);
   switch (result) {
     case VK_SUCCESS:
     case VK_SUBOPTIMAL_KHR:
@@ -600,37 +499,17 @@ bool HelloTriangle::Draw() {
       return false;
   }
 
-  VkPipelineStageFlags wait_dst_stage_mask =
-      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  VkSubmitInfo submit_info = {
-      VK_STRUCTURE_TYPE_SUBMIT_INFO,  // VkStructureType              sType
-      nullptr,                        // const void                  *pNext
-      1,  // uint32_t                     waitSemaphoreCount
-      &image_available_semaphore_,  // const VkSemaphore *pWaitSemaphores
-      &wait_dst_stage_mask,  // const VkPipelineStageFlags  *pWaitDstStageMask;
-      1,                     // uint32_t                     commandBufferCount
-      &graphics_command_buffers_[image_index],  // const VkCommandBuffer
-                                                // *pCommandBuffers
-      1,  // uint32_t                     signalSemaphoreCount
-      &rendering_finished_femaphore_  // const VkSemaphore *pSignalSemaphores
-  };
+  // The frame's command buffer is recycled every frame instead of keeping a
+  // pre-recorded one per swap chain image
+  if (!RecordCommandBuffer(frame->CommandBuffer, image_index)) {
+    return false;
+  }
 
-  if (vkQueueSubmit(GetGraphicsQueue().Handle, 1, &submit_info,
-                    VK_NULL_HANDLE) != VK_SUCCESS) {
+  if (SubmitFrame(*frame, frame->CommandBuffer) != VK_SUCCESS) {
     return false;
   }
 
-  VkPresentInfoKHR present_info = {
-      VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,  // VkStructureType              sType
-      nullptr,                             // const void                  *pNext
-      1,  // uint32_t                     waitSemaphoreCount
-      &rendering_finished_femaphore_,  // const VkSemaphore *pWaitSemaphores
-      1,             // uint32_t                     swapchainCount
-      &swap_chain,   // const VkSwapchainKHR        *pSwapchains
-      &image_index,  // const uint32_t              *pImageIndices
-      nullptr        // VkResult                    *pResults
-  };
-  result = vkQueuePresentKHR(GetPresentQueue().Handle, &present_info);
+  result = PresentImage(frame->FinishedRenderingSemaphore, image_index);
 
   switch (result) {
     case VK_SUCCESS:
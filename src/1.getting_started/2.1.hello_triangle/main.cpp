@@ -17,23 +17,47 @@
 #include <iostream>
 
 #include "hello_triangle.h"
+#include "options.h"
 #include "window.h"
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
 int main(int argc, char **argv) {
+  ApplicationOptions options;
+  if (!ParseApplicationOptions(argc, argv, &options)) {
+    return -1;
+  }
+
   Window window;
   HelloTriangle helloTriangle;
-  // Window creation
-  if (!window.Create("Hello, triangle", WIDTH, HEIGHT)) {
+  helloTriangle.SetDevicePreference(options.Device);
+  if (!helloTriangle.SetPresentPolicy(options.PresentMode,
+                                      options.SwapChainImages)) {
     return -1;
   }
+  if (options.Headless) {
+    // Vulkan preparations and initialization without any window
+    if (!helloTriangle.PrepareVulkanHeadless(WIDTH, HEIGHT,
+                                             options.HeadlessSurface)) {
+      return -1;
+    }
+  } else {
+    // Window creation
+    if (!window.Create("Hello, triangle", WIDTH, HEIGHT)) {
+      return -1;
+    }
 
-  // Vulkan preparations and initialization
-  if (!helloTriangle.PrepareVulkan(window.GetWindow())) {
+    // Vulkan preparations and initialization
+    if (!helloTriangle.PrepareVulkan(window.GetWindow())) {
+      return -1;
+    }
+  }
+
+  if (!helloTriangle.CreateFrameContexts(options.FramesInFlight)) {
     return -1;
   }
+  helloTriangle.SetFramePacing(options.FpsCap, options.LowLatency);
 
   if (!helloTriangle.CreateRenderPass()) {
     return -1;
@@ -45,18 +69,8 @@ int main(int argc, char **argv) {
     return -1;
   }
 
-  if (!helloTriangle.CreateSemaphores()) {
-    return -1;
-  }
-  if (!helloTriangle.CreateCommandBuffers()) {
-    return -1;
-  }
-  if (!helloTriangle.RecordCommandBuffers()) {
-    return -1;
-  }
-
   // Rendering loop
-  if (!window.RenderingLoop(helloTriangle)) {
+  if (!window.RenderingLoop(helloTriangle, options)) {
     return -1;
   }
   return 0;
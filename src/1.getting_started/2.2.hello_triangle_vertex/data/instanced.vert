@@ -0,0 +1,20 @@
+#version 450
+
+layout(location = 0) in vec4 i_Position;
+layout(location = 1) in vec4 i_Color;
+
+// Per instance: offset (xy) and scale (zw) in clip space, and a tint
+layout(location = 2) in vec4 i_Transform;
+layout(location = 3) in vec4 i_InstanceColor;
+
+out gl_PerVertex
+{
+  vec4 gl_Position;
+};
+
+layout(location = 0) out vec4 v_Color;
+
+void main() {
+    gl_Position = vec4(i_Position.xy * i_Transform.zw + i_Transform.xy, i_Position.zw);
+    v_Color = i_Color * i_InstanceColor;
+}
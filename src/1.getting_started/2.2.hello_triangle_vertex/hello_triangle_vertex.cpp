@@ -18,9 +18,16 @@
 
 #include <string.h>
 
+#include <cmath>
 #include <cstddef>
+#include <iomanip>
 #include <iostream>
 
+#include "cull.comp.spv.h"
+#include "instanced.vert.spv.h"
+#include "shader.frag.spv.h"
+#include "shader.vert.spv.h"
+
 HelloTriangleVertex::HelloTriangleVertex() {}
 
 bool HelloTriangleVertex::CreateRenderPass() {
@@ -33,7 +40,7 @@ bool HelloTriangleVertex::CreateRenderPass() {
       VK_ATTACHMENT_LOAD_OP_DONT_CARE,   // VkAttachmentLoadOp stencilLoadOp
       VK_ATTACHMENT_STORE_OP_DONT_CARE,  // VkAttachmentStoreOp stencilStoreOp
       VK_IMAGE_LAYOUT_UNDEFINED,         // VkImageLayout initialLayout;
-      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR    // VkImageLayout finalLayout
+      GetSwapChain().PresentLayout       // VkImageLayout finalLayout
   }};
 
   VkAttachmentReference color_attachment_references[] = {{
@@ -101,25 +108,20 @@ bool HelloTriangleVertex::CreateRenderPass() {
 }
 
 Tools::AutoDeleter<VkShaderModule, PFN_vkDestroyShaderModule>
-HelloTriangleVertex::CreateShaderModule(const char *filename) {
-  const std::vector<char> code = Tools::GetBinaryFileContents(filename);
-  if (code.size() == 0) {
-    return Tools::AutoDeleter<VkShaderModule, PFN_vkDestroyShaderModule>();
-  }
-
+HelloTriangleVertex::CreateShaderModule(const uint32_t *code,
+                                        size_t code_size) {
   VkShaderModuleCreateInfo shader_module_create_info = {
       VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,  // VkStructureType sType
       nullptr,      // const void                    *pNext
       0,            // VkShaderModuleCreateFlags      flags
-      code.size(),  // size_t                         codeSize
-      reinterpret_cast<const uint32_t *>(code.data())  // const uint32_t *pCode
+      code_size,    // size_t                         codeSize
+      code          // const uint32_t                *pCode
   };
 
   VkShaderModule shader_module;
   if (vkCreateShaderModule(GetDevice(), &shader_module_create_info, nullptr,
                            &shader_module) != VK_SUCCESS) {
-    std::cout << "Could not create shader module from a \"" << filename
-              << "\" file!" << std::endl;
+    std::cout << "Could not create shader module!" << std::endl;
     return Tools::AutoDeleter<VkShaderModule, PFN_vkDestroyShaderModule>();
   }
 
@@ -153,10 +155,13 @@ HelloTriangleVertex::CreatePipelineLayout() {
 bool HelloTriangleVertex::CreatePipeline() {
   Tools::AutoDeleter<VkShaderModule, PFN_vkDestroyShaderModule>
       vertex_shader_module =
-          CreateShaderModule("data/2.2.hello_triangle_vertex/shader.vert.spv");
+          Vulkan.Mode != DrawMode::PerCell
+              ? CreateShaderModule(instanced_vert_spv,
+                                   sizeof(instanced_vert_spv))
+              : CreateShaderModule(shader_vert_spv, sizeof(shader_vert_spv));
   Tools::AutoDeleter<VkShaderModule, PFN_vkDestroyShaderModule>
       fragment_shader_module =
-          CreateShaderModule("data/2.2.hello_triangle_vertex/shader.frag.spv");
+          CreateShaderModule(shader_frag_spv, sizeof(shader_frag_spv));
 
   if (!vertex_shader_module || !fragment_shader_module) {
     return false;
@@ -206,6 +211,33 @@ bool HelloTriangleVertex::CreatePipeline() {
            offsetof(struct VertexData, r)           // uint32_t offset
        }};
 
+  // Instance attributes advance once per instance instead of per vertex
+  if (Vulkan.Mode != DrawMode::PerCell) {
+    VkVertexInputBindingDescription instance_binding_description = {
+        1,                             // uint32_t binding
+        sizeof(InstanceData),          // uint32_t stride
+        VK_VERTEX_INPUT_RATE_INSTANCE  // VkVertexInputRate inputRate
+    };
+    vertex_binding_descriptions.push_back(instance_binding_description);
+
+    VkVertexInputAttributeDescription instance_attribute_descriptions[] = {
+        {
+            2,  // uint32_t                                       location
+            instance_binding_description.binding,  // uint32_t binding
+            VK_FORMAT_R32G32B32A32_SFLOAT,         // VkFormat format
+            offsetof(struct InstanceData, offset_x)  // uint32_t offset
+        },
+        {
+            3,  // uint32_t                                       location
+            instance_binding_description.binding,  // uint32_t binding
+            VK_FORMAT_R32G32B32A32_SFLOAT,         // VkFormat format
+            offsetof(struct InstanceData, r)       // uint32_t offset
+        }};
+    vertex_attribute_descriptions.insert(vertex_attribute_descriptions.end(),
+                                         instance_attribute_descriptions,
+                                         instance_attribute_descriptions + 2);
+  }
+
   VkPipelineVertexInputStateCreateInfo vertex_input_state_create_info = {
       VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,  // VkStructureType
                                                                   // sType
@@ -360,12 +392,105 @@ bool HelloTriangleVertex::CreatePipeline() {
       -1  // int32_t                                        basePipelineIndex
   };
 
-  if (vkCreateGraphicsPipelines(GetDevice(), VK_NULL_HANDLE, 1,
-                                &pipeline_create_info, nullptr,
-                                &Vulkan.GraphicsPipeline) != VK_SUCCESS) {
+  if (!LoadPipelineCache("data/2.2.hello_triangle_vertex/pipeline_cache.bin")) {
+    return false;
+  }
+
+  if (!CreateGraphicsPipeline(pipeline_create_info, &Vulkan.GraphicsPipeline)) {
     std::cout << "Could not create graphics pipeline!" << std::endl;
     return false;
   }
+
+  if ((Vulkan.Mode == DrawMode::Culled) && !CreateCullingPipeline()) {
+    return false;
+  }
+  return true;
+}
+
+bool HelloTriangleVertex::CreateCullingPipeline() {
+  std::vector<VkDescriptorSetLayoutBinding> layout_bindings;
+  for (uint32_t i = 0; i < 4; ++i) {
+    // Sources, bounding spheres, commands and count
+    VkDescriptorSetLayoutBinding layout_binding = {
+        i,  // uint32_t                       binding
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,  // VkDescriptorType
+                                                    // descriptorType
+        1,                            // uint32_t             descriptorCount
+        VK_SHADER_STAGE_COMPUTE_BIT,  // VkShaderStageFlags   stageFlags
+        nullptr  // const VkSampler                *pImmutableSamplers
+    };
+    layout_bindings.push_back(layout_binding);
+  }
+
+  VkDescriptorSetLayoutCreateInfo set_layout_create_info = {
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,  // VkStructureType
+                                                            // sType
+      nullptr,  // const void                    *pNext
+      0,        // VkDescriptorSetLayoutCreateFlags flags
+      static_cast<uint32_t>(layout_bindings.size()),  // uint32_t bindingCount
+      layout_bindings.data()  // const VkDescriptorSetLayoutBinding *pBindings
+  };
+
+  if (vkCreateDescriptorSetLayout(GetDevice(), &set_layout_create_info,
+                                  nullptr,
+                                  &Vulkan.Culling.SetLayout) != VK_SUCCESS) {
+    std::cout << "Could not create descriptor set layout!" << std::endl;
+    return false;
+  }
+
+  VkPushConstantRange push_constant_range = {
+      VK_SHADER_STAGE_COMPUTE_BIT,  // VkShaderStageFlags             stageFlags
+      0,                            // uint32_t                       offset
+      sizeof(CullingConstants)      // uint32_t                       size
+  };
+
+  VkPipelineLayoutCreateInfo layout_create_info = {
+      VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,  // VkStructureType sType
+      nullptr,  // const void                    *pNext
+      0,        // VkPipelineLayoutCreateFlags    flags
+      1,        // uint32_t                       setLayoutCount
+      &Vulkan.Culling.SetLayout,  // const VkDescriptorSetLayout *pSetLayouts
+      1,  // uint32_t                       pushConstantRangeCount
+      &push_constant_range  // const VkPushConstantRange *pPushConstantRanges
+  };
+
+  if (vkCreatePipelineLayout(GetDevice(), &layout_create_info, nullptr,
+                             &Vulkan.Culling.PipelineLayout) != VK_SUCCESS) {
+    std::cout << "Could not create pipeline layout!" << std::endl;
+    return false;
+  }
+
+  Tools::AutoDeleter<VkShaderModule, PFN_vkDestroyShaderModule>
+      compute_shader_module =
+          CreateShaderModule(cull_comp_spv, sizeof(cull_comp_spv));
+  if (!compute_shader_module) {
+    return false;
+  }
+
+  VkComputePipelineCreateInfo pipeline_create_info = {
+      VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,  // VkStructureType sType
+      nullptr,  // const void                                    *pNext
+      0,        // VkPipelineCreateFlags                          flags
+      {
+          // VkPipelineShaderStageCreateInfo                stage
+          VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,  // VkStructureType
+                                                                // sType
+          nullptr,  // const void                                    *pNext
+          0,        // VkPipelineShaderStageCreateFlags               flags
+          VK_SHADER_STAGE_COMPUTE_BIT,  // VkShaderStageFlagBits stage
+          compute_shader_module.Get(),  // VkShaderModule module
+          "main",  // const char                                    *pName
+          nullptr  // const VkSpecializationInfo *pSpecializationInfo
+      },
+      Vulkan.Culling.PipelineLayout,  // VkPipelineLayout layout
+      VK_NULL_HANDLE,                 // VkPipeline basePipelineHandle
+      -1  // int32_t                                        basePipelineIndex
+  };
+
+  if (!CreateComputePipeline(pipeline_create_info, &Vulkan.Culling.Pipeline)) {
+    std::cout << "Could not create compute pipeline!" << std::endl;
+    return false;
+  }
   return true;
 }
 
@@ -376,198 +501,547 @@ bool HelloTriangleVertex::CreateVertexBuffer() {
       {0.7f, -0.7f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f},
       {0.7f, 0.7f, 0.0f, 1.0f, 0.3f, 0.3f, 0.3f, 0.0f}};
 
-  Vulkan.VertexBuffer.Size = sizeof(vertex_data);
+  if (!CreateDeviceBuffer(vertex_data, sizeof(vertex_data),
+                          VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                          &Vulkan.VertexBuffer)) {
+    std::cout << "Could not create a vertex buffer!" << std::endl;
+    return false;
+  }
+
+  // Indirect commands are indexed draws of the same strip
+  if (UsesDrawList()) {
+    uint16_t index_data[] = {0, 1, 2, 3};
+    if (!CreateDeviceBuffer(index_data, sizeof(index_data),
+                            VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                            &Vulkan.IndexBuffer)) {
+      std::cout << "Could not create an index buffer!" << std::endl;
+      return false;
+    }
+  }
+
+  // The uploads share batches of the staging ring, and the buffers change
+  // queue family together
+  if (!GetUploadManager().WaitIdle()) {
+    std::cout << "Could not upload data to a buffer!" << std::endl;
+    return false;
+  }
+  std::vector<VkBuffer> buffers(1, Vulkan.VertexBuffer.Handle);
+  if (Vulkan.IndexBuffer.Handle != VK_NULL_HANDLE) {
+    buffers.push_back(Vulkan.IndexBuffer.Handle);
+  }
+
+  // Written on the transfer queue, read as vertex or index data on the
+  // graphics queue
+  return TransferBufferOwnership(
+      buffers, GetTransferQueue(), GetGraphicsQueue(),
+      VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+}
+
+bool HelloTriangleVertex::CreateDeviceBuffer(const void *data, uint32_t size,
+                                             VkBufferUsageFlags usage,
+                                             BufferParameters *buffer) {
+  buffer->Size = size;
 
   VkBufferCreateInfo buffer_create_info = {
       VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // VkStructureType        sType
       nullptr,                               // const void            *pNext
       0,                                     // VkBufferCreateFlags    flags
-      Vulkan.VertexBuffer.Size,              // VkDeviceSize           size
-      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,     // VkBufferUsageFlags     usage
+      buffer->Size,                          // VkDeviceSize           size
+      usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,  // VkBufferUsageFlags usage
       VK_SHARING_MODE_EXCLUSIVE,  // VkSharingMode          sharingMode
       0,       // uint32_t               queueFamilyIndexCount
       nullptr  // const uint32_t        *pQueueFamilyIndices
   };
 
   if (vkCreateBuffer(GetDevice(), &buffer_create_info, nullptr,
-                     &Vulkan.VertexBuffer.Handle) != VK_SUCCESS) {
-    std::cout << "Could not create a vertex buffer!" << std::endl;
+                     &buffer->Handle) != VK_SUCCESS) {
     return false;
   }
 
-  if (!AllocateBufferMemory(Vulkan.VertexBuffer.Handle,
-                            &Vulkan.VertexBuffer.Memory)) {
-    std::cout << "Could not allocate memory for a vertex buffer!" << std::endl;
+  if (!AllocateBufferMemory(buffer->Handle, &buffer->Memory)) {
+    std::cout << "Could not allocate memory for a buffer!" << std::endl;
     return false;
   }
 
-  if (vkBindBufferMemory(GetDevice(), Vulkan.VertexBuffer.Handle,
-                         Vulkan.VertexBuffer.Memory, 0) != VK_SUCCESS) {
-    std::cout << "Could not bind memory for a vertex buffer!" << std::endl;
+  if (vkBindBufferMemory(GetDevice(), buffer->Handle, buffer->Memory.Memory,
+                         buffer->Memory.Offset) != VK_SUCCESS) {
+    std::cout << "Could not bind memory for a buffer!" << std::endl;
     return false;
   }
 
-  void *vertex_buffer_memory_pointer;
-  if (vkMapMemory(GetDevice(), Vulkan.VertexBuffer.Memory, 0,
-                  Vulkan.VertexBuffer.Size, 0,
-                  &vertex_buffer_memory_pointer) != VK_SUCCESS) {
-    std::cout << "Could not map memory and upload data to a vertex buffer!"
-              << std::endl;
+  // Only recorded; the caller waits for all uploads at once
+  if (!GetUploadManager().UploadToBuffer(buffer->Handle, 0, data,
+                                         buffer->Size)) {
+    std::cout << "Could not upload data to a buffer!" << std::endl;
     return false;
   }
+  return true;
+}
 
-  memcpy(vertex_buffer_memory_pointer, vertex_data, Vulkan.VertexBuffer.Size);
-
-  VkMappedMemoryRange flush_range = {
-      VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,  // VkStructureType        sType
-      nullptr,                                // const void            *pNext
-      Vulkan.VertexBuffer.Memory,             // VkDeviceMemory         memory
-      0,                                      // VkDeviceSize           offset
-      VK_WHOLE_SIZE                           // VkDeviceSize           size
-  };
-  vkFlushMappedMemoryRanges(GetDevice(), 1, &flush_range);
+bool HelloTriangleVertex::AllocateBufferMemory(VkBuffer buffer,
+                                               MemoryAllocation *memory) {
+  return GetMemoryAllocator().AllocateForBuffer(
+      buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, memory);
+}
 
-  vkUnmapMemory(GetDevice(), Vulkan.VertexBuffer.Memory);
+void HelloTriangleVertex::SetDrawCount(uint32_t draw_count, DrawMode mode) {
+  Vulkan.DrawCount = draw_count;
+  Vulkan.Mode = mode;
+}
 
-  return true;
+VkDeviceSize HelloTriangleVertex::GetTransientBufferSize() const {
+  if (Vulkan.Mode == DrawMode::PerCell) {
+    return 0;
+  }
+  // Room for aligning the start of every allocation
+  VkDeviceSize size =
+      Vulkan.DrawCount * sizeof(InstanceData) + DrawList::SliceAlignment;
+  if (Vulkan.Mode == DrawMode::Culled) {
+    size +=
+        Vulkan.DrawCount * sizeof(BoundingSphere) + DrawList::SliceAlignment;
+  }
+  return size;
 }
 
-bool HelloTriangleVertex::AllocateBufferMemory(VkBuffer buffer,
-                                               VkDeviceMemory *memory) {
-  VkMemoryRequirements buffer_memory_requirements;
-  vkGetBufferMemoryRequirements(GetDevice(), buffer,
-                                &buffer_memory_requirements);
-
-  VkPhysicalDeviceMemoryProperties memory_properties;
-  vkGetPhysicalDeviceMemoryProperties(GetPhysicalDevice(), &memory_properties);
-
-  for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
-    if ((buffer_memory_requirements.memoryTypeBits & (1 << i)) &&
-        (memory_properties.memoryTypes[i].propertyFlags &
-         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
-      VkMemoryAllocateInfo memory_allocate_info = {
-          VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,  // VkStructureType sType
-          nullptr,  // const void                            *pNext
-          buffer_memory_requirements.size,  // VkDeviceSize allocationSize
-          i  // uint32_t                               memoryTypeIndex
-      };
+bool HelloTriangleVertex::CreateDrawList() {
+  // Every command picks its cell through firstInstance
+  if (!GetEnabledFeatures().drawIndirectFirstInstance) {
+    std::cout << "Indirect draws with a first instance are not supported!"
+              << std::endl;
+    return false;
+  }
+
+  if (!Vulkan.Draws.Init(GetDevice(), &GetMemoryAllocator(), Vulkan.DrawCount,
+                         GetFramesInFlight(),
+                         GetEnabledFeatures().multiDrawIndirect == VK_TRUE,
+                         GetDrawIndirectCountFunction())) {
+    return false;
+  }
 
-      if (vkAllocateMemory(GetDevice(), &memory_allocate_info, nullptr,
-                           memory) == VK_SUCCESS) {
-        return true;
-      }
+  for (uint32_t i = 0; i < Vulkan.DrawCount; ++i) {
+    VkDrawIndexedIndirectCommand command = {
+        4,  // uint32_t indexCount
+        1,  // uint32_t instanceCount
+        0,  // uint32_t firstIndex
+        0,  // int32_t  vertexOffset
+        i   // uint32_t firstInstance
+    };
+    if (!Vulkan.Draws.Add(command)) {
+      return false;
     }
   }
-  return false;
+  return true;
 }
 
-bool HelloTriangleVertex::CreateRenderingResources() {
-  if (!CreateCommandBuffers()) {
+bool HelloTriangleVertex::CreateHostVisibleBuffer(
+    VkDeviceSize size, VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags preferred_flags, BufferParameters *buffer) {
+  buffer->Size = static_cast<uint32_t>(size);
+
+  VkBufferCreateInfo buffer_create_info = {
+      VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // VkStructureType        sType
+      nullptr,                               // const void            *pNext
+      0,                                     // VkBufferCreateFlags    flags
+      size,                                  // VkDeviceSize           size
+      usage,                                 // VkBufferUsageFlags     usage
+      VK_SHARING_MODE_EXCLUSIVE,  // VkSharingMode          sharingMode
+      0,       // uint32_t               queueFamilyIndexCount
+      nullptr  // const uint32_t        *pQueueFamilyIndices
+  };
+
+  if (vkCreateBuffer(GetDevice(), &buffer_create_info, nullptr,
+                     &buffer->Handle) != VK_SUCCESS) {
     return false;
   }
-  if (!CreateSemaphores()) {
+
+  // Host visible memory stays mapped for the lifetime of the allocator, so
+  // every frame accesses it directly
+  if (!GetMemoryAllocator().AllocateForBuffer(
+          buffer->Handle, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, preferred_flags,
+          &buffer->Memory) ||
+      (buffer->Memory.Mapped == nullptr)) {
+    std::cout << "Could not allocate host visible memory for a buffer!"
+              << std::endl;
     return false;
   }
-  if (!CreateFences()) {
+
+  if (vkBindBufferMemory(GetDevice(), buffer->Handle, buffer->Memory.Memory,
+                         buffer->Memory.Offset) != VK_SUCCESS) {
+    std::cout << "Could not bind memory for a buffer!" << std::endl;
     return false;
   }
   return true;
 }
 
-bool HelloTriangleVertex::CreateCommandBuffers() {
-  if (!CreateCommandPool(GetGraphicsQueue().FamilyIndex, &Vulkan.CommandPool)) {
-    std::cout << "Could not create command pool!" << std::endl;
+void HelloTriangleVertex::DestroyBuffer(BufferParameters &buffer) {
+  if (buffer.Handle != VK_NULL_HANDLE) {
+    vkDestroyBuffer(GetDevice(), buffer.Handle, nullptr);
+    buffer.Handle = VK_NULL_HANDLE;
+  }
+  GetMemoryAllocator().Free(buffer.Memory);
+}
+
+bool HelloTriangleVertex::UsesDrawList() const {
+  return (Vulkan.Mode == DrawMode::Indirect) ||
+         (Vulkan.Mode == DrawMode::Culled);
+}
+
+bool HelloTriangleVertex::UpdateInstanceBuffer(FrameContext &frame) {
+  // The GPU is done with the frame context's transient buffer, so the data
+  // of this frame is written over the data of its previous use
+  TransientAllocation &instance_buffer = Vulkan.InstanceBuffers[frame.Index];
+  if (!AllocateTransientBuffer(frame, Vulkan.DrawCount * sizeof(InstanceData),
+                               sizeof(InstanceData), &instance_buffer)) {
+    std::cout << "Could not allocate an instance buffer!" << std::endl;
     return false;
   }
-  for (size_t i = 0; i < Vulkan.RenderingResources.size(); ++i) {
-    if (!AllocateCommandBuffers(Vulkan.CommandPool, 1,
-                                &Vulkan.RenderingResources[i].CommandBuffer)) {
-      std::cout << "Could not allocate command buffer!" << std::endl;
+  InstanceData *instances = static_cast<InstanceData *>(instance_buffer.Mapped);
+
+  // Same grid the per draw viewports cover, in clip space
+  uint32_t columns = static_cast<uint32_t>(
+      std::ceil(std::sqrt(static_cast<double>(Vulkan.DrawCount))));
+  uint32_t rows = (Vulkan.DrawCount + columns - 1) / columns;
+  float scale_x = 1.0f / columns;
+  float scale_y = 1.0f / rows;
+
+  // When culling, the grid sways sideways so that parts of it leave the view
+  bool culled = Vulkan.Mode == DrawMode::Culled;
+  float pan = culled ? std::sin(Vulkan.FrameNumber * 0.01f) : 0.0f;
+
+  // The grid is placed straight in clip space; its bounding spheres sit at a
+  // view space depth of 1, where they project onto the same area
+  std::array<float, 16> projection = GetProjectionMatrix();
+  float view_scale_x = 1.0f / projection[0];
+  float view_scale_y = 1.0f / projection[5];
+  BoundingSphere *spheres = nullptr;
+  if (culled) {
+    // Bound with a dynamic offset, which the slice alignment of the draw
+    // list satisfies on every device
+    TransientAllocation &sphere_buffer =
+        Vulkan.Culling.SphereBuffers[frame.Index];
+    if (!AllocateTransientBuffer(frame,
+                                 Vulkan.DrawCount * sizeof(BoundingSphere),
+                                 DrawList::SliceAlignment, &sphere_buffer)) {
+      std::cout << "Could not allocate a bounding sphere buffer!" << std::endl;
       return false;
     }
+    spheres = static_cast<BoundingSphere *>(sphere_buffer.Mapped);
   }
-  return true;
+
+  // Written sequentially and never read back, as the memory may be write
+  // combined
+  for (uint32_t i = 0; i < Vulkan.DrawCount; ++i) {
+    float tint =
+        0.5f + static_cast<float>((i + Vulkan.FrameNumber) % 64) / 126.0f;
+    InstanceData instance = {
+        -1.0f + (2 * (i % columns) + 1) * scale_x + pan,  // float offset_x
+        -1.0f + (2 * (i / columns) + 1) * scale_y,        // float offset_y
+        scale_x,                                          // float scale_x
+        scale_y,                                          // float scale_y
+        tint,                                             // float r
+        tint,                                             // float g
+        tint,                                             // float b
+        1.0f                                              // float a
+    };
+    instances[i] = instance;
+
+    if (culled) {
+      // Encloses the corners of the strip, which span 0.7 of the cell
+      float extent_x = 0.7f * scale_x * view_scale_x;
+      float extent_y = 0.7f * scale_y * view_scale_y;
+      BoundingSphere sphere = {
+          instance.offset_x * view_scale_x,  // float x
+          instance.offset_y * view_scale_y,  // float y
+          -1.0f,                             // float z
+          std::sqrt(extent_x * extent_x + extent_y * extent_y)  // float radius
+      };
+      spheres[i] = sphere;
+    }
+  }
+  ++Vulkan.FrameNumber;
+
+  return FlushTransientBuffer(frame);
 }
 
-bool HelloTriangleVertex::CreateCommandPool(uint32_t queue_family_index,
-                                            VkCommandPool *pool) {
-  VkCommandPoolCreateInfo cmd_pool_create_info = {
-      VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,  // VkStructureType sType
-      nullptr,  // const void                    *pNext
-      VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |  // VkCommandPoolCreateFlags
-                                                         // flags
-          VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
-      queue_family_index  // uint32_t                       queueFamilyIndex
-  };
+std::array<float, 16> HelloTriangleVertex::GetProjectionMatrix() const {
+  float aspect_ratio = static_cast<float>(GetSwapChain().Extent.width) /
+                       static_cast<float>(GetSwapChain().Extent.height);
+  return Tools::GetPerspectiveProjectionMatrix(aspect_ratio, 60.0f, 0.1f,
+                                               10.0f);
+}
 
-  if (vkCreateCommandPool(GetDevice(), &cmd_pool_create_info, nullptr, pool) !=
-      VK_SUCCESS) {
+bool HelloTriangleVertex::CreateRenderingResources() {
+  // Command buffers, semaphores and fences come from the frame contexts
+  if (!GetGpuProfiler().Init(GetPhysicalDevice(), GetDevice(),
+                             GetGraphicsQueue().FamilyIndex,
+                             GetFramesInFlight())) {
+    return false;
+  }
+  Vulkan.InstanceBuffers.assign(GetFramesInFlight(), TransientAllocation());
+  if (UsesDrawList() && !CreateDrawList()) {
+    return false;
+  }
+  if ((Vulkan.Mode == DrawMode::Culled) && !CreateCullingResources()) {
     return false;
   }
   return true;
 }
 
-bool HelloTriangleVertex::AllocateCommandBuffers(
-    VkCommandPool pool, uint32_t count, VkCommandBuffer *command_buffers) {
-  VkCommandBufferAllocateInfo command_buffer_allocate_info = {
-      VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,  // VkStructureType sType
-      nullptr,  // const void                    *pNext
-      pool,     // VkCommandPool                  commandPool
-      VK_COMMAND_BUFFER_LEVEL_PRIMARY,  // VkCommandBufferLevel           level
-      count  // uint32_t                       bufferCount
+bool HelloTriangleVertex::CreateCullingResources() {
+  CullingParameters &culling = Vulkan.Culling;
+  uint32_t frames_in_flight = GetFramesInFlight();
+
+  culling.SphereBuffers.assign(frames_in_flight, TransientAllocation());
+  // Read by the CPU, so cached memory is preferred
+  if (!CreateHostVisibleBuffer(frames_in_flight * sizeof(uint32_t),
+                               VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                               VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                               &culling.ResultBuffer)) {
+    std::cout << "Could not create a culling result buffer!" << std::endl;
+    return false;
+  }
+  culling.ResultPending.assign(frames_in_flight, 0);
+
+  VkDescriptorPoolSize pool_size = {
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,  // VkDescriptorType type
+      4 * frames_in_flight  // uint32_t                       descriptorCount
+  };
+
+  VkDescriptorPoolCreateInfo pool_create_info = {
+      VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,  // VkStructureType sType
+      nullptr,           // const void                    *pNext
+      0,                 // VkDescriptorPoolCreateFlags    flags
+      frames_in_flight,  // uint32_t                       maxSets
+      1,                 // uint32_t                       poolSizeCount
+      &pool_size         // const VkDescriptorPoolSize    *pPoolSizes
   };
 
-  if (vkAllocateCommandBuffers(GetDevice(), &command_buffer_allocate_info,
-                               command_buffers) != VK_SUCCESS) {
+  if (vkCreateDescriptorPool(GetDevice(), &pool_create_info, nullptr,
+                             &culling.DescriptorPool) != VK_SUCCESS) {
+    std::cout << "Could not create descriptor pool!" << std::endl;
     return false;
   }
+
+  std::vector<VkDescriptorSetLayout> set_layouts(frames_in_flight,
+                                                 culling.SetLayout);
+  VkDescriptorSetAllocateInfo set_allocate_info = {
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,  // VkStructureType sType
+      nullptr,                 // const void                    *pNext
+      culling.DescriptorPool,  // VkDescriptorPool               descriptorPool
+      frames_in_flight,        // uint32_t              descriptorSetCount
+      set_layouts.data()       // const VkDescriptorSetLayout   *pSetLayouts
+  };
+
+  culling.DescriptorSets.resize(frames_in_flight);
+  if (vkAllocateDescriptorSets(GetDevice(), &set_allocate_info,
+                               culling.DescriptorSets.data()) != VK_SUCCESS) {
+    std::cout << "Could not allocate descriptor sets!" << std::endl;
+    return false;
+  }
+
+  // Ranges cover one frame's slice of the draw list or its bounding spheres,
+  // the dynamic offsets pick where the frame's data starts
+  VkDescriptorBufferInfo source_info = {
+      Vulkan.Draws.GetSourceBuffer().Handle,  // VkBuffer buffer
+      0,                                      // VkDeviceSize offset
+      Vulkan.Draws.GetCommandSliceSize()      // VkDeviceSize range
+  };
+  VkDescriptorBufferInfo list_infos[] = {
+      {
+          Vulkan.Draws.GetCommandBuffer().Handle,  // VkBuffer buffer
+          0,                                       // VkDeviceSize offset
+          Vulkan.Draws.GetCommandSliceSize()       // VkDeviceSize range
+      },
+      {
+          Vulkan.Draws.GetCountBuffer().Handle,  // VkBuffer buffer
+          0,                                     // VkDeviceSize offset
+          sizeof(uint32_t)                       // VkDeviceSize range
+      }};
+
+  std::vector<VkDescriptorBufferInfo> sphere_infos;
+  for (uint32_t i = 0; i < frames_in_flight; ++i) {
+    VkDescriptorBufferInfo sphere_info = {
+        GetFrameContext(i).TransientBuffer.Handle,  // VkBuffer buffer
+        0,                                           // VkDeviceSize offset
+        Vulkan.DrawCount * sizeof(BoundingSphere)    // VkDeviceSize range
+    };
+    sphere_infos.push_back(sphere_info);
+  }
+
+  std::vector<VkWriteDescriptorSet> descriptor_writes;
+  for (uint32_t i = 0; i < frames_in_flight; ++i) {
+    VkWriteDescriptorSet source_write = {
+        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,  // VkStructureType sType
+        nullptr,                    // const void                    *pNext
+        culling.DescriptorSets[i],  // VkDescriptorSet                dstSet
+        0,                          // uint32_t                       dstBinding
+        0,                          // uint32_t                  dstArrayElement
+        1,                          // uint32_t                  descriptorCount
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,  // VkDescriptorType
+                                                    // descriptorType
+        nullptr,       // const VkDescriptorImageInfo   *pImageInfo
+        &source_info,  // const VkDescriptorBufferInfo  *pBufferInfo
+        nullptr        // const VkBufferView            *pTexelBufferView
+    };
+    descriptor_writes.push_back(source_write);
+
+    VkWriteDescriptorSet sphere_write = source_write;
+    sphere_write.dstBinding = 1;
+    sphere_write.pBufferInfo = &sphere_infos[i];
+    descriptor_writes.push_back(sphere_write);
+
+    // Commands and count
+    VkWriteDescriptorSet list_write = source_write;
+    list_write.dstBinding = 2;
+    list_write.descriptorCount = 2;
+    list_write.pBufferInfo = list_infos;
+    descriptor_writes.push_back(list_write);
+  }
+  vkUpdateDescriptorSets(GetDevice(),
+                         static_cast<uint32_t>(descriptor_writes.size()),
+                         descriptor_writes.data(), 0, nullptr);
   return true;
 }
 
-bool HelloTriangleVertex::CreateSemaphores() {
-  VkSemaphoreCreateInfo semaphore_create_info = {
-      VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,  // VkStructureType sType
-      nullptr,  // const void*                    pNext
-      0         // VkSemaphoreCreateFlags         flags
-  };
-
-  for (size_t i = 0; i < Vulkan.RenderingResources.size(); ++i) {
-    if ((vkCreateSemaphore(
-             GetDevice(), &semaphore_create_info, nullptr,
-             &Vulkan.RenderingResources[i].ImageAvailableSemaphore) !=
-         VK_SUCCESS) ||
-        (vkCreateSemaphore(
-             GetDevice(), &semaphore_create_info, nullptr,
-             &Vulkan.RenderingResources[i].FinishedRenderingSemaphore) !=
-         VK_SUCCESS)) {
-      std::cout << "Could not create semaphores!" << std::endl;
-      return false;
-    }
+bool HelloTriangleVertex::ReadCullingResult(const FrameContext &frame) {
+  CullingParameters &culling = Vulkan.Culling;
+  if (!culling.ResultPending[frame.Index]) {
+    return true;
+  }
+
+  VkDeviceSize offset = frame.Index * sizeof(uint32_t);
+  if (!GetMemoryAllocator().Invalidate(culling.ResultBuffer.Memory, offset,
+                                       sizeof(uint32_t))) {
+    std::cout << "Could not invalidate the culling result buffer!"
+              << std::endl;
+    return false;
   }
+  const uint32_t *results =
+      static_cast<const uint32_t *>(culling.ResultBuffer.Memory.Mapped);
+  uint32_t drawn_count = results[frame.Index];
+
+  ++culling.Statistics.FrameCount;
+  culling.Statistics.TestedCount += Vulkan.DrawCount;
+  culling.Statistics.DrawnCount += drawn_count;
+  culling.ResultPending[frame.Index] = 0;
   return true;
 }
 
-bool HelloTriangleVertex::CreateFences() {
-  VkFenceCreateInfo fence_create_info = {
-      VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,  // VkStructureType sType
-      nullptr,                      // const void                    *pNext
-      VK_FENCE_CREATE_SIGNALED_BIT  // VkFenceCreateFlags             flags
+bool HelloTriangleVertex::RecordCulling(VkCommandBuffer command_buffer,
+                                        const FrameContext &frame) {
+  CullingParameters &culling = Vulkan.Culling;
+  const DrawList &draws = Vulkan.Draws;
+  if (!Vulkan.Draws.WriteSource(frame.Index)) {
+    return false;
+  }
+
+  uint32_t culling_scope =
+      GetGpuProfiler().BeginScope(command_buffer, "Culling");
+
+  // Slots the shader leaves untouched become empty draws, so the whole list
+  // can be issued when the count is not read from the GPU
+  vkCmdFillBuffer(command_buffer, draws.GetCommandBuffer().Handle,
+                  draws.GetCommandOffset(frame.Index),
+                  draws.GetCommandSliceSize(), 0);
+  vkCmdFillBuffer(command_buffer, draws.GetCountBuffer().Handle,
+                  draws.GetCountOffset(frame.Index), sizeof(uint32_t), 0);
+
+  VkMemoryBarrier barrier_from_clear_to_culling = {
+      VK_STRUCTURE_TYPE_MEMORY_BARRIER,  // VkStructureType sType
+      nullptr,                           // const void     *pNext
+      VK_ACCESS_TRANSFER_WRITE_BIT,      // VkAccessFlags   srcAccessMask
+      VK_ACCESS_SHADER_READ_BIT |
+          VK_ACCESS_SHADER_WRITE_BIT  // VkAccessFlags   dstAccessMask
+  };
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                       &barrier_from_clear_to_culling, 0, nullptr, 0, nullptr);
+
+  VkDescriptorSet descriptor_set = culling.DescriptorSets[frame.Index];
+
+  // Sources, bounding spheres, commands and count
+  uint32_t dynamic_offsets[] = {
+      static_cast<uint32_t>(draws.GetCommandOffset(frame.Index)),
+      static_cast<uint32_t>(culling.SphereBuffers[frame.Index].Offset),
+      static_cast<uint32_t>(draws.GetCommandOffset(frame.Index)),
+      static_cast<uint32_t>(draws.GetCountOffset(frame.Index))};
+
+  CullingConstants constants;
+  constants.planes = Tools::GetFrustumPlanes(GetProjectionMatrix());
+  constants.object_count = draws.GetDrawCount();
+
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    culling.Pipeline);
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          culling.PipelineLayout, 0, 1, &descriptor_set, 4,
+                          dynamic_offsets);
+  vkCmdPushConstants(command_buffer, culling.PipelineLayout,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                     &constants);
+  // The shader runs in work groups of 64 objects
+  vkCmdDispatch(command_buffer, (constants.object_count + 63) / 64, 1, 1);
+
+  VkMemoryBarrier barrier_from_culling_to_draw = {
+      VK_STRUCTURE_TYPE_MEMORY_BARRIER,  // VkStructureType sType
+      nullptr,                           // const void     *pNext
+      VK_ACCESS_SHADER_WRITE_BIT,        // VkAccessFlags   srcAccessMask
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+          VK_ACCESS_TRANSFER_READ_BIT  // VkAccessFlags   dstAccessMask
+  };
+  vkCmdPipelineBarrier(
+      command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+      1, &barrier_from_culling_to_draw, 0, nullptr, 0, nullptr);
+
+  // The number of survivors is read back when this frame context gets reused
+  VkBufferCopy region = {
+      draws.GetCountOffset(frame.Index),  // VkDeviceSize srcOffset
+      frame.Index * sizeof(uint32_t),     // VkDeviceSize dstOffset
+      sizeof(uint32_t)                    // VkDeviceSize size
   };
+  vkCmdCopyBuffer(command_buffer, draws.GetCountBuffer().Handle,
+                  culling.ResultBuffer.Handle, 1, &region);
+
+  VkMemoryBarrier barrier_from_copy_to_host = {
+      VK_STRUCTURE_TYPE_MEMORY_BARRIER,  // VkStructureType sType
+      nullptr,                           // const void     *pNext
+      VK_ACCESS_TRANSFER_WRITE_BIT,      // VkAccessFlags   srcAccessMask
+      VK_ACCESS_HOST_READ_BIT            // VkAccessFlags   dstAccessMask
+  };
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                       &barrier_from_copy_to_host, 0, nullptr, 0, nullptr);
 
-  for (size_t i = 0; i < Vulkan.RenderingResources.size(); ++i) {
-    if (vkCreateFence(GetDevice(), &fence_create_info, nullptr,
-                      &Vulkan.RenderingResources[i].Fence) != VK_SUCCESS) {
-      std::cout << "Could not create a fence!" << std::endl;
-      return false;
-    }
-  }
+  GetGpuProfiler().EndScope(command_buffer, culling_scope);
+  culling.ResultPending[frame.Index] = 1;
   return true;
 }
 
-bool HelloTriangleVertex::PrepareFrame(VkCommandBuffer command_buffer,
-                                       const ImageParameters &image_parameters,
-                                       VkFramebuffer &framebuffer) {
-  if (!CreateFramebuffer(framebuffer, image_parameters.View)) {
+bool HelloTriangleVertex::PrepareFrame(
+    FrameContext &frame, const ImageParameters &image_parameters) {
+  VkCommandBuffer command_buffer = frame.CommandBuffer;
+  VkFramebuffer framebuffer =
+      GetFramebuffer(Vulkan.RenderPass, &image_parameters.View, 1);
+  if (framebuffer == VK_NULL_HANDLE) {
+    return false;
+  }
+
+  // The GPU finished the previous frame which used this context, and its
+  // transient buffers were released with it
+  if ((Vulkan.Mode != DrawMode::PerCell) && !UpdateInstanceBuffer(frame)) {
+    return false;
+  }
+  if ((Vulkan.Mode == DrawMode::Culled) && !ReadCullingResult(frame)) {
+    return false;
+  }
+
+  // Secondary command buffers are recorded first, the primary one only
+  // executes them inside the render pass. A single indirect draw has nothing
+  // to split between threads
+  bool use_secondary = !frame.WorkerCommandBuffers.empty() && !UsesDrawList();
+  if (use_secondary && !RecordSecondaryCommandBuffers(frame, framebuffer)) {
     return false;
   }
 
@@ -581,6 +1055,19 @@ bool HelloTriangleVertex::PrepareFrame(VkCommandBuffer command_buffer,
 
   vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
 
+  GetGpuProfiler().BeginFrame(command_buffer, frame.Index);
+  uint32_t frame_scope = GetGpuProfiler().BeginScope(command_buffer, "Frame");
+
+  // Transfers and dispatches are not allowed inside a render pass
+  if ((Vulkan.Mode == DrawMode::Indirect) &&
+      !Vulkan.Draws.RecordUpload(command_buffer, frame.Index)) {
+    return false;
+  }
+  if ((Vulkan.Mode == DrawMode::Culled) &&
+      !RecordCulling(command_buffer, frame)) {
+    return false;
+  }
+
   VkImageSubresourceRange image_subresource_range = {
       VK_IMAGE_ASPECT_COLOR_BIT,  // VkImageAspectFlags aspectMask
       0,  // uint32_t                               baseMipLevel
@@ -630,42 +1117,22 @@ bool HelloTriangleVertex::PrepareFrame(VkCommandBuffer command_buffer,
       &clear_value  // const VkClearValue                    *pClearValues
   };
 
-  vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info,
-                       VK_SUBPASS_CONTENTS_INLINE);
-
-  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    Vulkan.GraphicsPipeline);
-
-  VkViewport viewport = {
-      0.0f,  // float                                  x
-      0.0f,  // float                                  y
-      static_cast<float>(GetSwapChain().Extent.width),   // float width
-      static_cast<float>(GetSwapChain().Extent.height),  // float height
-      0.0f,  // float                                  minDepth
-      1.0f   // float                                  maxDepth
-  };
-
-  VkRect2D scissor = {{
-                          // VkOffset2D                             offset
-                          0,  // int32_t                                x
-                          0   // int32_t                                y
-                      },
-                      {
-                          // VkExtent2D                             extent
-                          GetSwapChain().Extent.width,  // uint32_t width
-                          GetSwapChain().Extent.height  // uint32_t height
-                      }};
-
-  vkCmdSetViewport(command_buffer, 0, 1, &viewport);
-  vkCmdSetScissor(command_buffer, 0, 1, &scissor);
-
-  VkDeviceSize offset = 0;
-  vkCmdBindVertexBuffers(command_buffer, 0, 1, &Vulkan.VertexBuffer.Handle,
-                         &offset);
-
-  vkCmdDraw(command_buffer, 4, 1, 0, 0);
+  uint32_t render_pass_scope =
+      GetGpuProfiler().BeginScope(command_buffer, "RenderPass");
+  if (use_secondary) {
+    vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info,
+                         VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    vkCmdExecuteCommands(
+        command_buffer, static_cast<uint32_t>(frame.WorkerCommandBuffers.size()),
+        frame.WorkerCommandBuffers.data());
+  } else {
+    vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info,
+                         VK_SUBPASS_CONTENTS_INLINE);
+    RecordDraws(command_buffer, frame, 0, Vulkan.DrawCount);
+  }
 
   vkCmdEndRenderPass(command_buffer);
+  GetGpuProfiler().EndScope(command_buffer, render_pass_scope);
 
   if (GetGraphicsQueue().Handle != GetPresentQueue().Handle) {
     VkImageMemoryBarrier barrier_from_draw_to_present = {
@@ -686,6 +1153,8 @@ bool HelloTriangleVertex::PrepareFrame(VkCommandBuffer command_buffer,
                          nullptr, 1, &barrier_from_draw_to_present);
   }
 
+  GetGpuProfiler().EndScope(command_buffer, frame_scope);
+
   if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
     std::cout << "Could not record command buffer!" << std::endl;
     return false;
@@ -693,57 +1162,143 @@ bool HelloTriangleVertex::PrepareFrame(VkCommandBuffer command_buffer,
   return true;
 }
 
-bool HelloTriangleVertex::CreateFramebuffer(VkFramebuffer &framebuffer,
-                                            VkImageView image_view) {
-  if (framebuffer != VK_NULL_HANDLE) {
-    vkDestroyFramebuffer(GetDevice(), framebuffer, nullptr);
-    framebuffer = VK_NULL_HANDLE;
-  }
-
-  VkFramebufferCreateInfo framebuffer_create_info = {
-      VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,  // VkStructureType sType
+bool HelloTriangleVertex::RecordSecondaryCommandBuffers(
+    FrameContext &frame, VkFramebuffer framebuffer) {
+  VkCommandBufferInheritanceInfo inheritance_info = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,  // VkStructureType
+                                                          // sType
       nullptr,            // const void                    *pNext
-      0,                  // VkFramebufferCreateFlags       flags
       Vulkan.RenderPass,  // VkRenderPass                   renderPass
-      1,                  // uint32_t                       attachmentCount
-      &image_view,        // const VkImageView             *pAttachments
-      GetSwapChain().Extent.width,   // uint32_t                       width
-      GetSwapChain().Extent.height,  // uint32_t                       height
-      1                              // uint32_t                       layers
+      0,                  // uint32_t                       subpass
+      framebuffer,        // VkFramebuffer                  framebuffer
+      VK_FALSE,           // VkBool32 occlusionQueryEnable
+      0,                  // VkQueryControlFlags            queryFlags
+      0  // VkQueryPipelineStatisticFlags  pipelineStatistics
   };
 
-  if (vkCreateFramebuffer(GetDevice(), &framebuffer_create_info, nullptr,
-                          &framebuffer) != VK_SUCCESS) {
-    std::cout << "Could not create a framebuffer!" << std::endl;
-    return false;
-  }
+  VkCommandBufferBeginInfo command_buffer_begin_info = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,  // VkStructureType sType
+      nullptr,  // const void                            *pNext
+      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |  // VkCommandBufferUsageFlags
+                                                     // flags
+          VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+      &inheritance_info  // const VkCommandBufferInheritanceInfo
+                         // *pInheritanceInfo
+  };
+
+  // Each job records one contiguous slice of the draw list into its own
+  // command buffer, allocated from its own pool
+  uint32_t job_count = static_cast<uint32_t>(frame.WorkerCommandBuffers.size());
+  std::vector<char> succeeded(job_count, 0);
+  GetThreadPool().Run(job_count, [&](uint32_t job_index) {
+    VkCommandBuffer command_buffer = frame.WorkerCommandBuffers[job_index];
+    uint32_t first_draw = Vulkan.DrawCount * job_index / job_count;
+    uint32_t last_draw = Vulkan.DrawCount * (job_index + 1) / job_count;
+
+    if (vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) !=
+        VK_SUCCESS) {
+      return;
+    }
+    RecordDraws(command_buffer, frame, first_draw, last_draw - first_draw);
+    succeeded[job_index] = vkEndCommandBuffer(command_buffer) == VK_SUCCESS;
+  });
 
+  for (uint32_t i = 0; i < job_count; ++i) {
+    if (!succeeded[i]) {
+      std::cout << "Could not record secondary command buffer!" << std::endl;
+      return false;
+    }
+  }
   return true;
 }
 
-bool HelloTriangleVertex::ChildOnWindowSizeChanged() { return true; }
+void HelloTriangleVertex::RecordDraws(VkCommandBuffer command_buffer,
+                                      const FrameContext &frame,
+                                      uint32_t first_draw,
+                                      uint32_t draw_count) {
+  if (draw_count == 0) {
+    return;
+  }
 
-bool HelloTriangleVertex::Draw() {
-  static size_t resource_index = 0;
-  RenderingResourcesData &current_rendering_resource =
-      Vulkan.RenderingResources[resource_index];
-  VkSwapchainKHR swap_chain = GetSwapChain().Handle;
-  uint32_t image_index;
+  // Dynamic state is not inherited by secondary command buffers, so every
+  // command buffer sets up everything it needs
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    Vulkan.GraphicsPipeline);
 
-  resource_index =
-      (resource_index + 1) % VulkanTutorial04Parameters::ResourcesCount;
+  VkRect2D scissor = {{
+                          // VkOffset2D                             offset
+                          0,  // int32_t                                x
+                          0   // int32_t                                y
+                      },
+                      {
+                          // VkExtent2D                             extent
+                          GetSwapChain().Extent.width,  // uint32_t width
+                          GetSwapChain().Extent.height  // uint32_t height
+                      }};
+  vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(command_buffer, 0, 1, &Vulkan.VertexBuffer.Handle,
+                         &offset);
+
+  // One draw for the whole slice; instances position themselves within the
+  // full screen viewport
+  if (Vulkan.Mode != DrawMode::PerCell) {
+    VkViewport viewport = {
+        0.0f,  // float x
+        0.0f,  // float y
+        static_cast<float>(GetSwapChain().Extent.width),   // float width
+        static_cast<float>(GetSwapChain().Extent.height),  // float height
+        0.0f,  // float minDepth
+        1.0f   // float maxDepth
+    };
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    const TransientAllocation &instance_buffer =
+        Vulkan.InstanceBuffers[frame.Index];
+    vkCmdBindVertexBuffers(command_buffer, 1, 1, &instance_buffer.Buffer,
+                           &instance_buffer.Offset);
+    if (UsesDrawList()) {
+      // The draw list always covers all cells
+      vkCmdBindIndexBuffer(command_buffer, Vulkan.IndexBuffer.Handle, 0,
+                           VK_INDEX_TYPE_UINT16);
+      Vulkan.Draws.RecordDraw(command_buffer, frame.Index);
+    } else {
+      vkCmdDraw(command_buffer, 4, draw_count, 0, first_draw);
+    }
+    return;
+  }
 
-  if (vkWaitForFences(GetDevice(), 1, &current_rendering_resource.Fence,
-                      VK_FALSE, 1000000000) != VK_SUCCESS) {
-    std::cout << "Waiting for fence takes too long!" << std::endl;
+  uint32_t columns = static_cast<uint32_t>(
+      std::ceil(std::sqrt(static_cast<double>(Vulkan.DrawCount))));
+  uint32_t rows = (Vulkan.DrawCount + columns - 1) / columns;
+  float cell_width = static_cast<float>(GetSwapChain().Extent.width) / columns;
+  float cell_height = static_cast<float>(GetSwapChain().Extent.height) / rows;
+
+  for (uint32_t i = first_draw; i < first_draw + draw_count; ++i) {
+    VkViewport viewport = {
+        (i % columns) * cell_width,   // float x
+        (i / columns) * cell_height,  // float y
+        cell_width,                   // float width
+        cell_height,                  // float height
+        0.0f,                         // float minDepth
+        1.0f                          // float maxDepth
+    };
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    vkCmdDraw(command_buffer, 4, 1, 0, 0);
+  }
+}
+
+bool HelloTriangleVertex::ChildOnWindowSizeChanged() { return true; }
+
+bool HelloTriangleVertex::Draw() {
+  FrameContext *frame = BeginFrame();
+  if (frame == nullptr) {
     return false;
   }
-  vkResetFences(GetDevice(), 1, &current_rendering_resource.Fence);
+  uint32_t image_index;
 
   VkResult result =
-      vkAcquireNextImageKHR(GetDevice(), swap_chain, UINT64_MAX,
-                            current_rendering_resource.ImageAvailableSemaphore,
-                            VK_NULL_HANDLE, &image_index);
+      AcquireNextImage(frame->ImageAvailableSemaphore, &image_index);
   switch (result) {
     case VK_SUCCESS:
     case VK_SUBOPTIMAL_KHR:
@@ -756,46 +1311,17 @@ bool HelloTriangleVertex::Draw() {
       return false;
   }
 
-  if (!PrepareFrame(current_rendering_resource.CommandBuffer,
-                    GetSwapChain().Images[image_index],
-                    current_rendering_resource.Framebuffer)) {
+  FrameRecorder::Clock::time_point record_start = FrameRecorder::Clock::now();
+  if (!PrepareFrame(*frame, GetSwapChain().Images[image_index])) {
     return false;
   }
+  GetFrameRecorder().AddPhaseTime(FramePhase::Record, record_start);
 
-  VkPipelineStageFlags wait_dst_stage_mask =
-      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  VkSubmitInfo submit_info = {
-      VK_STRUCTURE_TYPE_SUBMIT_INFO,  // VkStructureType              sType
-      nullptr,                        // const void                  *pNext
-      1,  // uint32_t                     waitSemaphoreCount
-      &current_rendering_resource
-           .ImageAvailableSemaphore,  // const VkSemaphore *pWaitSemaphores
-      &wait_dst_stage_mask,  // const VkPipelineStageFlags  *pWaitDstStageMask;
-      1,                     // uint32_t                     commandBufferCount
-      &current_rendering_resource
-           .CommandBuffer,  // const VkCommandBuffer       *pCommandBuffers
-      1,                    // uint32_t                     signalSemaphoreCount
-      &current_rendering_resource
-           .FinishedRenderingSemaphore  // const VkSemaphore *pSignalSemaphores
-  };
-
-  if (vkQueueSubmit(GetGraphicsQueue().Handle, 1, &submit_info,
-                    current_rendering_resource.Fence) != VK_SUCCESS) {
+  if (SubmitFrame(*frame, frame->CommandBuffer) != VK_SUCCESS) {
     return false;
   }
 
-  VkPresentInfoKHR present_info = {
-      VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,  // VkStructureType              sType
-      nullptr,                             // const void                  *pNext
-      1,  // uint32_t                     waitSemaphoreCount
-      &current_rendering_resource
-           .FinishedRenderingSemaphore,  // const VkSemaphore *pWaitSemaphores
-      1,             // uint32_t                     swapchainCount
-      &swap_chain,   // const VkSwapchainKHR        *pSwapchains
-      &image_index,  // const uint32_t              *pImageIndices
-      nullptr        // VkResult                    *pResults
-  };
-  result = vkQueuePresentKHR(GetPresentQueue().Handle, &present_info);
+  result = PresentImage(frame->FinishedRenderingSemaphore, image_index);
 
   switch (result) {
     case VK_SUCCESS:
@@ -813,50 +1339,48 @@ bool HelloTriangleVertex::Draw() {
 
 void HelloTriangleVertex::ChildClear() {}
 
+void HelloTriangleVertex::ChildPrintStatistics() const {
+  const CullingStatistics &statistics = Vulkan.Culling.Statistics;
+  if (statistics.FrameCount == 0) {
+    return;
+  }
+  std::cout << "Culling: avg "
+            << statistics.DrawnCount / statistics.FrameCount << " of "
+            << statistics.TestedCount / statistics.FrameCount
+            << " objects drawn per frame, " << std::setprecision(1)
+            << statistics.GetCulledRatio() * 100.0 << "% culled over "
+            << statistics.FrameCount << " frames" << std::endl;
+}
+
 HelloTriangleVertex::~HelloTriangleVertex() {
   if (GetDevice() != VK_NULL_HANDLE) {
     vkDeviceWaitIdle(GetDevice());
 
-    for (size_t i = 0; i < Vulkan.RenderingResources.size(); ++i) {
-      if (Vulkan.RenderingResources[i].Framebuffer != VK_NULL_HANDLE) {
-        vkDestroyFramebuffer(GetDevice(),
-                             Vulkan.RenderingResources[i].Framebuffer, nullptr);
-      }
-      if (Vulkan.RenderingResources[i].CommandBuffer != VK_NULL_HANDLE) {
-        vkFreeCommandBuffers(GetDevice(), Vulkan.CommandPool, 1,
-                             &Vulkan.RenderingResources[i].CommandBuffer);
-      }
-      if (Vulkan.RenderingResources[i].ImageAvailableSemaphore !=
-          VK_NULL_HANDLE) {
-        vkDestroySemaphore(GetDevice(),
-                           Vulkan.RenderingResources[i].ImageAvailableSemaphore,
-                           nullptr);
-      }
-      if (Vulkan.RenderingResources[i].FinishedRenderingSemaphore !=
-          VK_NULL_HANDLE) {
-        vkDestroySemaphore(
-            GetDevice(),
-            Vulkan.RenderingResources[i].FinishedRenderingSemaphore, nullptr);
-      }
-      if (Vulkan.RenderingResources[i].Fence != VK_NULL_HANDLE) {
-        vkDestroyFence(GetDevice(), Vulkan.RenderingResources[i].Fence,
-                       nullptr);
-      }
+    DestroyBuffer(Vulkan.VertexBuffer);
+    DestroyBuffer(Vulkan.IndexBuffer);
+    Vulkan.Draws.Destroy();
+
+    CullingParameters &culling = Vulkan.Culling;
+    DestroyBuffer(culling.ResultBuffer);
+
+    if (culling.DescriptorPool != VK_NULL_HANDLE) {
+      vkDestroyDescriptorPool(GetDevice(), culling.DescriptorPool, nullptr);
+      culling.DescriptorPool = VK_NULL_HANDLE;
     }
 
-    if (Vulkan.CommandPool != VK_NULL_HANDLE) {
-      vkDestroyCommandPool(GetDevice(), Vulkan.CommandPool, nullptr);
-      Vulkan.CommandPool = VK_NULL_HANDLE;
+    if (culling.Pipeline != VK_NULL_HANDLE) {
+      vkDestroyPipeline(GetDevice(), culling.Pipeline, nullptr);
+      culling.Pipeline = VK_NULL_HANDLE;
     }
 
-    if (Vulkan.VertexBuffer.Handle != VK_NULL_HANDLE) {
-      vkDestroyBuffer(GetDevice(), Vulkan.VertexBuffer.Handle, nullptr);
-      Vulkan.VertexBuffer.Handle = VK_NULL_HANDLE;
+    if (culling.PipelineLayout != VK_NULL_HANDLE) {
+      vkDestroyPipelineLayout(GetDevice(), culling.PipelineLayout, nullptr);
+      culling.PipelineLayout = VK_NULL_HANDLE;
     }
 
-    if (Vulkan.VertexBuffer.Memory != VK_NULL_HANDLE) {
-      vkFreeMemory(GetDevice(), Vulkan.VertexBuffer.Memory, nullptr);
-      Vulkan.VertexBuffer.Memory = VK_NULL_HANDLE;
+    if (culling.SetLayout != VK_NULL_HANDLE) {
+      vkDestroyDescriptorSetLayout(GetDevice(), culling.SetLayout, nullptr);
+      culling.SetLayout = VK_NULL_HANDLE;
     }
 
     if (Vulkan.GraphicsPipeline != VK_NULL_HANDLE) {
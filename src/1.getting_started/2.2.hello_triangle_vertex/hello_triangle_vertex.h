@@ -17,6 +17,9 @@
 #ifndef HELLO_TRIANGLE_VERTEX_H
 #define HELLO_TRIANGLE_VERTEX_H
 
+#include <array>
+
+#include "common/draw_list.h"
 #include "common/tools.h"
 #include "common/vulkan_common.h"
 
@@ -31,23 +34,106 @@ struct VertexData {
 };
 
 // ************************************************************ //
-// RenderingResourcesData                                       //
+// InstanceData                                                 //
+//                                                              //
+// Per instance attributes of the instanced path: clip space    //
+// offset and scale of the triangle, and a tint of its colors   //
+// ************************************************************ //
+struct InstanceData {
+  float offset_x, offset_y, scale_x, scale_y;
+  float r, g, b, a;
+};
+
+// ************************************************************ //
+// DrawMode                                                     //
+//                                                              //
+// How the grid of triangles gets drawn                         //
+// ************************************************************ //
+enum class DrawMode {
+  // One draw and viewport per grid cell
+  PerCell,
+  // All cells in one draw, with per instance data instead of viewports
+  Instanced,
+  // One indexed command per cell in a GPU buffer, all issued by one
+  // indirect draw
+  Indirect,
+  // Indirect, with the commands of cells outside the view frustum removed
+  // by a compute shader first
+  Culled
+};
+
+// ************************************************************ //
+// BoundingSphere                                               //
+//                                                              //
+// View space bounding sphere of one instance, read by the      //
+// culling shader                                               //
+// ************************************************************ //
+struct BoundingSphere {
+  float x, y, z, radius;
+};
+
+// ************************************************************ //
+// CullingConstants                                             //
+//                                                              //
+// Push constants of the culling shader: the frustum planes and //
+// the number of objects to test                                //
+// ************************************************************ //
+struct CullingConstants {
+  std::array<float, 24> planes;
+  uint32_t object_count;
+};
+
+// ************************************************************ //
+// CullingStatistics                                            //
+//                                                              //
+// Objects tested by the culling pass and drawn after it, read  //
+// back once the GPU finished a frame                           //
+// ************************************************************ //
+struct CullingStatistics {
+  uint64_t FrameCount;
+  uint64_t TestedCount;
+  uint64_t DrawnCount;
+
+  CullingStatistics() : FrameCount(0), TestedCount(0), DrawnCount(0) {}
+
+  double GetCulledRatio() const {
+    return (TestedCount > 0)
+               ? 1.0 - static_cast<double>(DrawnCount) / TestedCount
+               : 0.0;
+  }
+};
+
+// ************************************************************ //
+// CullingParameters                                            //
 //                                                              //
-// Struct containing data used during rendering process         //
-// ************************************************************ //
-struct RenderingResourcesData {
-  VkFramebuffer Framebuffer;
-  VkCommandBuffer CommandBuffer;
-  VkSemaphore ImageAvailableSemaphore;
-  VkSemaphore FinishedRenderingSemaphore;
-  VkFence Fence;
-
-  RenderingResourcesData()
-      : Framebuffer(VK_NULL_HANDLE),
-        CommandBuffer(VK_NULL_HANDLE),
-        ImageAvailableSemaphore(VK_NULL_HANDLE),
-        FinishedRenderingSemaphore(VK_NULL_HANDLE),
-        Fence(VK_NULL_HANDLE) {}
+// Compute pipeline and buffers of the frustum culling pass     //
+// ************************************************************ //
+struct CullingParameters {
+  VkDescriptorSetLayout SetLayout;
+  VkDescriptorPool DescriptorPool;
+  // One set per frame in flight, each pointing at its frame's transient
+  // buffer for the bounding spheres
+  std::vector<VkDescriptorSet> DescriptorSets;
+  VkPipelineLayout PipelineLayout;
+  VkPipeline Pipeline;
+  // Parts of the frames' transient buffers written by the frames in flight
+  std::vector<TransientAllocation> SphereBuffers;
+  // Number of drawn objects of every frame in flight, copied from the draw
+  // list's count buffer
+  BufferParameters ResultBuffer;
+  std::vector<char> ResultPending;
+  CullingStatistics Statistics;
+
+  CullingParameters()
+      : SetLayout(VK_NULL_HANDLE),
+        DescriptorPool(VK_NULL_HANDLE),
+        DescriptorSets(),
+        PipelineLayout(VK_NULL_HANDLE),
+        Pipeline(VK_NULL_HANDLE),
+        SphereBuffers(),
+        ResultBuffer(),
+        ResultPending(),
+        Statistics() {}
 };
 
 // ************************************************************ //
@@ -59,17 +145,27 @@ struct VulkanTutorial04Parameters {
   VkRenderPass RenderPass;
   VkPipeline GraphicsPipeline;
   BufferParameters VertexBuffer;
-  VkCommandPool CommandPool;
-  std::vector<RenderingResourcesData> RenderingResources;
-
-  static const size_t ResourcesCount = 3;
+  BufferParameters IndexBuffer;
+  // The triangle is drawn once per cell of a grid covering the screen
+  uint32_t DrawCount;
+  DrawMode Mode;
+  // Parts of the frames' transient buffers written by the frames in flight
+  std::vector<TransientAllocation> InstanceBuffers;
+  uint64_t FrameNumber;
+  DrawList Draws;
+  CullingParameters Culling;
 
   VulkanTutorial04Parameters()
       : RenderPass(VK_NULL_HANDLE),
         GraphicsPipeline(VK_NULL_HANDLE),
         VertexBuffer(),
-        CommandPool(VK_NULL_HANDLE),
-        RenderingResources(ResourcesCount) {}
+        IndexBuffer(),
+        DrawCount(1),
+        Mode(DrawMode::PerCell),
+        InstanceBuffers(),
+        FrameNumber(0),
+        Draws(),
+        Culling() {}
 };
 
 // ************************************************************ //
@@ -86,6 +182,10 @@ class HelloTriangleVertex : public VulkanCommon {
   bool CreatePipeline();
   bool CreateVertexBuffer();
   bool CreateRenderingResources();
+  // Must be called before CreatePipeline()
+  void SetDrawCount(uint32_t draw_count, DrawMode mode);
+  // Per frame data written by the CPU for the draw count and mode set
+  VkDeviceSize GetTransientBufferSize() const;
 
   bool Draw() override;
 
@@ -93,23 +193,35 @@ class HelloTriangleVertex : public VulkanCommon {
   VulkanTutorial04Parameters Vulkan;
 
   Tools::AutoDeleter<VkShaderModule, PFN_vkDestroyShaderModule>
-  CreateShaderModule(const char *filename);
+  CreateShaderModule(const uint32_t *code, size_t code_size);
   Tools::AutoDeleter<VkPipelineLayout, PFN_vkDestroyPipelineLayout>
   CreatePipelineLayout();
-  bool AllocateBufferMemory(VkBuffer buffer, VkDeviceMemory *memory);
-  bool CreateCommandPool(uint32_t queue_family_index, VkCommandPool *pool);
-  bool AllocateCommandBuffers(VkCommandPool pool, uint32_t count,
-                              VkCommandBuffer *command_buffers);
-  bool CreateCommandBuffers();
-  bool CreateSemaphores();
-  bool CreateFences();
-  bool PrepareFrame(VkCommandBuffer command_buffer,
-                    const ImageParameters &image_parameters,
-                    VkFramebuffer &framebuffer);
-  bool CreateFramebuffer(VkFramebuffer &framebuffer, VkImageView image_view);
+  bool AllocateBufferMemory(VkBuffer buffer, MemoryAllocation *memory);
+  bool CreateDeviceBuffer(const void *data, uint32_t size,
+                          VkBufferUsageFlags usage, BufferParameters *buffer);
+  bool CreateHostVisibleBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                               VkMemoryPropertyFlags preferred_flags,
+                               BufferParameters *buffer);
+  void DestroyBuffer(BufferParameters &buffer);
+  bool UsesDrawList() const;
+  bool CreateDrawList();
+  bool UpdateInstanceBuffer(FrameContext &frame);
+  // Projection the bounding spheres and frustum planes of culling refer to
+  std::array<float, 16> GetProjectionMatrix() const;
+  bool CreateCullingPipeline();
+  bool CreateCullingResources();
+  bool ReadCullingResult(const FrameContext &frame);
+  bool RecordCulling(VkCommandBuffer command_buffer, const FrameContext &frame);
+  bool PrepareFrame(FrameContext &frame,
+                    const ImageParameters &image_parameters);
+  bool RecordSecondaryCommandBuffers(FrameContext &frame,
+                                     VkFramebuffer framebuffer);
+  void RecordDraws(VkCommandBuffer command_buffer, const FrameContext &frame,
+                   uint32_t first_draw, uint32_t draw_count);
 
   void ChildClear() override;
   bool ChildOnWindowSizeChanged() override;
+  void ChildPrintStatistics() const override;
 };
 
 #endif  // HELLO_TRIANGLE_VERTEX_H
\ No newline at end of file
@@ -17,23 +17,54 @@
 #include <iostream>
 
 #include "hello_triangle_vertex.h"
+#include "options.h"
 #include "window.h"
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
 int main(int argc, char **argv) {
+  ApplicationOptions options;
+  if (!ParseApplicationOptions(argc, argv, &options)) {
+    return -1;
+  }
+
   Window window;
   HelloTriangleVertex helloTriangleVertex;
-  // Window creation
-  if (!window.Create("Hello, triangle", WIDTH, HEIGHT)) {
+  helloTriangleVertex.SetDevicePreference(options.Device);
+  if (!helloTriangleVertex.SetPresentPolicy(options.PresentMode,
+                                            options.SwapChainImages)) {
     return -1;
   }
+  if (options.Headless) {
+    // Vulkan preparations and initialization without any window
+    if (!helloTriangleVertex.PrepareVulkanHeadless(WIDTH, HEIGHT,
+                                                   options.HeadlessSurface)) {
+      return -1;
+    }
+  } else {
+    // Window creation
+    if (!window.Create("Hello, triangle", WIDTH, HEIGHT)) {
+      return -1;
+    }
+
+    // Vulkan preparations and initialization
+    if (!helloTriangleVertex.PrepareVulkan(window.GetWindow())) {
+      return -1;
+    }
+  }
 
-  // Vulkan preparations and initialization
-  if( !helloTriangleVertex.PrepareVulkan( window.GetWindow()) ) {
+  DrawMode draw_mode = options.Cull        ? DrawMode::Culled
+                       : options.Indirect  ? DrawMode::Indirect
+                       : options.Instanced ? DrawMode::Instanced
+                                           : DrawMode::PerCell;
+  helloTriangleVertex.SetDrawCount(options.DrawCount, draw_mode);
+  if (!helloTriangleVertex.CreateFrameContexts(
+          options.FramesInFlight, options.RecordingThreads,
+          helloTriangleVertex.GetTransientBufferSize())) {
     return -1;
   }
+  helloTriangleVertex.SetFramePacing(options.FpsCap, options.LowLatency);
 
   // Tutorial 04
   if( !helloTriangleVertex.CreateRenderPass() ) {
@@ -50,7 +81,7 @@ int main(int argc, char **argv) {
   }
 
   // Rendering loop
-  if (!window.RenderingLoop(helloTriangleVertex)) {
+  if (!window.RenderingLoop(helloTriangleVertex, options)) {
     return -1;
   }
   return 0;
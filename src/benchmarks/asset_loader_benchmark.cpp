@@ -0,0 +1,150 @@
+// Measures how long loading a set of images takes with 1..N AssetLoader
+// workers, which is what asset loading adds to application startup.
+//
+// Usage: asset_loader_benchmark [max_workers] [image files...]
+// Without image files, a set of BMP images is generated and removed afterwards.
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/asset_loader.h"
+
+namespace {
+
+const uint32_t GeneratedImageCount = 64;
+const uint32_t GeneratedImageSize = 1024;
+
+void WriteLittleEndian(std::ofstream &file, uint32_t value, int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    file.put(static_cast<char>((value >> (i * 8)) & 0xFF));
+  }
+}
+
+// 24 bit uncompressed BMP - simple to write and decoded by stb_image
+bool GenerateImage(const std::string &file_name, uint32_t size, uint32_t seed) {
+  std::ofstream file(file_name, std::ios::binary);
+  uint32_t row_size = (size * 3 + 3) & ~3u;
+  uint32_t pixel_bytes = row_size * size;
+
+  file.put('B');
+  file.put('M');
+  WriteLittleEndian(file, 54 + pixel_bytes, 4);  // file size
+  WriteLittleEndian(file, 0, 4);                 // reserved
+  WriteLittleEndian(file, 54, 4);                // pixel data offset
+  WriteLittleEndian(file, 40, 4);                // header size
+  WriteLittleEndian(file, size, 4);              // width
+  WriteLittleEndian(file, size, 4);              // height
+  WriteLittleEndian(file, 1, 2);                 // planes
+  WriteLittleEndian(file, 24, 2);                // bits per pixel
+  WriteLittleEndian(file, 0, 4);                 // no compression
+  WriteLittleEndian(file, pixel_bytes, 4);
+  WriteLittleEndian(file, 2835, 4);  // horizontal resolution
+  WriteLittleEndian(file, 2835, 4);  // vertical resolution
+  WriteLittleEndian(file, 0, 4);     // palette colors
+  WriteLittleEndian(file, 0, 4);     // important colors
+
+  std::vector<char> row(row_size, 0);
+  for (uint32_t y = 0; y < size; ++y) {
+    for (uint32_t x = 0; x < size; ++x) {
+      row[x * 3 + 0] = static_cast<char>(x + seed);
+      row[x * 3 + 1] = static_cast<char>(y);
+      row[x * 3 + 2] = static_cast<char>(x ^ y);
+    }
+    file.write(row.data(), row.size());
+  }
+  return static_cast<bool>(file);
+}
+
+double LoadAll(const std::vector<std::string> &file_names,
+               uint32_t worker_count, uint32_t *failed) {
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+  AssetLoader loader;
+  if (!loader.Init(worker_count)) {
+    return 0.0;
+  }
+  *failed = 0;
+  for (size_t i = 0; i < file_names.size(); ++i) {
+    loader.LoadImage(file_names[i], 4, [failed](LoadedAsset &asset) {
+      if (!asset.Succeeded) {
+        ++*failed;
+      }
+    });
+  }
+  loader.WaitIdle();
+
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  uint32_t max_workers =
+      (argc > 1) ? static_cast<uint32_t>(std::stoul(argv[1]))
+                 : std::max(1u, std::thread::hardware_concurrency());
+
+  std::vector<std::string> file_names;
+  for (int i = 2; i < argc; ++i) {
+    file_names.push_back(argv[i]);
+  }
+  bool generated = file_names.empty();
+  if (generated) {
+    for (uint32_t i = 0; i < GeneratedImageCount; ++i) {
+      file_names.push_back("asset_loader_benchmark_" + std::to_string(i) +
+                           ".bmp");
+      if (!GenerateImage(file_names.back(), GeneratedImageSize, i)) {
+        std::cout << "Could not generate \"" << file_names.back()
+                  << "\" file!" << std::endl;
+        return -1;
+      }
+    }
+  }
+
+  // Warm up the page cache, so all runs measure decoding and not the disk
+  uint32_t failed = 0;
+  LoadAll(file_names, 1, &failed);
+
+  std::cout << file_names.size() << " images" << std::endl;
+  // Powers of two, always ending with max_workers
+  std::vector<uint32_t> worker_counts;
+  for (uint32_t workers = 1; workers < max_workers; workers *= 2) {
+    worker_counts.push_back(workers);
+  }
+  worker_counts.push_back(max_workers);
+
+  double single_worker_milliseconds = 0.0;
+  for (size_t i = 0; i < worker_counts.size(); ++i) {
+    uint32_t workers = worker_counts[i];
+    double milliseconds = LoadAll(file_names, workers, &failed);
+    if (workers == 1) {
+      single_worker_milliseconds = milliseconds;
+    }
+    std::cout << std::setw(3) << workers << " workers: " << std::fixed
+              << std::setprecision(1) << std::setw(8) << milliseconds
+              << " ms, speedup " << std::setprecision(2)
+              << single_worker_milliseconds / milliseconds << "x";
+    if (failed > 0) {
+      std::cout << " (" << failed << " failed)";
+    }
+    std::cout << std::endl;
+  }
+
+  if (generated) {
+    for (size_t i = 0; i < file_names.size(); ++i) {
+      std::remove(file_names[i].c_str());
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,109 @@
+// Compares reading a large file through Tools::GetBinaryFileContents, a
+// buffered Tools::FileView and a memory-mapped Tools::FileView.
+//
+// Usage: file_view_benchmark [file] [iterations]
+// Without a file, a temporary 256 MiB file is generated and removed afterwards.
+
+#include <stdint.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common/tools.h"
+
+namespace {
+
+const size_t GeneratedFileSize = 256 * 1024 * 1024;
+
+bool GenerateFile(std::string const &filename, size_t size) {
+  std::ofstream file(filename, std::ios::binary);
+  std::vector<char> chunk(1024 * 1024);
+  for (size_t i = 0; i < chunk.size(); ++i) {
+    chunk[i] = static_cast<char>(i * 31);
+  }
+  for (size_t written = 0; written < size; written += chunk.size()) {
+    file.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+  }
+  return static_cast<bool>(file);
+}
+
+// Every byte is read, so lazily mapped pages are really faulted in
+uint64_t Checksum(const char *data, size_t size) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < size; ++i) {
+    sum += static_cast<unsigned char>(data[i]);
+  }
+  return sum;
+}
+
+void Measure(const char *name, uint32_t iterations, size_t file_size,
+             const std::function<uint64_t()> &read) {
+  double best_seconds = 0.0;
+  uint64_t checksum = 0;
+  for (uint32_t i = 0; i < iterations; ++i) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    checksum = read();
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    if ((i == 0) || (seconds < best_seconds)) {
+      best_seconds = seconds;
+    }
+  }
+
+  std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+            << std::setprecision(1) << std::setw(10)
+            << file_size / (1024.0 * 1024.0) / best_seconds << " MiB/s"
+            << "  (checksum " << checksum << ")" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::string filename = (argc > 1) ? argv[1] : "file_view_benchmark.tmp";
+  uint32_t iterations =
+      (argc > 2) ? static_cast<uint32_t>(std::stoul(argv[2])) : 5;
+  bool generated = argc <= 1;
+
+  if (generated && !GenerateFile(filename, GeneratedFileSize)) {
+    std::cout << "Could not generate \"" << filename << "\" file!" << std::endl;
+    return -1;
+  }
+
+  Tools::FileView probe;
+  if (!probe.Open(filename)) {
+    return -1;
+  }
+  size_t file_size = probe.GetSize();
+  probe.Close();
+
+  std::cout << "File: " << filename << ", " << file_size << " bytes, best of "
+            << iterations << " runs" << std::endl;
+
+  Measure("GetBinaryFileContents", iterations, file_size, [&]() {
+    std::vector<char> contents = Tools::GetBinaryFileContents(filename);
+    return Checksum(contents.data(), contents.size());
+  });
+  Measure("FileView (buffered)", iterations, file_size, [&]() {
+    Tools::FileView view;
+    view.Open(filename, false);
+    return Checksum(view.GetData(), view.GetSize());
+  });
+  Measure("FileView (mapped)", iterations, file_size, [&]() {
+    Tools::FileView view;
+    view.Open(filename);
+    return Checksum(view.GetData(), view.GetSize());
+  });
+
+  if (generated) {
+    std::remove(filename.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,106 @@
+// Compares the SIMD Math functions of the instruction set this binary was
+// compiled for against their scalar versions.
+//
+// Usage: math_benchmark [count] [iterations]
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common/vector_math.h"
+
+namespace {
+
+// Best of all iterations, in millions of operations per second
+double Measure(uint32_t iterations, size_t count,
+               const std::function<void()> &run) {
+  double best_seconds = 0.0;
+  for (uint32_t i = 0; i < iterations; ++i) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    run();
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    if ((i == 0) || (seconds < best_seconds)) {
+      best_seconds = seconds;
+    }
+  }
+  return count / best_seconds / 1000000.0;
+}
+
+void Report(const char *name, double scalar, double simd, float max_error) {
+  std::cout << std::left << std::setw(16) << name << std::right << std::fixed
+            << std::setprecision(1) << std::setw(10) << scalar
+            << " Mop/s scalar" << std::setw(10) << simd << " Mop/s "
+            << Math::GetInstructionSet() << "  speedup "
+            << std::setprecision(2) << simd / scalar << "x  max error "
+            << std::scientific << max_error << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  size_t count = (argc > 1) ? std::stoul(argv[1]) : 16384;
+  uint32_t iterations =
+      (argc > 2) ? static_cast<uint32_t>(std::stoul(argv[2])) : 200;
+
+  std::vector<Math::Mat4> a(count), b(count), scalar_out(count),
+      simd_out(count);
+  std::vector<Math::Vec4> vectors(count), scalar_vectors(count),
+      simd_vectors(count);
+  for (size_t i = 0; i < count; ++i) {
+    float angle = static_cast<float>(i % 360);
+    a[i] = Math::Translation(1.0f, 2.0f, static_cast<float>(i)) *
+           Math::ToMatrix(Math::Quat::FromAxisAngle(
+               Math::Vec4(0.0f, 1.0f, 1.0f, 0.0f), angle));
+    b[i] = Math::Perspective(1.5f, 60.0f + angle * 0.1f, 0.1f, 100.0f);
+    vectors[i] = Math::Vec4(static_cast<float>(i), 1.0f, -2.0f, 1.0f);
+  }
+  Math::Mat4 transform = a[count / 2];
+
+  std::cout << count << " elements, best of " << iterations << " runs"
+            << std::endl;
+
+  double scalar = Measure(iterations, count, [&]() {
+    Math::Scalar::MultiplyArray(a.data(), b.data(), scalar_out.data(), count);
+  });
+  double simd = Measure(iterations, count, [&]() {
+    Math::MultiplyArray(a.data(), b.data(), simd_out.data(), count);
+  });
+  float max_error = 0.0f;
+  for (size_t i = 0; i < count; ++i) {
+    for (int j = 0; j < 16; ++j) {
+      max_error = std::max(
+          max_error, std::fabs(scalar_out[i].m[j] - simd_out[i].m[j]));
+    }
+  }
+  Report("mat4 x mat4", scalar, simd, max_error);
+
+  scalar = Measure(iterations, count, [&]() {
+    Math::Scalar::TransformArray(transform, vectors.data(),
+                                 scalar_vectors.data(), count);
+  });
+  simd = Measure(iterations, count, [&]() {
+    Math::TransformArray(transform, vectors.data(), simd_vectors.data(),
+                         count);
+  });
+  max_error = 0.0f;
+  for (size_t i = 0; i < count; ++i) {
+    max_error = std::max(
+        max_error,
+        std::max(std::max(std::fabs(scalar_vectors[i].x - simd_vectors[i].x),
+                          std::fabs(scalar_vectors[i].y - simd_vectors[i].y)),
+                 std::max(std::fabs(scalar_vectors[i].z - simd_vectors[i].z),
+                          std::fabs(scalar_vectors[i].w - simd_vectors[i].w))));
+  }
+  Report("mat4 x vec4", scalar, simd, max_error);
+  return 0;
+}
@@ -0,0 +1,175 @@
+// Checks the Math functions of the instruction set this binary was compiled
+// for against the scalar versions, and the projection matrices against the
+// formulas Tools used before they moved to Math.
+//
+// Usage: math_test
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "common/tools.h"
+#include "common/vector_math.h"
+
+namespace {
+
+// SIMD paths may use fused multiply-add, so results differ in the last bits
+const float Tolerance = 1e-5f;
+
+int failure_count = 0;
+
+bool IsClose(float a, float b) {
+  float scale = std::max(1.0f, std::max(std::fabs(a), std::fabs(b)));
+  return std::fabs(a - b) <= Tolerance * scale;
+}
+
+void Check(const char *name, const float *expected, const float *actual,
+           size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    if (!IsClose(expected[i], actual[i])) {
+      std::cout << "FAILED " << name << ": element " << i << " is "
+                << actual[i] << ", expected " << expected[i] << std::endl;
+      ++failure_count;
+      return;
+    }
+  }
+}
+
+// Projection formulas as Tools computed them before
+std::array<float, 16> ReferencePerspective(float aspect_ratio,
+                                           float field_of_view,
+                                           float near_clip, float far_clip) {
+  float f = 1.0f / std::tan(field_of_view * 0.5f *
+                            0.01745329251994329576923690768489f);
+
+  return {f / aspect_ratio,
+          0.0f,
+          0.0f,
+          0.0f,
+
+          0.0f,
+          -f,
+          0.0f,
+          0.0f,
+
+          0.0f,
+          0.0f,
+          far_clip / (near_clip - far_clip),
+          -1.0f,
+
+          0.0f,
+          0.0f,
+          (near_clip * far_clip) / (near_clip - far_clip),
+          0.0f};
+}
+
+std::array<float, 16> ReferenceOrthographic(float left_plane,
+                                            float right_plane,
+                                            float top_plane,
+                                            float bottom_plane,
+                                            float near_plane,
+                                            float far_plane) {
+  return {2.0f / (right_plane - left_plane),
+          0.0f,
+          0.0f,
+          0.0f,
+
+          0.0f,
+          2.0f / (bottom_plane - top_plane),
+          0.0f,
+          0.0f,
+
+          0.0f,
+          0.0f,
+          1.0f / (near_plane - far_plane),
+          0.0f,
+
+          -(right_plane + left_plane) / (right_plane - left_plane),
+          -(bottom_plane + top_plane) / (bottom_plane - top_plane),
+          near_plane / (near_plane - far_plane),
+          1.0f};
+}
+
+void TestProjections() {
+  std::array<float, 16> expected = ReferencePerspective(1.5f, 60.0f, 0.1f,
+                                                        100.0f);
+  Check("Math::Perspective", expected.data(),
+        Math::Perspective(1.5f, 60.0f, 0.1f, 100.0f).ToArray().data(), 16);
+  Check("Tools::GetPerspectiveProjectionMatrix", expected.data(),
+        Tools::GetPerspectiveProjectionMatrix(1.5f, 60.0f, 0.1f, 100.0f)
+            .data(),
+        16);
+
+  expected = ReferenceOrthographic(-2.0f, 3.0f, -1.0f, 4.0f, 0.5f, 20.0f);
+  Check("Math::Orthographic", expected.data(),
+        Math::Orthographic(-2.0f, 3.0f, -1.0f, 4.0f, 0.5f, 20.0f)
+            .ToArray()
+            .data(),
+        16);
+  Check("Tools::GetOrthographicProjectionMatrix", expected.data(),
+        Tools::GetOrthographicProjectionMatrix(-2.0f, 3.0f, -1.0f, 4.0f, 0.5f,
+                                               20.0f)
+            .data(),
+        16);
+}
+
+void TestBatches() {
+  // Not a multiple of any vector width, so the remainder loops run as well
+  const size_t count = 1027;
+  std::vector<Math::Mat4> a(count), b(count), scalar_out(count),
+      simd_out(count);
+  std::vector<Math::Vec4> vectors(count), scalar_vectors(count),
+      simd_vectors(count);
+  for (size_t i = 0; i < count; ++i) {
+    float angle = static_cast<float>(i % 360);
+    a[i] = Math::Translation(1.0f, 2.0f, static_cast<float>(i)) *
+           Math::ToMatrix(Math::Quat::FromAxisAngle(
+               Math::Vec4(0.0f, 1.0f, 1.0f, 0.0f), angle));
+    b[i] = Math::Perspective(1.5f, 60.0f + angle * 0.1f, 0.1f, 100.0f);
+    vectors[i] = Math::Vec4(static_cast<float>(i), 1.0f, -2.0f, 1.0f);
+  }
+
+  Math::Scalar::MultiplyArray(a.data(), b.data(), scalar_out.data(), count);
+  Math::MultiplyArray(a.data(), b.data(), simd_out.data(), count);
+  for (size_t i = 0; i < count; ++i) {
+    Check("Math::MultiplyArray", scalar_out[i].m, simd_out[i].m, 16);
+  }
+
+  Math::Mat4 product = a[count / 2] * b[count / 2];
+  Check("Math::operator*(Mat4, Mat4)", scalar_out[count / 2].m, product.m,
+        16);
+
+  const Math::Mat4 &transform = a[count / 2];
+  Math::Scalar::TransformArray(transform, vectors.data(),
+                               scalar_vectors.data(), count);
+  Math::TransformArray(transform, vectors.data(), simd_vectors.data(), count);
+  for (size_t i = 0; i < count; ++i) {
+    Check("Math::TransformArray", &scalar_vectors[i].x, &simd_vectors[i].x,
+          4);
+  }
+
+  Math::Vec4 transformed = transform * vectors[count / 2];
+  Check("Math::operator*(Mat4, Vec4)", &scalar_vectors[count / 2].x,
+        &transformed.x, 4);
+}
+
+}  // namespace
+
+int main() {
+  std::cout << "Testing the " << Math::GetInstructionSet()
+            << " math functions" << std::endl;
+
+  TestProjections();
+  TestBatches();
+
+  if (failure_count > 0) {
+    std::cout << failure_count << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All checks passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,188 @@
+#include "asset_loader.h"
+
+#include <algorithm>
+#include <iostream>
+#include <system_error>
+
+#include "common/tools.h"
+
+AssetLoader::AssetLoader()
+    : workers_(),
+      mutex_(),
+      request_available_(),
+      request_completed_(),
+      queued_(),
+      completed_(),
+      pending_(0),
+      stopping_(false) {}
+
+AssetLoader::~AssetLoader() { Destroy(); }
+
+bool AssetLoader::Init(uint32_t worker_count) {
+  Destroy();
+
+  if (worker_count == 0) {
+    worker_count = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  stopping_ = false;
+  try {
+    for (uint32_t i = 0; i < worker_count; ++i) {
+      workers_.push_back(std::thread(&AssetLoader::WorkerLoop, this));
+    }
+  } catch (const std::system_error &error) {
+    std::cout << "Could not start asset loading threads: " << error.what()
+              << std::endl;
+    Destroy();
+    return false;
+  }
+  return true;
+}
+
+void AssetLoader::Destroy() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  request_available_.notify_all();
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i].join();
+  }
+  workers_.clear();
+
+  // Requests which were never started are dropped without callbacks
+  pending_ -= static_cast<uint32_t>(queued_.size());
+  queued_.clear();
+}
+
+uint32_t AssetLoader::GetWorkerCount() const {
+  return static_cast<uint32_t>(workers_.size());
+}
+
+void AssetLoader::LoadFile(const std::string &file_name,
+                           const Callback &callback) {
+  Enqueue(file_name, false, 0, callback);
+}
+
+void AssetLoader::LoadImage(const std::string &file_name,
+                            int requested_components,
+                            const Callback &callback) {
+  Enqueue(file_name, true, requested_components, callback);
+}
+
+void AssetLoader::Enqueue(const std::string &file_name, bool is_image,
+                          int requested_components, const Callback &callback) {
+  Request request;
+  request.FileName = file_name;
+  request.IsImage = is_image;
+  request.RequestedComponents = requested_components;
+  request.OnLoaded = callback;
+
+  // Without workers the request is loaded right away on the calling thread
+  if (workers_.empty()) {
+    Load(request);
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++pending_;
+    completed_.push_back(std::move(request));
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++pending_;
+    queued_.push_back(std::move(request));
+  }
+  request_available_.notify_one();
+}
+
+uint32_t AssetLoader::DispatchCompleted(UploadManager *upload_manager) {
+  std::vector<Request> completed;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    completed.swap(completed_);
+  }
+
+  for (size_t i = 0; i < completed.size(); ++i) {
+    if (completed[i].OnLoaded) {
+      completed[i].OnLoaded(completed[i].Asset);
+    }
+  }
+
+  // Everything recorded by the callbacks goes to the GPU in one submission
+  if (!completed.empty() && (upload_manager != nullptr)) {
+    upload_manager->Flush();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_ -= static_cast<uint32_t>(completed.size());
+  }
+  return static_cast<uint32_t>(completed.size());
+}
+
+bool AssetLoader::WaitIdle(UploadManager *upload_manager) {
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      request_completed_.wait(lock, [this]() {
+        return !completed_.empty() || (pending_ == 0);
+      });
+      if (pending_ == 0) {
+        break;
+      }
+    }
+    DispatchCompleted(upload_manager);
+  }
+  return (upload_manager == nullptr) || upload_manager->WaitIdle();
+}
+
+uint32_t AssetLoader::GetPendingCount() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_;
+}
+
+void AssetLoader::WorkerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    request_available_.wait(
+        lock, [this]() { return stopping_ || !queued_.empty(); });
+    if (stopping_) {
+      return;
+    }
+
+    Request request = std::move(queued_.front());
+    queued_.pop_front();
+
+    lock.unlock();
+    Load(request);
+    lock.lock();
+
+    completed_.push_back(std::move(request));
+    request_completed_.notify_all();
+  }
+}
+
+void AssetLoader::Load(Request &request) {
+  LoadedAsset &asset = request.Asset;
+  asset.FileName = request.FileName;
+
+  Tools::FileView file;
+  if (!file.Open(request.FileName)) {
+    return;
+  }
+
+  if (!request.IsImage) {
+    asset.Data.assign(file.GetData(), file.GetData() + file.GetSize());
+    asset.Succeeded = true;
+    return;
+  }
+
+  int data_size = 0;
+  if (!Tools::GetImageInfo(file, request.RequestedComponents, &asset.Width,
+                           &asset.Height, &asset.Components, &data_size)) {
+    return;
+  }
+  asset.Data.resize(data_size);
+  asset.Succeeded = Tools::LoadImageData(file, request.RequestedComponents,
+                                         asset.Data.data(), asset.Data.size());
+}
@@ -0,0 +1,94 @@
+#ifndef ASSET_LOADER_H_
+#define ASSET_LOADER_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/upload_manager.h"
+
+// ************************************************************ //
+// LoadedAsset                                                  //
+//                                                              //
+// File contents or decoded image produced by the AssetLoader   //
+// ************************************************************ //
+struct LoadedAsset {
+  std::string FileName;
+  bool Succeeded;
+  // Decoded pixels for images, raw file contents otherwise
+  std::vector<char> Data;
+  int Width;
+  int Height;
+  int Components;
+
+  LoadedAsset()
+      : FileName(),
+        Succeeded(false),
+        Data(),
+        Width(0),
+        Height(0),
+        Components(0) {}
+};
+
+// ************************************************************ //
+// AssetLoader                                                  //
+//                                                              //
+// Reads files and decodes images on worker threads; completion //
+// callbacks run on the thread calling DispatchCompleted(), so  //
+// they can record uploads which are then submitted as a batch  //
+// ************************************************************ //
+class AssetLoader {
+ public:
+  typedef std::function<void(LoadedAsset &asset)> Callback;
+
+  AssetLoader();
+  ~AssetLoader();
+
+  // worker_count of 0 uses one thread per hardware core
+  bool Init(uint32_t worker_count);
+  void Destroy();
+  uint32_t GetWorkerCount() const;
+
+  void LoadFile(const std::string &file_name, const Callback &callback);
+  // requested_components of 0 keeps the number of components of the file
+  void LoadImage(const std::string &file_name, int requested_components,
+                 const Callback &callback);
+
+  // Runs callbacks of all finished requests and flushes the upload manager
+  // once afterwards; returns the number of dispatched requests
+  uint32_t DispatchCompleted(UploadManager *upload_manager = nullptr);
+  // Blocks until every request was loaded and dispatched
+  bool WaitIdle(UploadManager *upload_manager = nullptr);
+  uint32_t GetPendingCount();
+
+ private:
+  struct Request {
+    std::string FileName;
+    bool IsImage;
+    int RequestedComponents;
+    Callback OnLoaded;
+    LoadedAsset Asset;
+  };
+
+  void Enqueue(const std::string &file_name, bool is_image,
+               int requested_components, const Callback &callback);
+  void WorkerLoop();
+  static void Load(Request &request);
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable request_available_;
+  std::condition_variable request_completed_;
+  std::deque<Request> queued_;
+  std::vector<Request> completed_;
+  uint32_t pending_;
+  bool stopping_;
+};
+
+#endif
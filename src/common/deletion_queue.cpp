@@ -0,0 +1,47 @@
+#include "deletion_queue.h"
+
+#include "gpu_timeline.h"
+
+DeletionQueue::DeletionQueue() : timeline_(nullptr), entries_() {}
+
+DeletionQueue::~DeletionQueue() { Flush(); }
+
+void DeletionQueue::Init(GpuTimeline *timeline) { timeline_ = timeline; }
+
+void DeletionQueue::Enqueue(uint64_t timeline_value, const Deleter &deleter) {
+  Entry entry = {timeline_value, deleter};
+  entries_.push_back(entry);
+}
+
+void DeletionQueue::Collect() {
+  if (entries_.empty() || (timeline_ == nullptr)) {
+    return;
+  }
+
+  // Entries are not sorted: objects get enqueued with the value of their last
+  // use, which is not necessarily the latest one. Deleters may enqueue
+  // further objects, so the list is swapped out first
+  uint64_t completed_value = timeline_->GetCompletedValue();
+  std::vector<Entry> entries;
+  entries.swap(entries_);
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (entries[i].TimelineValue <= completed_value) {
+      entries[i].Delete();
+    } else {
+      entries_.push_back(entries[i]);
+    }
+  }
+}
+
+void DeletionQueue::Flush() {
+  // Deleters may enqueue further objects
+  while (!entries_.empty()) {
+    std::vector<Entry> entries;
+    entries.swap(entries_);
+    for (size_t i = 0; i < entries.size(); ++i) {
+      entries[i].Delete();
+    }
+  }
+}
+
+size_t DeletionQueue::GetPendingCount() const { return entries_.size(); }
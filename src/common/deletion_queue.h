@@ -0,0 +1,51 @@
+#ifndef DELETION_QUEUE_H_
+#define DELETION_QUEUE_H_
+
+#include <vulkan/vulkan.h>
+
+#include <functional>
+#include <vector>
+
+class GpuTimeline;
+
+// ************************************************************ //
+// DeletionQueue                                                //
+//                                                              //
+// Destruction of objects the GPU may still be using, deferred  //
+// until the timeline value of their last use has completed     //
+// Not thread safe, like the timeline it polls                  //
+// ************************************************************ //
+class DeletionQueue {
+ public:
+  typedef std::function<void()> Deleter;
+
+  DeletionQueue();
+  ~DeletionQueue();
+
+  void Init(GpuTimeline *timeline);
+
+  // A timeline_value of 0 means the object was never used by the GPU, it is
+  // still destroyed at the next Collect() and not immediately
+  void Enqueue(uint64_t timeline_value, const Deleter &deleter);
+  template <class T, class F>
+  void Enqueue(uint64_t timeline_value, VkDevice device, T object, F deleter) {
+    Enqueue(timeline_value,
+            [device, object, deleter]() { deleter(device, object, nullptr); });
+  }
+  // Runs deleters whose timeline value has completed
+  void Collect();
+  // Runs all deleters; nothing may be in flight, i.e. after vkDeviceWaitIdle()
+  void Flush();
+  size_t GetPendingCount() const;
+
+ private:
+  struct Entry {
+    uint64_t TimelineValue;
+    Deleter Delete;
+  };
+
+  GpuTimeline *timeline_;
+  std::vector<Entry> entries_;
+};
+
+#endif
@@ -0,0 +1,261 @@
+#include "draw_list.h"
+
+#include <string.h>
+
+#include <iostream>
+
+DrawList::DrawList()
+    : device_(VK_NULL_HANDLE),
+      memory_allocator_(nullptr),
+      max_draw_count_(0),
+      multi_draw_indirect_(false),
+      draw_indirect_count_(nullptr),
+      commands_(),
+      source_buffer_(),
+      command_buffer_(),
+      count_buffer_(),
+      command_slice_size_(0),
+      version_(1),
+      source_versions_(),
+      uploaded_versions_() {}
+
+DrawList::~DrawList() { Destroy(); }
+
+bool DrawList::Init(VkDevice device, MemoryAllocator *memory_allocator,
+                    uint32_t max_draw_count, uint32_t frames_in_flight,
+                    bool multi_draw_indirect,
+                    PFN_vkCmdDrawIndexedIndirectCountKHR draw_indirect_count) {
+  Destroy();
+  device_ = device;
+  memory_allocator_ = memory_allocator;
+  max_draw_count_ = max_draw_count;
+  multi_draw_indirect_ = multi_draw_indirect;
+  draw_indirect_count_ = draw_indirect_count;
+  commands_.reserve(max_draw_count);
+
+  VkDeviceSize command_size =
+      max_draw_count * sizeof(VkDrawIndexedIndirectCommand);
+  command_slice_size_ =
+      (command_size + SliceAlignment - 1) / SliceAlignment * SliceAlignment;
+
+  // The source is written by the CPU and read by transfers or shaders, the
+  // command and count buffers are read by indirect draws
+  if (!CreateBuffer(command_slice_size_ * frames_in_flight,
+                    VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &source_buffer_) ||
+      !CreateBuffer(command_slice_size_ * frames_in_flight,
+                    VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+                    &command_buffer_) ||
+      !CreateBuffer(SliceAlignment * frames_in_flight,
+                    VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &count_buffer_)) {
+    return false;
+  }
+  if (source_buffer_.Memory.Mapped == nullptr) {
+    std::cout << "Draw list source buffer is not mapped!" << std::endl;
+    return false;
+  }
+
+  source_versions_.assign(frames_in_flight, 0);
+  uploaded_versions_.assign(frames_in_flight, 0);
+  return true;
+}
+
+void DrawList::Destroy() {
+  if (device_ == VK_NULL_HANDLE) {
+    return;
+  }
+  DestroyBuffer(source_buffer_);
+  DestroyBuffer(command_buffer_);
+  DestroyBuffer(count_buffer_);
+  commands_.clear();
+  source_versions_.clear();
+  uploaded_versions_.clear();
+  device_ = VK_NULL_HANDLE;
+}
+
+void DrawList::Clear() {
+  if (!commands_.empty()) {
+    commands_.clear();
+    ++version_;
+  }
+}
+
+bool DrawList::Add(const VkDrawIndexedIndirectCommand &command) {
+  if (commands_.size() >= max_draw_count_) {
+    std::cout << "Draw list is full!" << std::endl;
+    return false;
+  }
+  commands_.push_back(command);
+  ++version_;
+  return true;
+}
+
+uint32_t DrawList::GetDrawCount() const {
+  return static_cast<uint32_t>(commands_.size());
+}
+
+uint32_t DrawList::GetMaxDrawCount() const { return max_draw_count_; }
+
+bool DrawList::UsesDrawIndirectCount() const {
+  return draw_indirect_count_ != nullptr;
+}
+
+bool DrawList::WriteSource(uint32_t frame_index) {
+  if (source_versions_[frame_index] == version_) {
+    return true;
+  }
+
+  VkDeviceSize offset = GetCommandOffset(frame_index);
+  memcpy(static_cast<char *>(source_buffer_.Memory.Mapped) + offset,
+         commands_.data(),
+         commands_.size() * sizeof(VkDrawIndexedIndirectCommand));
+  if (!memory_allocator_->IsHostCoherent(source_buffer_.Memory) &&
+      !memory_allocator_->Flush(source_buffer_.Memory, offset,
+                                command_slice_size_)) {
+    std::cout << "Could not flush the draw list!" << std::endl;
+    return false;
+  }
+  source_versions_[frame_index] = version_;
+  return true;
+}
+
+bool DrawList::RecordUpload(VkCommandBuffer command_buffer,
+                            uint32_t frame_index) {
+  // The slice still holds what an earlier frame uploaded, and the barrier
+  // recorded back then orders it before this frame's draw
+  if (uploaded_versions_[frame_index] == version_) {
+    return true;
+  }
+  if (!WriteSource(frame_index)) {
+    return false;
+  }
+
+  if (!commands_.empty()) {
+    VkBufferCopy region = {
+        GetCommandOffset(frame_index),  // VkDeviceSize srcOffset
+        GetCommandOffset(frame_index),  // VkDeviceSize dstOffset
+        commands_.size() *
+            sizeof(VkDrawIndexedIndirectCommand)  // VkDeviceSize size
+    };
+    vkCmdCopyBuffer(command_buffer, source_buffer_.Handle,
+                    command_buffer_.Handle, 1, &region);
+  }
+  uint32_t draw_count = GetDrawCount();
+  vkCmdUpdateBuffer(command_buffer, count_buffer_.Handle,
+                    GetCountOffset(frame_index), sizeof(draw_count),
+                    &draw_count);
+
+  VkMemoryBarrier barrier = {
+      VK_STRUCTURE_TYPE_MEMORY_BARRIER,    // VkStructureType sType
+      nullptr,                             // const void     *pNext
+      VK_ACCESS_TRANSFER_WRITE_BIT,        // VkAccessFlags   srcAccessMask
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT  // VkAccessFlags   dstAccessMask
+  };
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+
+  uploaded_versions_[frame_index] = version_;
+  return true;
+}
+
+void DrawList::RecordDraw(VkCommandBuffer command_buffer,
+                          uint32_t frame_index) {
+  VkDeviceSize offset = GetCommandOffset(frame_index);
+  uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+  // The count comes from GPU memory, so passes like culling can shrink the
+  // list without the CPU knowing the result
+  if (draw_indirect_count_ != nullptr) {
+    draw_indirect_count_(command_buffer, command_buffer_.Handle, offset,
+                         count_buffer_.Handle, GetCountOffset(frame_index),
+                         max_draw_count_, stride);
+    return;
+  }
+
+  if (multi_draw_indirect_) {
+    vkCmdDrawIndexedIndirect(command_buffer, command_buffer_.Handle, offset,
+                             GetDrawCount(), stride);
+    return;
+  }
+  for (uint32_t i = 0; i < GetDrawCount(); ++i) {
+    vkCmdDrawIndexedIndirect(command_buffer, command_buffer_.Handle,
+                             offset + i * stride, 1, stride);
+  }
+}
+
+const BufferParameters &DrawList::GetSourceBuffer() const {
+  return source_buffer_;
+}
+
+const BufferParameters &DrawList::GetCommandBuffer() const {
+  return command_buffer_;
+}
+
+const BufferParameters &DrawList::GetCountBuffer() const {
+  return count_buffer_;
+}
+
+VkDeviceSize DrawList::GetCommandSliceSize() const {
+  return command_slice_size_;
+}
+
+VkDeviceSize DrawList::GetCommandOffset(uint32_t frame_index) const {
+  return frame_index * command_slice_size_;
+}
+
+VkDeviceSize DrawList::GetCountOffset(uint32_t frame_index) const {
+  return frame_index * SliceAlignment;
+}
+
+bool DrawList::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                            VkMemoryPropertyFlags required_flags,
+                            VkMemoryPropertyFlags preferred_flags,
+                            BufferParameters *buffer) {
+  buffer->Size = static_cast<uint32_t>(size);
+
+  VkBufferCreateInfo buffer_create_info = {
+      VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // VkStructureType        sType
+      nullptr,                               // const void            *pNext
+      0,                                     // VkBufferCreateFlags    flags
+      size,                                  // VkDeviceSize           size
+      usage,                                 // VkBufferUsageFlags     usage
+      VK_SHARING_MODE_EXCLUSIVE,  // VkSharingMode          sharingMode
+      0,       // uint32_t               queueFamilyIndexCount
+      nullptr  // const uint32_t        *pQueueFamilyIndices
+  };
+
+  if (vkCreateBuffer(device_, &buffer_create_info, nullptr,
+                     &buffer->Handle) != VK_SUCCESS) {
+    std::cout << "Could not create a draw list buffer!" << std::endl;
+    return false;
+  }
+
+  if (!memory_allocator_->AllocateForBuffer(buffer->Handle, required_flags,
+                                            preferred_flags,
+                                            &buffer->Memory) ||
+      (vkBindBufferMemory(device_, buffer->Handle, buffer->Memory.Memory,
+                          buffer->Memory.Offset) != VK_SUCCESS)) {
+    std::cout << "Could not allocate memory for a draw list buffer!"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void DrawList::DestroyBuffer(BufferParameters &buffer) {
+  if (buffer.Handle != VK_NULL_HANDLE) {
+    vkDestroyBuffer(device_, buffer.Handle, nullptr);
+    buffer.Handle = VK_NULL_HANDLE;
+  }
+  memory_allocator_->Free(buffer.Memory);
+  buffer.Size = 0;
+}
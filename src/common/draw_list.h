@@ -0,0 +1,83 @@
+#ifndef DRAW_LIST_H_
+#define DRAW_LIST_H_
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+#include "common/memory_allocator.h"
+#include "common/vulkan_common.h"
+
+// ************************************************************ //
+// DrawList                                                     //
+//                                                              //
+// Indexed draw commands collected on the CPU and issued with a //
+// single indirect draw, so recording does not depend on the    //
+// number of objects. Every frame in flight owns a slice of the //
+// host visible source buffer and of the device local command   //
+// and count buffers, so changing the list never stalls the GPU //
+// ************************************************************ //
+class DrawList {
+ public:
+  // Slices start at offsets usable for storage buffer descriptors
+  static const VkDeviceSize SliceAlignment = 256;
+
+  DrawList();
+  ~DrawList();
+
+  // draw_indirect_count is null without VK_KHR_draw_indirect_count; without
+  // multi_draw_indirect every command is issued with its own indirect draw
+  bool Init(VkDevice device, MemoryAllocator *memory_allocator,
+            uint32_t max_draw_count, uint32_t frames_in_flight,
+            bool multi_draw_indirect,
+            PFN_vkCmdDrawIndexedIndirectCountKHR draw_indirect_count);
+  void Destroy();
+
+  void Clear();
+  bool Add(const VkDrawIndexedIndirectCommand &command);
+  uint32_t GetDrawCount() const;
+  uint32_t GetMaxDrawCount() const;
+  bool UsesDrawIndirectCount() const;
+
+  // Outside of a render pass, after the frame's previous use has finished:
+  // brings the frame's command and count slices up to date with the list
+  bool RecordUpload(VkCommandBuffer command_buffer, uint32_t frame_index);
+  // Inside a render pass, with an indexed pipeline and buffers bound
+  void RecordDraw(VkCommandBuffer command_buffer, uint32_t frame_index);
+
+  // For passes generating the commands on the GPU instead of
+  // RecordUpload(), i.e. culling; the source holds the list as written by
+  // the CPU, the count slice a single uint32_t
+  const BufferParameters &GetSourceBuffer() const;
+  const BufferParameters &GetCommandBuffer() const;
+  const BufferParameters &GetCountBuffer() const;
+  VkDeviceSize GetCommandSliceSize() const;
+  VkDeviceSize GetCommandOffset(uint32_t frame_index) const;
+  VkDeviceSize GetCountOffset(uint32_t frame_index) const;
+  // Writes the list into the frame's source slice if it changed since
+  bool WriteSource(uint32_t frame_index);
+
+ private:
+  bool CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                    VkMemoryPropertyFlags required_flags,
+                    VkMemoryPropertyFlags preferred_flags,
+                    BufferParameters *buffer);
+  void DestroyBuffer(BufferParameters &buffer);
+
+  VkDevice device_;
+  MemoryAllocator *memory_allocator_;
+  uint32_t max_draw_count_;
+  bool multi_draw_indirect_;
+  PFN_vkCmdDrawIndexedIndirectCountKHR draw_indirect_count_;
+  std::vector<VkDrawIndexedIndirectCommand> commands_;
+  BufferParameters source_buffer_;
+  BufferParameters command_buffer_;
+  BufferParameters count_buffer_;
+  VkDeviceSize command_slice_size_;
+  // Bumped on every change; a slice is rewritten when its version is older
+  uint64_t version_;
+  std::vector<uint64_t> source_versions_;
+  std::vector<uint64_t> uploaded_versions_;
+};
+
+#endif
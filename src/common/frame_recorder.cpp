@@ -0,0 +1,135 @@
+#include "frame_recorder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+const char *const MetricNames[] = {"cpu_frame_ms",  "acquire_ms",
+                                   "record_ms",     "gpu_wait_ms",
+                                   "submit_ms",     "present_ms",
+                                   "latency_ms"};
+const size_t MetricCount = sizeof(MetricNames) / sizeof(MetricNames[0]);
+
+// Nearest-rank percentile of sorted values: the smallest value which at
+// least percent of all values do not exceed
+double Percentile(const std::vector<double> &sorted_values, double percent) {
+  size_t rank = static_cast<size_t>(
+      std::ceil(percent / 100.0 * sorted_values.size()));
+  rank = (rank > 0) ? rank - 1 : 0;
+  return sorted_values[std::min(rank, sorted_values.size() - 1)];
+}
+
+}  // namespace
+
+FrameRecorder::FrameRecorder()
+    : enabled_(false),
+      frame_start_(),
+      current_(),
+      frames_() {}
+
+void FrameRecorder::SetEnabled(bool enabled) { enabled_ = enabled; }
+
+bool FrameRecorder::IsEnabled() const { return enabled_; }
+
+void FrameRecorder::BeginFrame() {
+  if (!enabled_) {
+    return;
+  }
+  frame_start_ = Clock::now();
+  current_ = FrameTimes();
+}
+
+void FrameRecorder::EndFrame() {
+  if (!enabled_) {
+    return;
+  }
+  current_.FrameMilliseconds =
+      std::chrono::duration<double, std::milli>(Clock::now() - frame_start_)
+          .count();
+  frames_.push_back(current_);
+}
+
+void FrameRecorder::AddPhaseTime(FramePhase phase, Clock::time_point start) {
+  if (!enabled_) {
+    return;
+  }
+  current_.PhaseMilliseconds[static_cast<size_t>(phase)] +=
+      std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+size_t FrameRecorder::GetFrameCount() const { return frames_.size(); }
+
+bool FrameRecorder::WriteJson(const std::string &file_name,
+                              const std::string &label) const {
+  std::ofstream file(file_name);
+  if (!file) {
+    std::cout << "Could not open file \"" << file_name << "\"!" << std::endl;
+    return false;
+  }
+
+  double total_milliseconds = 0.0;
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    total_milliseconds += frames_[i].FrameMilliseconds;
+  }
+
+  file << std::fixed << std::setprecision(4);
+  file << "{" << std::endl
+       << "  \"label\": \"" << label << "\"," << std::endl
+       << "  \"frames\": " << frames_.size() << "," << std::endl
+       << "  \"total_ms\": " << total_milliseconds << "," << std::endl
+       << "  \"metrics\": {" << std::endl;
+
+  for (size_t metric = 0; metric < MetricCount; ++metric) {
+    std::vector<double> values(frames_.size());
+    double sum = 0.0;
+    for (size_t i = 0; i < frames_.size(); ++i) {
+      values[i] = (metric == 0) ? frames_[i].FrameMilliseconds
+                                : frames_[i].PhaseMilliseconds[metric - 1];
+      sum += values[i];
+    }
+    std::sort(values.begin(), values.end());
+
+    file << "    \"" << MetricNames[metric] << "\": {";
+    if (!values.empty()) {
+      file << "\"min\": " << values.front()
+           << ", \"avg\": " << sum / values.size()
+           << ", \"p50\": " << Percentile(values, 50.0)
+           << ", \"p90\": " << Percentile(values, 90.0)
+           << ", \"p99\": " << Percentile(values, 99.0)
+           << ", \"max\": " << values.back();
+    }
+    file << "}" << ((metric + 1 < MetricCount) ? "," : "") << std::endl;
+  }
+
+  file << "  }" << std::endl << "}" << std::endl;
+  return static_cast<bool>(file);
+}
+
+bool FrameRecorder::WriteCsv(const std::string &file_name) const {
+  std::ofstream file(file_name);
+  if (!file) {
+    std::cout << "Could not open file \"" << file_name << "\"!" << std::endl;
+    return false;
+  }
+
+  file << "frame";
+  for (size_t metric = 0; metric < MetricCount; ++metric) {
+    file << "," << MetricNames[metric];
+  }
+  file << std::endl;
+
+  file << std::fixed << std::setprecision(4);
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    file << i << "," << frames_[i].FrameMilliseconds;
+    for (size_t phase = 0; phase < frames_[i].PhaseMilliseconds.size();
+         ++phase) {
+      file << "," << frames_[i].PhaseMilliseconds[phase];
+    }
+    file << std::endl;
+  }
+  return static_cast<bool>(file);
+}
@@ -0,0 +1,62 @@
+#ifndef FRAME_RECORDER_H_
+#define FRAME_RECORDER_H_
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// ************************************************************ //
+// FramePhase                                                   //
+//                                                              //
+// Parts of a frame which are timed separately on the CPU       //
+// ************************************************************ //
+enum class FramePhase {
+  Acquire,
+  Record,
+  // Waiting on the GPU timeline for a frame context to become free
+  GpuWait,
+  Submit,
+  Present,
+  // Input to photon estimate of an earlier frame, measured at acquire
+  Latency,
+  Count
+};
+
+// ************************************************************ //
+// FrameRecorder                                                //
+//                                                              //
+// Per frame CPU timings collected in benchmark mode, written   //
+// as a JSON summary with percentiles or as CSV rows            //
+// ************************************************************ //
+class FrameRecorder {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  FrameRecorder();
+
+  void SetEnabled(bool enabled);
+  bool IsEnabled() const;
+
+  void BeginFrame();
+  void EndFrame();
+  void AddPhaseTime(FramePhase phase, Clock::time_point start);
+
+  size_t GetFrameCount() const;
+  bool WriteJson(const std::string &file_name, const std::string &label) const;
+  bool WriteCsv(const std::string &file_name) const;
+
+ private:
+  struct FrameTimes {
+    double FrameMilliseconds;
+    std::array<double, static_cast<size_t>(FramePhase::Count)>
+        PhaseMilliseconds;
+  };
+
+  bool enabled_;
+  Clock::time_point frame_start_;
+  FrameTimes current_;
+  std::vector<FrameTimes> frames_;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "framebuffer_cache.h"
+
+#include <iostream>
+#include <tuple>
+
+FramebufferCache::FramebufferCache() : device_(VK_NULL_HANDLE) {}
+
+FramebufferCache::~FramebufferCache() { Clear(); }
+
+bool FramebufferCache::Key::operator<(const Key &other) const {
+  return std::tie(RenderPass, AttachmentCount, Attachments, Width, Height) <
+         std::tie(other.RenderPass, other.AttachmentCount, other.Attachments,
+                  other.Width, other.Height);
+}
+
+void FramebufferCache::Init(VkDevice device) { device_ = device; }
+
+VkFramebuffer FramebufferCache::Get(VkRenderPass render_pass,
+                                    const VkImageView *attachments,
+                                    uint32_t attachment_count,
+                                    VkExtent2D extent) {
+  if (attachment_count > MaxAttachments) {
+    std::cout << "Too many framebuffer attachments!" << std::endl;
+    return VK_NULL_HANDLE;
+  }
+
+  Key key = {};
+  key.RenderPass = render_pass;
+  key.AttachmentCount = attachment_count;
+  for (uint32_t i = 0; i < attachment_count; ++i) {
+    key.Attachments[i] = attachments[i];
+  }
+  key.Width = extent.width;
+  key.Height = extent.height;
+
+  std::map<Key, VkFramebuffer>::const_iterator it = framebuffers_.find(key);
+  if (it != framebuffers_.end()) {
+    ++statistics_.Hits;
+    return it->second;
+  }
+
+  VkFramebufferCreateInfo framebuffer_create_info = {
+      VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,  // VkStructureType sType
+      nullptr,           // const void                    *pNext
+      0,                 // VkFramebufferCreateFlags       flags
+      render_pass,       // VkRenderPass                   renderPass
+      attachment_count,  // uint32_t                       attachmentCount
+      attachments,       // const VkImageView             *pAttachments
+      extent.width,      // uint32_t                       width
+      extent.height,     // uint32_t                       height
+      1                  // uint32_t                       layers
+  };
+
+  VkFramebuffer framebuffer = VK_NULL_HANDLE;
+  if (vkCreateFramebuffer(device_, &framebuffer_create_info, nullptr,
+                          &framebuffer) != VK_SUCCESS) {
+    std::cout << "Could not create a framebuffer!" << std::endl;
+    return VK_NULL_HANDLE;
+  }
+
+  ++statistics_.Creations;
+  framebuffers_[key] = framebuffer;
+  return framebuffer;
+}
+
+void FramebufferCache::Clear() {
+  if (device_ != VK_NULL_HANDLE) {
+    for (std::map<Key, VkFramebuffer>::iterator it = framebuffers_.begin();
+         it != framebuffers_.end(); ++it) {
+      vkDestroyFramebuffer(device_, it->second, nullptr);
+    }
+  }
+  framebuffers_.clear();
+}
+
+void FramebufferCache::Detach(std::vector<VkFramebuffer> *framebuffers) {
+  for (std::map<Key, VkFramebuffer>::iterator it = framebuffers_.begin();
+       it != framebuffers_.end(); ++it) {
+    framebuffers->push_back(it->second);
+  }
+  framebuffers_.clear();
+}
+
+const FramebufferCacheStatistics &FramebufferCache::GetStatistics() const {
+  return statistics_;
+}
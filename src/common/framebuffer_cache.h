@@ -0,0 +1,62 @@
+#ifndef FRAMEBUFFER_CACHE_H_
+#define FRAMEBUFFER_CACHE_H_
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <map>
+#include <vector>
+
+// ************************************************************ //
+// FramebufferCacheStatistics                                   //
+//                                                              //
+// Counters of framebuffer lookups served from the cache and    //
+// of framebuffers which had to be created                      //
+// ************************************************************ //
+struct FramebufferCacheStatistics {
+  uint64_t Hits;
+  uint64_t Creations;
+
+  FramebufferCacheStatistics() : Hits(0), Creations(0) {}
+};
+
+// ************************************************************ //
+// FramebufferCache                                             //
+//                                                              //
+// Framebuffers keyed by render pass, attachments and extent    //
+// Entries stay alive until the cache is cleared or detached,  //
+// which happens only when swap chain images are recreated      //
+// ************************************************************ //
+class FramebufferCache {
+ public:
+  static const uint32_t MaxAttachments = 8;
+
+  FramebufferCache();
+  ~FramebufferCache();
+
+  void Init(VkDevice device);
+  VkFramebuffer Get(VkRenderPass render_pass, const VkImageView *attachments,
+                    uint32_t attachment_count, VkExtent2D extent);
+  void Clear();
+  // Empties the cache without destroying anything; the framebuffers are
+  // appended to the list and destroyed by the caller once unused
+  void Detach(std::vector<VkFramebuffer> *framebuffers);
+  const FramebufferCacheStatistics &GetStatistics() const;
+
+ private:
+  struct Key {
+    VkRenderPass RenderPass;
+    std::array<VkImageView, MaxAttachments> Attachments;
+    uint32_t AttachmentCount;
+    uint32_t Width;
+    uint32_t Height;
+
+    bool operator<(const Key &other) const;
+  };
+
+  VkDevice device_;
+  std::map<Key, VkFramebuffer> framebuffers_;
+  FramebufferCacheStatistics statistics_;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <iostream>
+
+GpuProfiler::GpuProfiler()
+    : device_(VK_NULL_HANDLE),
+      query_pool_(VK_NULL_HANDLE),
+      timestamp_period_(1.0),
+      timestamp_mask_(0),
+      frames_(),
+      current_frame_(0),
+      scopes_(),
+      scope_ids_() {}
+
+GpuProfiler::~GpuProfiler() { Destroy(); }
+
+bool GpuProfiler::Init(VkPhysicalDevice physical_device, VkDevice device,
+                       uint32_t queue_family_index, uint32_t frame_count) {
+  device_ = device;
+
+  VkPhysicalDeviceProperties device_properties;
+  vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+
+  uint32_t queue_families_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device,
+                                           &queue_families_count, nullptr);
+  std::vector<VkQueueFamilyProperties> queue_family_properties(
+      queue_families_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(
+      physical_device, &queue_families_count, queue_family_properties.data());
+
+  uint32_t valid_bits =
+      (queue_family_index < queue_families_count)
+          ? queue_family_properties[queue_family_index].timestampValidBits
+          : 0;
+  if ((valid_bits == 0) || (device_properties.limits.timestampPeriod == 0.0f)) {
+    // Profiling is optional, rendering works the same without it
+    std::cout << "Timestamp queries are not supported by the queue family, "
+                 "GPU profiling is disabled"
+              << std::endl;
+    return true;
+  }
+  timestamp_mask_ = (valid_bits >= 64) ? UINT64_MAX : ((1ull << valid_bits) - 1);
+  timestamp_period_ = device_properties.limits.timestampPeriod;
+
+  VkQueryPoolCreateInfo query_pool_create_info = {
+      VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,  // VkStructureType sType
+      nullptr,                   // const void                    *pNext
+      0,                         // VkQueryPoolCreateFlags         flags
+      VK_QUERY_TYPE_TIMESTAMP,   // VkQueryType                    queryType
+      frame_count * MaxScopesPerFrame * 2,  // uint32_t queryCount
+      0  // VkQueryPipelineStatisticFlags  pipelineStatistics
+  };
+
+  if (vkCreateQueryPool(device_, &query_pool_create_info, nullptr,
+                        &query_pool_) != VK_SUCCESS) {
+    std::cout << "Could not create a timestamp query pool!" << std::endl;
+    return false;
+  }
+
+  frames_.resize(frame_count);
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    frames_[i].Recorded = false;
+  }
+  return true;
+}
+
+void GpuProfiler::Destroy() {
+  if (query_pool_ != VK_NULL_HANDLE) {
+    vkDestroyQueryPool(device_, query_pool_, nullptr);
+    query_pool_ = VK_NULL_HANDLE;
+  }
+  frames_.clear();
+}
+
+void GpuProfiler::BeginFrame(VkCommandBuffer command_buffer,
+                             uint32_t frame_index) {
+  if (!IsEnabled()) {
+    return;
+  }
+
+  // Previous results of this slot are ready, as its fence was already waited
+  // on; they are frames_.size() frames old
+  CollectResults(frame_index);
+
+  current_frame_ = frame_index;
+  frames_[current_frame_].Scopes.clear();
+  frames_[current_frame_].Recorded = true;
+  vkCmdResetQueryPool(command_buffer, query_pool_,
+                      current_frame_ * MaxScopesPerFrame * 2,
+                      MaxScopesPerFrame * 2);
+}
+
+uint32_t GpuProfiler::BeginScope(VkCommandBuffer command_buffer,
+                                 const char *name) {
+  if (!IsEnabled()) {
+    return UINT32_MAX;
+  }
+
+  FrameQueries &frame = frames_[current_frame_];
+  if (frame.Scopes.size() >= MaxScopesPerFrame) {
+    return UINT32_MAX;
+  }
+
+  uint32_t scope = static_cast<uint32_t>(frame.Scopes.size());
+  frame.Scopes.push_back(GetScopeId(name));
+  vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                      query_pool_,
+                      (current_frame_ * MaxScopesPerFrame + scope) * 2);
+  return scope;
+}
+
+void GpuProfiler::EndScope(VkCommandBuffer command_buffer, uint32_t scope) {
+  if (!IsEnabled() || (scope == UINT32_MAX)) {
+    return;
+  }
+  vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                      query_pool_,
+                      (current_frame_ * MaxScopesPerFrame + scope) * 2 + 1);
+}
+
+bool GpuProfiler::IsEnabled() const { return query_pool_ != VK_NULL_HANDLE; }
+
+std::vector<GpuScopeStatistics> GpuProfiler::GetStatistics() const {
+  std::vector<GpuScopeStatistics> statistics;
+  for (size_t i = 0; i < scopes_.size(); ++i) {
+    const ScopeHistory &history = scopes_[i];
+    if (history.Samples.empty()) {
+      continue;
+    }
+
+    std::vector<double> samples = history.Samples;
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0.0;
+    for (size_t j = 0; j < samples.size(); ++j) {
+      sum += samples[j];
+    }
+
+    GpuScopeStatistics scope_statistics;
+    scope_statistics.Name = history.Name;
+    scope_statistics.SampleCount = static_cast<uint32_t>(samples.size());
+    scope_statistics.MinMilliseconds = samples.front();
+    scope_statistics.AverageMilliseconds = sum / samples.size();
+    scope_statistics.P99Milliseconds =
+        samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+    statistics.push_back(scope_statistics);
+  }
+  return statistics;
+}
+
+void GpuProfiler::CollectResults(uint32_t frame_index) {
+  FrameQueries &frame = frames_[frame_index];
+  if (!frame.Recorded || frame.Scopes.empty()) {
+    return;
+  }
+
+  uint32_t query_count = static_cast<uint32_t>(frame.Scopes.size()) * 2;
+  std::vector<uint64_t> timestamps(query_count);
+  // No VK_QUERY_RESULT_WAIT_BIT - a frame which is not ready is skipped
+  if (vkGetQueryPoolResults(device_, query_pool_,
+                            frame_index * MaxScopesPerFrame * 2, query_count,
+                            timestamps.size() * sizeof(uint64_t),
+                            timestamps.data(), sizeof(uint64_t),
+                            VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+    return;
+  }
+
+  for (size_t i = 0; i < frame.Scopes.size(); ++i) {
+    uint64_t ticks =
+        (timestamps[i * 2 + 1] - timestamps[i * 2]) & timestamp_mask_;
+    double milliseconds = ticks * timestamp_period_ / 1000000.0;
+
+    ScopeHistory &history = scopes_[frame.Scopes[i]];
+    if (history.Samples.size() < HistorySize) {
+      history.Samples.push_back(milliseconds);
+    } else {
+      history.Samples[history.Next] = milliseconds;
+    }
+    history.Next = (history.Next + 1) % HistorySize;
+  }
+}
+
+uint32_t GpuProfiler::GetScopeId(const char *name) {
+  std::map<std::string, uint32_t>::const_iterator it = scope_ids_.find(name);
+  if (it != scope_ids_.end()) {
+    return it->second;
+  }
+
+  uint32_t id = static_cast<uint32_t>(scopes_.size());
+  ScopeHistory history;
+  history.Name = name;
+  history.Next = 0;
+  scopes_.push_back(history);
+  scope_ids_[name] = id;
+  return id;
+}
@@ -0,0 +1,84 @@
+#ifndef GPU_PROFILER_H_
+#define GPU_PROFILER_H_
+
+#include <vulkan/vulkan.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// ************************************************************ //
+// GpuScopeStatistics                                           //
+//                                                              //
+// GPU time of a named scope over the most recent frames        //
+// ************************************************************ //
+struct GpuScopeStatistics {
+  std::string Name;
+  uint32_t SampleCount;
+  double MinMilliseconds;
+  double AverageMilliseconds;
+  double P99Milliseconds;
+
+  GpuScopeStatistics()
+      : Name(),
+        SampleCount(0),
+        MinMilliseconds(0.0),
+        AverageMilliseconds(0.0),
+        P99Milliseconds(0.0) {}
+};
+
+// ************************************************************ //
+// GpuProfiler                                                  //
+//                                                              //
+// Timestamp queries written around named scopes of a command   //
+// buffer; every frame slot owns its own range of queries which //
+// is read back when the slot is recorded again, so results are //
+// available without waiting for the GPU                        //
+// ************************************************************ //
+class GpuProfiler {
+ public:
+  static const uint32_t MaxScopesPerFrame = 32;
+  static const uint32_t HistorySize = 256;
+
+  GpuProfiler();
+  ~GpuProfiler();
+
+  bool Init(VkPhysicalDevice physical_device, VkDevice device,
+            uint32_t queue_family_index, uint32_t frame_count);
+  void Destroy();
+
+  // Must be recorded outside of a render pass, before any scope of the frame
+  // The fence of the previous submission of this frame slot must be signaled
+  void BeginFrame(VkCommandBuffer command_buffer, uint32_t frame_index);
+  uint32_t BeginScope(VkCommandBuffer command_buffer, const char *name);
+  void EndScope(VkCommandBuffer command_buffer, uint32_t scope);
+
+  bool IsEnabled() const;
+  std::vector<GpuScopeStatistics> GetStatistics() const;
+
+ private:
+  struct FrameQueries {
+    std::vector<uint32_t> Scopes;
+    bool Recorded;
+  };
+
+  struct ScopeHistory {
+    std::string Name;
+    std::vector<double> Samples;
+    uint32_t Next;
+  };
+
+  void CollectResults(uint32_t frame_index);
+  uint32_t GetScopeId(const char *name);
+
+  VkDevice device_;
+  VkQueryPool query_pool_;
+  double timestamp_period_;
+  uint64_t timestamp_mask_;
+  std::vector<FrameQueries> frames_;
+  uint32_t current_frame_;
+  std::vector<ScopeHistory> scopes_;
+  std::map<std::string, uint32_t> scope_ids_;
+};
+
+#endif
@@ -0,0 +1,333 @@
+#include "gpu_timeline.h"
+
+#include <algorithm>
+#include <iostream>
+
+GpuTimeline::GpuTimeline()
+    : device_(VK_NULL_HANDLE),
+      use_timeline_semaphore_(false),
+      queue_semaphores_(),
+      wait_semaphores_(nullptr),
+      get_semaphore_counter_value_(nullptr),
+      pending_submissions_(),
+      free_fences_(),
+      completed_value_(0),
+      last_signaled_value_(0) {}
+
+GpuTimeline::~GpuTimeline() { Destroy(); }
+
+bool GpuTimeline::Init(VkDevice device, bool use_timeline_semaphore) {
+  Destroy();
+  device_ = device;
+  if (!use_timeline_semaphore) {
+    return true;
+  }
+
+  wait_semaphores_ = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(
+      vkGetDeviceProcAddr(device_, "vkWaitSemaphoresKHR"));
+  get_semaphore_counter_value_ =
+      reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(
+          vkGetDeviceProcAddr(device_, "vkGetSemaphoreCounterValueKHR"));
+  if ((wait_semaphores_ == nullptr) ||
+      (get_semaphore_counter_value_ == nullptr)) {
+    std::cout << "Could not load timeline semaphore functions!" << std::endl;
+    return false;
+  }
+
+  // Semaphores are created with the first submission to their queue
+  use_timeline_semaphore_ = true;
+  return true;
+}
+
+void GpuTimeline::Destroy() {
+  if (device_ == VK_NULL_HANDLE) {
+    return;
+  }
+  for (size_t i = 0; i < queue_semaphores_.size(); ++i) {
+    vkDestroySemaphore(device_, queue_semaphores_[i].Semaphore, nullptr);
+  }
+  for (size_t i = 0; i < pending_submissions_.size(); ++i) {
+    if (pending_submissions_[i].Fence != VK_NULL_HANDLE) {
+      vkDestroyFence(device_, pending_submissions_[i].Fence, nullptr);
+    }
+  }
+  for (size_t i = 0; i < free_fences_.size(); ++i) {
+    vkDestroyFence(device_, free_fences_[i], nullptr);
+  }
+  queue_semaphores_.clear();
+  pending_submissions_.clear();
+  free_fences_.clear();
+  use_timeline_semaphore_ = false;
+  wait_semaphores_ = nullptr;
+  get_semaphore_counter_value_ = nullptr;
+  completed_value_ = 0;
+  last_signaled_value_ = 0;
+  device_ = VK_NULL_HANDLE;
+}
+
+bool GpuTimeline::IsTimelineSemaphore() const {
+  return use_timeline_semaphore_;
+}
+
+VkResult GpuTimeline::Submit(VkQueue queue, const VkSubmitInfo &submit_info,
+                             uint64_t wait_value,
+                             VkPipelineStageFlags wait_stage,
+                             uint64_t *signaled_value) {
+  VkResult result =
+      IsTimelineSemaphore()
+          ? SubmitWithSemaphore(queue, submit_info, wait_value, wait_stage)
+          : SubmitWithFence(queue, submit_info, wait_value);
+  if ((result == VK_SUCCESS) && (signaled_value != nullptr)) {
+    *signaled_value = last_signaled_value_;
+  }
+  return result;
+}
+
+VkResult GpuTimeline::SubmitWithSemaphore(VkQueue queue,
+                                          const VkSubmitInfo &submit_info,
+                                          uint64_t wait_value,
+                                          VkPipelineStageFlags wait_stage) {
+  // The timeline is appended to the caller's semaphores; values of binary
+  // semaphores are ignored
+  std::vector<VkSemaphore> wait_semaphores(
+      submit_info.pWaitSemaphores,
+      submit_info.pWaitSemaphores + submit_info.waitSemaphoreCount);
+  std::vector<VkPipelineStageFlags> wait_stages(
+      submit_info.pWaitDstStageMask,
+      submit_info.pWaitDstStageMask + submit_info.waitSemaphoreCount);
+  std::vector<uint64_t> wait_values(submit_info.waitSemaphoreCount, 0);
+  if (wait_value > 0) {
+    std::vector<uint64_t> queue_wait_values = GetQueueWaitValues(wait_value);
+    for (size_t i = 0; i < queue_wait_values.size(); ++i) {
+      if (queue_wait_values[i] > 0) {
+        wait_semaphores.push_back(queue_semaphores_[i].Semaphore);
+        wait_stages.push_back(wait_stage);
+        wait_values.push_back(queue_wait_values[i]);
+      }
+    }
+  }
+
+  size_t queue_index = 0;
+  if (!GetQueueSemaphore(queue, &queue_index)) {
+    return VK_ERROR_INITIALIZATION_FAILED;
+  }
+  std::vector<VkSemaphore> signal_semaphores(
+      submit_info.pSignalSemaphores,
+      submit_info.pSignalSemaphores + submit_info.signalSemaphoreCount);
+  std::vector<uint64_t> signal_values(submit_info.signalSemaphoreCount, 0);
+  signal_semaphores.push_back(queue_semaphores_[queue_index].Semaphore);
+  signal_values.push_back(last_signaled_value_ + 1);
+
+  VkTimelineSemaphoreSubmitInfoKHR timeline_submit_info = {
+      VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,  // VkStructureType sType
+      submit_info.pNext,  // const void                  *pNext
+      static_cast<uint32_t>(
+          wait_values.size()),  // uint32_t waitSemaphoreValueCount
+      wait_values.data(),       // const uint64_t *pWaitSemaphoreValues
+      static_cast<uint32_t>(
+          signal_values.size()),  // uint32_t signalSemaphoreValueCount
+      signal_values.data()        // const uint64_t *pSignalSemaphoreValues
+  };
+
+  VkSubmitInfo timeline_info = submit_info;
+  timeline_info.pNext = &timeline_submit_info;
+  timeline_info.waitSemaphoreCount =
+      static_cast<uint32_t>(wait_semaphores.size());
+  timeline_info.pWaitSemaphores = wait_semaphores.data();
+  timeline_info.pWaitDstStageMask = wait_stages.data();
+  timeline_info.signalSemaphoreCount =
+      static_cast<uint32_t>(signal_semaphores.size());
+  timeline_info.pSignalSemaphores = signal_semaphores.data();
+
+  VkResult result = vkQueueSubmit(queue, 1, &timeline_info, VK_NULL_HANDLE);
+  if (result == VK_SUCCESS) {
+    PendingSubmission pending = {++last_signaled_value_, queue_index,
+                                 VK_NULL_HANDLE};
+    pending_submissions_.push_back(pending);
+  }
+  return result;
+}
+
+VkResult GpuTimeline::SubmitWithFence(VkQueue queue,
+                                      const VkSubmitInfo &submit_info,
+                                      uint64_t wait_value) {
+  // Fences cannot be waited on by a queue
+  if (wait_value > 0) {
+    VkResult result = Wait(wait_value, UINT64_MAX);
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+  }
+
+  VkFence fence = VK_NULL_HANDLE;
+  if (!free_fences_.empty()) {
+    fence = free_fences_.back();
+    free_fences_.pop_back();
+  } else {
+    VkFenceCreateInfo fence_create_info = {
+        VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,  // VkStructureType sType
+        nullptr,  // const void                    *pNext
+        0         // VkFenceCreateFlags             flags
+    };
+    VkResult result =
+        vkCreateFence(device_, &fence_create_info, nullptr, &fence);
+    if (result != VK_SUCCESS) {
+      std::cout << "Could not create a fence!" << std::endl;
+      return result;
+    }
+  }
+
+  VkResult result = vkQueueSubmit(queue, 1, &submit_info, fence);
+  if (result != VK_SUCCESS) {
+    free_fences_.push_back(fence);
+    return result;
+  }
+  PendingSubmission pending = {++last_signaled_value_, 0, fence};
+  pending_submissions_.push_back(pending);
+  return VK_SUCCESS;
+}
+
+bool GpuTimeline::GetQueueSemaphore(VkQueue queue, size_t *index) {
+  for (size_t i = 0; i < queue_semaphores_.size(); ++i) {
+    if (queue_semaphores_[i].Queue == queue) {
+      *index = i;
+      return true;
+    }
+  }
+
+  // Starts at the current value, so that the values of every queue compare
+  // with the values of all others
+  VkSemaphoreTypeCreateInfoKHR semaphore_type_create_info = {
+      VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,  // VkStructureType sType
+      nullptr,                         // const void         *pNext
+      VK_SEMAPHORE_TYPE_TIMELINE_KHR,  // VkSemaphoreType     semaphoreType
+      last_signaled_value_             // uint64_t            initialValue
+  };
+  VkSemaphoreCreateInfo semaphore_create_info = {
+      VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,  // VkStructureType sType
+      &semaphore_type_create_info,  // const void*              pNext
+      0                             // VkSemaphoreCreateFlags   flags
+  };
+  QueueSemaphore queue_semaphore = {queue, VK_NULL_HANDLE};
+  if (vkCreateSemaphore(device_, &semaphore_create_info, nullptr,
+                        &queue_semaphore.Semaphore) != VK_SUCCESS) {
+    std::cout << "Could not create a timeline semaphore!" << std::endl;
+    return false;
+  }
+  queue_semaphores_.push_back(queue_semaphore);
+  *index = queue_semaphores_.size() - 1;
+  return true;
+}
+
+std::vector<uint64_t> GpuTimeline::GetQueueWaitValues(uint64_t value) const {
+  // Each queue signals its own values in order, so its last one up to value
+  // covers all earlier ones
+  std::vector<uint64_t> values(queue_semaphores_.size(), 0);
+  for (size_t i = 0; i < pending_submissions_.size(); ++i) {
+    if (pending_submissions_[i].Value > value) {
+      break;
+    }
+    values[pending_submissions_[i].Queue] = pending_submissions_[i].Value;
+  }
+  return values;
+}
+
+VkResult GpuTimeline::Wait(uint64_t value, uint64_t timeout) {
+  if (value <= completed_value_) {
+    return VK_SUCCESS;
+  }
+
+  // Submissions on different queues may finish out of order, so every queue
+  // is waited for up to the value
+  if (IsTimelineSemaphore()) {
+    std::vector<uint64_t> queue_wait_values = GetQueueWaitValues(value);
+    std::vector<VkSemaphore> semaphores;
+    std::vector<uint64_t> values;
+    for (size_t i = 0; i < queue_wait_values.size(); ++i) {
+      if (queue_wait_values[i] > 0) {
+        semaphores.push_back(queue_semaphores_[i].Semaphore);
+        values.push_back(queue_wait_values[i]);
+      }
+    }
+    if (!semaphores.empty()) {
+      VkSemaphoreWaitInfoKHR wait_info = {
+          VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,  // VkStructureType sType
+          nullptr,  // const void                 *pNext
+          0,        // VkSemaphoreWaitFlags        flags
+          static_cast<uint32_t>(
+              semaphores.size()),  // uint32_t semaphoreCount
+          semaphores.data(),       // const VkSemaphore          *pSemaphores
+          values.data()            // const uint64_t             *pValues
+      };
+      VkResult result = wait_semaphores_(device_, &wait_info, timeout);
+      if (result != VK_SUCCESS) {
+        return result;
+      }
+    }
+  } else {
+    std::vector<VkFence> fences;
+    for (size_t i = 0; i < pending_submissions_.size(); ++i) {
+      if (pending_submissions_[i].Value > value) {
+        break;
+      }
+      fences.push_back(pending_submissions_[i].Fence);
+    }
+    if (!fences.empty()) {
+      VkResult result =
+          vkWaitForFences(device_, static_cast<uint32_t>(fences.size()),
+                          fences.data(), VK_TRUE, timeout);
+      if (result != VK_SUCCESS) {
+        return result;
+      }
+    }
+  }
+  RetireSubmissions(std::min(value, last_signaled_value_));
+  return VK_SUCCESS;
+}
+
+bool GpuTimeline::IsCompleted(uint64_t value) {
+  return (value <= completed_value_) || (value <= GetCompletedValue());
+}
+
+uint64_t GpuTimeline::GetCompletedValue() {
+  std::vector<uint64_t> queue_values(queue_semaphores_.size(), 0);
+  for (size_t i = 0; i < queue_semaphores_.size(); ++i) {
+    if (get_semaphore_counter_value_(device_, queue_semaphores_[i].Semaphore,
+                                     &queue_values[i]) != VK_SUCCESS) {
+      return completed_value_;
+    }
+  }
+
+  // Finished submissions count only when all earlier ones are finished too
+  uint64_t value = completed_value_;
+  for (size_t i = 0; i < pending_submissions_.size(); ++i) {
+    const PendingSubmission &pending = pending_submissions_[i];
+    bool finished =
+        IsTimelineSemaphore()
+            ? (queue_values[pending.Queue] >= pending.Value)
+            : (vkGetFenceStatus(device_, pending.Fence) == VK_SUCCESS);
+    if (!finished) {
+      break;
+    }
+    value = pending.Value;
+  }
+  RetireSubmissions(value);
+  return completed_value_;
+}
+
+uint64_t GpuTimeline::GetLastSignaledValue() const {
+  return last_signaled_value_;
+}
+
+void GpuTimeline::RetireSubmissions(uint64_t value) {
+  while (!pending_submissions_.empty() &&
+         (pending_submissions_.front().Value <= value)) {
+    VkFence fence = pending_submissions_.front().Fence;
+    if (fence != VK_NULL_HANDLE) {
+      vkResetFences(device_, 1, &fence);
+      free_fences_.push_back(fence);
+    }
+    pending_submissions_.pop_front();
+  }
+  completed_value_ = std::max(completed_value_, value);
+}
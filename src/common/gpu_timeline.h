@@ -0,0 +1,80 @@
+#ifndef GPU_TIMELINE_H_
+#define GPU_TIMELINE_H_
+
+#include <vulkan/vulkan.h>
+
+#include <deque>
+#include <vector>
+
+// ************************************************************ //
+// GpuTimeline                                                  //
+//                                                              //
+// Monotonically increasing counter shared by all queues;       //
+// each submission signals the next value and the CPU waits     //
+// for specific values. Backed by one timeline semaphore per    //
+// queue, or by a recycled fence per submission when            //
+// VK_KHR_timeline_semaphore is unavailable                     //
+// A value is reached once it and all values before it have     //
+// been signaled, whichever queues they were submitted to       //
+// Not thread safe, like the queues it submits to               //
+// ************************************************************ //
+class GpuTimeline {
+ public:
+  GpuTimeline();
+  ~GpuTimeline();
+
+  bool Init(VkDevice device, bool use_timeline_semaphore);
+  // All submissions must be finished, i.e. after vkDeviceWaitIdle()
+  void Destroy();
+
+  bool IsTimelineSemaphore() const;
+  // Submits and signals the value returned in signaled_value; a non zero
+  // wait_value makes the submission wait for it and all values before it at
+  // wait_stage (with fences the CPU waits before submitting)
+  VkResult Submit(VkQueue queue, const VkSubmitInfo &submit_info,
+                  uint64_t wait_value, VkPipelineStageFlags wait_stage,
+                  uint64_t *signaled_value);
+  VkResult Wait(uint64_t value, uint64_t timeout);
+  bool IsCompleted(uint64_t value);
+  uint64_t GetCompletedValue();
+  uint64_t GetLastSignaledValue() const;
+
+ private:
+  // Queues may finish their work out of order, which a single timeline
+  // semaphore cannot represent, so every queue signals its own
+  struct QueueSemaphore {
+    VkQueue Queue;
+    VkSemaphore Semaphore;
+  };
+
+  struct PendingSubmission {
+    uint64_t Value;
+    // Index into queue_semaphores_, or the fence of the fence fallback
+    size_t Queue;
+    VkFence Fence;
+  };
+
+  VkResult SubmitWithSemaphore(VkQueue queue, const VkSubmitInfo &submit_info,
+                               uint64_t wait_value,
+                               VkPipelineStageFlags wait_stage);
+  VkResult SubmitWithFence(VkQueue queue, const VkSubmitInfo &submit_info,
+                           uint64_t wait_value);
+  bool GetQueueSemaphore(VkQueue queue, size_t *index);
+  // Per queue semaphore value which is reached once all of the queue's
+  // submissions up to value have finished, 0 when there are none
+  std::vector<uint64_t> GetQueueWaitValues(uint64_t value) const;
+  void RetireSubmissions(uint64_t value);
+
+  VkDevice device_;
+  bool use_timeline_semaphore_;
+  std::vector<QueueSemaphore> queue_semaphores_;
+  PFN_vkWaitSemaphoresKHR wait_semaphores_;
+  PFN_vkGetSemaphoreCounterValueKHR get_semaphore_counter_value_;
+  // Unfinished submissions in signal order, and reset fences of the fallback
+  std::deque<PendingSubmission> pending_submissions_;
+  std::vector<VkFence> free_fences_;
+  uint64_t completed_value_;
+  uint64_t last_signaled_value_;
+};
+
+#endif
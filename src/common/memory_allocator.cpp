@@ -0,0 +1,431 @@
+#include "memory_allocator.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  if (alignment <= 1) {
+    return value;
+  }
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+VkDeviceSize AlignDown(VkDeviceSize value, VkDeviceSize alignment) {
+  if (alignment <= 1) {
+    return value;
+  }
+  return value / alignment * alignment;
+}
+
+}  // namespace
+
+float MemoryAllocatorStatistics::GetUtilization() const {
+  if (BlockBytes == 0) {
+    return 0.0f;
+  }
+  return static_cast<float>(UsedBytes) / static_cast<float>(BlockBytes);
+}
+
+float MemoryAllocatorStatistics::GetFragmentation() const {
+  VkDeviceSize free_bytes = BlockBytes - UsedBytes;
+  if (free_bytes == 0) {
+    return 0.0f;
+  }
+  return 1.0f - static_cast<float>(LargestFreeRange) /
+                    static_cast<float>(free_bytes);
+}
+
+MemoryAllocator::MemoryAllocator()
+    : device_(VK_NULL_HANDLE),
+      memory_properties_(),
+      buffer_image_granularity_(1),
+      non_coherent_atom_size_(1),
+      max_memory_allocation_count_(UINT32_MAX),
+      block_size_(DefaultBlockSize),
+      device_memory_count_(0),
+      blocks_() {}
+
+MemoryAllocator::~MemoryAllocator() { Destroy(); }
+
+bool MemoryAllocator::Init(VkPhysicalDevice physical_device, VkDevice device,
+                           VkDeviceSize block_size) {
+  device_ = device;
+  block_size_ = block_size;
+
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties_);
+
+  VkPhysicalDeviceProperties device_properties;
+  vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+  buffer_image_granularity_ = device_properties.limits.bufferImageGranularity;
+  non_coherent_atom_size_ = device_properties.limits.nonCoherentAtomSize;
+  max_memory_allocation_count_ =
+      device_properties.limits.maxMemoryAllocationCount;
+  return true;
+}
+
+void MemoryAllocator::Destroy() {
+  if (device_ == VK_NULL_HANDLE) {
+    return;
+  }
+
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    if (blocks_[i].Memory == VK_NULL_HANDLE) {
+      continue;
+    }
+    if (blocks_[i].AllocationCount > 0) {
+      std::cout << "Memory block " << i << " still has "
+                << blocks_[i].AllocationCount
+                << " live allocations during destruction!" << std::endl;
+    }
+    DestroyBlock(blocks_[i]);
+  }
+  blocks_.clear();
+  device_ = VK_NULL_HANDLE;
+}
+
+bool MemoryAllocator::FindMemoryType(uint32_t memory_type_bits,
+                                     VkMemoryPropertyFlags flags,
+                                     uint32_t *memory_type_index) const {
+  for (uint32_t i = 0; i < memory_properties_.memoryTypeCount; ++i) {
+    if ((memory_type_bits & (1 << i)) &&
+        ((memory_properties_.memoryTypes[i].propertyFlags & flags) == flags)) {
+      *memory_type_index = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MemoryAllocator::CreateBlock(uint32_t memory_type_index, VkDeviceSize size,
+                                  bool linear, bool dedicated,
+                                  uint32_t *block_index) {
+  if (device_memory_count_ >= max_memory_allocation_count_) {
+    std::cout << "Reached maxMemoryAllocationCount (" << device_memory_count_
+              << ") device memory allocations!" << std::endl;
+    return false;
+  }
+
+  VkMemoryAllocateInfo memory_allocate_info = {
+      VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,  // VkStructureType sType
+      nullptr,           // const void                            *pNext
+      size,              // VkDeviceSize allocationSize
+      memory_type_index  // uint32_t                               memoryTypeIndex
+  };
+
+  MemoryBlock block = {};
+  if (vkAllocateMemory(device_, &memory_allocate_info, nullptr,
+                       &block.Memory) != VK_SUCCESS) {
+    return false;
+  }
+  block.Size = size;
+  block.MemoryTypeIndex = memory_type_index;
+  block.Linear = linear;
+  block.Dedicated = dedicated;
+  block.Mapped = nullptr;
+  block.AllocationCount = 0;
+  block.UsedBytes = 0;
+  block.FreeRanges.push_back({0, size});
+
+  // Host visible blocks stay mapped for their whole lifetime so resources
+  // never have to map and unmap memory on their own
+  if (memory_properties_.memoryTypes[memory_type_index].propertyFlags &
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    if (vkMapMemory(device_, block.Memory, 0, VK_WHOLE_SIZE, 0,
+                    &block.Mapped) != VK_SUCCESS) {
+      std::cout << "Could not map memory block!" << std::endl;
+      vkFreeMemory(device_, block.Memory, nullptr);
+      return false;
+    }
+  }
+  ++device_memory_count_;
+
+  // Reuse slots of released blocks so block indices stay stable
+  for (uint32_t i = 0; i < blocks_.size(); ++i) {
+    if (blocks_[i].Memory == VK_NULL_HANDLE) {
+      blocks_[i] = block;
+      *block_index = i;
+      return true;
+    }
+  }
+  blocks_.push_back(block);
+  *block_index = static_cast<uint32_t>(blocks_.size() - 1);
+  return true;
+}
+
+void MemoryAllocator::DestroyBlock(MemoryBlock &block) {
+  if (block.Mapped != nullptr) {
+    vkUnmapMemory(device_, block.Memory);
+    block.Mapped = nullptr;
+  }
+  vkFreeMemory(device_, block.Memory, nullptr);
+  block.Memory = VK_NULL_HANDLE;
+  block.FreeRanges.clear();
+  block.AllocationCount = 0;
+  block.UsedBytes = 0;
+  --device_memory_count_;
+}
+
+bool MemoryAllocator::AllocateFromBlock(MemoryBlock &block, VkDeviceSize size,
+                                        VkDeviceSize alignment,
+                                        VkDeviceSize *offset) {
+  // Best fit: pick the free range which leaves the smallest remainder
+  size_t best_range = block.FreeRanges.size();
+  VkDeviceSize best_remainder = 0;
+  for (size_t i = 0; i < block.FreeRanges.size(); ++i) {
+    const FreeRange &range = block.FreeRanges[i];
+    VkDeviceSize aligned_offset = AlignUp(range.Offset, alignment);
+    VkDeviceSize padding = aligned_offset - range.Offset;
+    if (padding + size > range.Size) {
+      continue;
+    }
+    VkDeviceSize remainder = range.Size - padding - size;
+    if ((best_range == block.FreeRanges.size()) ||
+        (remainder < best_remainder)) {
+      best_range = i;
+      best_remainder = remainder;
+    }
+  }
+  if (best_range == block.FreeRanges.size()) {
+    return false;
+  }
+
+  FreeRange range = block.FreeRanges[best_range];
+  VkDeviceSize aligned_offset = AlignUp(range.Offset, alignment);
+  VkDeviceSize range_end = range.Offset + range.Size;
+  VkDeviceSize allocation_end = aligned_offset + size;
+
+  block.FreeRanges.erase(block.FreeRanges.begin() + best_range);
+  if (allocation_end < range_end) {
+    block.FreeRanges.insert(block.FreeRanges.begin() + best_range,
+                            {allocation_end, range_end - allocation_end});
+  }
+  if (aligned_offset > range.Offset) {
+    block.FreeRanges.insert(block.FreeRanges.begin() + best_range,
+                            {range.Offset, aligned_offset - range.Offset});
+  }
+
+  ++block.AllocationCount;
+  block.UsedBytes += size;
+  *offset = aligned_offset;
+  return true;
+}
+
+bool MemoryAllocator::Allocate(const VkMemoryRequirements &memory_requirements,
+                               VkMemoryPropertyFlags required_flags,
+                               VkMemoryPropertyFlags preferred_flags,
+                               bool linear, MemoryAllocation *allocation) {
+  uint32_t memory_type_index = UINT32_MAX;
+  if (!FindMemoryType(memory_requirements.memoryTypeBits,
+                      required_flags | preferred_flags, &memory_type_index) &&
+      !FindMemoryType(memory_requirements.memoryTypeBits, required_flags,
+                      &memory_type_index)) {
+    std::cout << "Could not find memory type with required properties!"
+              << std::endl;
+    return false;
+  }
+
+  // Linear and optimal resources are kept in separate blocks so neighbouring
+  // resources can never violate bufferImageGranularity. When the granularity
+  // is 1 there is nothing to respect and all resources share blocks.
+  bool block_linear = (buffer_image_granularity_ > 1) ? linear : false;
+
+  // Never let a single block take more than 1/8 of its heap
+  uint32_t heap_index =
+      memory_properties_.memoryTypes[memory_type_index].heapIndex;
+  VkDeviceSize block_size =
+      std::min(block_size_, memory_properties_.memoryHeaps[heap_index].size / 8);
+
+  uint32_t block_index = UINT32_MAX;
+  VkDeviceSize offset = 0;
+
+  if (memory_requirements.size > block_size / 2) {
+    // Big resources get their own allocation instead of wasting a block
+    if (!CreateBlock(memory_type_index, memory_requirements.size, block_linear,
+                     true, &block_index)) {
+      std::cout << "Could not allocate dedicated device memory!" << std::endl;
+      return false;
+    }
+    AllocateFromBlock(blocks_[block_index], memory_requirements.size, 1,
+                      &offset);
+  } else {
+    for (uint32_t i = 0; i < blocks_.size(); ++i) {
+      MemoryBlock &block = blocks_[i];
+      if ((block.Memory != VK_NULL_HANDLE) && !block.Dedicated &&
+          (block.MemoryTypeIndex == memory_type_index) &&
+          (block.Linear == block_linear) &&
+          AllocateFromBlock(block, memory_requirements.size,
+                            memory_requirements.alignment, &offset)) {
+        block_index = i;
+        break;
+      }
+    }
+
+    if (block_index == UINT32_MAX) {
+      if (!CreateBlock(memory_type_index, block_size, block_linear, false,
+                       &block_index) &&
+          !CreateBlock(memory_type_index, memory_requirements.size,
+                       block_linear, true, &block_index)) {
+        std::cout << "Could not allocate device memory block!" << std::endl;
+        return false;
+      }
+      AllocateFromBlock(blocks_[block_index], memory_requirements.size,
+                        memory_requirements.alignment, &offset);
+    }
+  }
+
+  const MemoryBlock &block = blocks_[block_index];
+  allocation->Memory = block.Memory;
+  allocation->Offset = offset;
+  allocation->Size = memory_requirements.size;
+  allocation->Mapped =
+      (block.Mapped != nullptr) ? static_cast<char *>(block.Mapped) + offset
+                                : nullptr;
+  allocation->MemoryTypeIndex = memory_type_index;
+  allocation->BlockIndex = block_index;
+  return true;
+}
+
+bool MemoryAllocator::AllocateForBuffer(VkBuffer buffer,
+                                        VkMemoryPropertyFlags required_flags,
+                                        VkMemoryPropertyFlags preferred_flags,
+                                        MemoryAllocation *allocation) {
+  VkMemoryRequirements memory_requirements;
+  vkGetBufferMemoryRequirements(device_, buffer, &memory_requirements);
+  return Allocate(memory_requirements, required_flags, preferred_flags, true,
+                  allocation);
+}
+
+bool MemoryAllocator::AllocateForImage(VkImage image,
+                                       VkMemoryPropertyFlags required_flags,
+                                       VkMemoryPropertyFlags preferred_flags,
+                                       MemoryAllocation *allocation) {
+  VkMemoryRequirements memory_requirements;
+  vkGetImageMemoryRequirements(device_, image, &memory_requirements);
+  return Allocate(memory_requirements, required_flags, preferred_flags, false,
+                  allocation);
+}
+
+void MemoryAllocator::Free(MemoryAllocation &allocation) {
+  if ((allocation.Memory == VK_NULL_HANDLE) ||
+      (allocation.BlockIndex >= blocks_.size())) {
+    return;
+  }
+
+  MemoryBlock &block = blocks_[allocation.BlockIndex];
+  if (block.Dedicated) {
+    DestroyBlock(block);
+    allocation = MemoryAllocation();
+    return;
+  }
+
+  // Insert the range back in offset order and merge it with its neighbours
+  std::vector<FreeRange>::iterator next = block.FreeRanges.begin();
+  while ((next != block.FreeRanges.end()) &&
+         (next->Offset < allocation.Offset)) {
+    ++next;
+  }
+  std::vector<FreeRange>::iterator inserted =
+      block.FreeRanges.insert(next, {allocation.Offset, allocation.Size});
+
+  std::vector<FreeRange>::iterator following = inserted + 1;
+  if ((following != block.FreeRanges.end()) &&
+      (inserted->Offset + inserted->Size == following->Offset)) {
+    inserted->Size += following->Size;
+    block.FreeRanges.erase(following);
+  }
+  if (inserted != block.FreeRanges.begin()) {
+    std::vector<FreeRange>::iterator previous = inserted - 1;
+    if (previous->Offset + previous->Size == inserted->Offset) {
+      previous->Size += inserted->Size;
+      block.FreeRanges.erase(inserted);
+    }
+  }
+
+  --block.AllocationCount;
+  block.UsedBytes -= allocation.Size;
+  allocation = MemoryAllocation();
+}
+
+bool MemoryAllocator::IsHostCoherent(const MemoryAllocation &allocation) const {
+  if (allocation.MemoryTypeIndex >= memory_properties_.memoryTypeCount) {
+    return false;
+  }
+  return (memory_properties_.memoryTypes[allocation.MemoryTypeIndex]
+              .propertyFlags &
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+bool MemoryAllocator::Flush(const MemoryAllocation &allocation,
+                            VkDeviceSize offset, VkDeviceSize size) {
+  if ((allocation.Mapped == nullptr) || IsHostCoherent(allocation)) {
+    return true;
+  }
+
+  VkMappedMemoryRange flush_range = GetMappedRange(allocation, offset, size);
+  return vkFlushMappedMemoryRanges(device_, 1, &flush_range) == VK_SUCCESS;
+}
+
+bool MemoryAllocator::Invalidate(const MemoryAllocation &allocation,
+                                 VkDeviceSize offset, VkDeviceSize size) {
+  if ((allocation.Mapped == nullptr) || IsHostCoherent(allocation)) {
+    return true;
+  }
+
+  VkMappedMemoryRange invalidate_range =
+      GetMappedRange(allocation, offset, size);
+  return vkInvalidateMappedMemoryRanges(device_, 1, &invalidate_range) ==
+         VK_SUCCESS;
+}
+
+VkMappedMemoryRange MemoryAllocator::GetMappedRange(
+    const MemoryAllocation &allocation, VkDeviceSize offset,
+    VkDeviceSize size) const {
+  // Ranges must be aligned to nonCoherentAtomSize; rounding may touch
+  // neighbouring allocations, which is harmless
+  const MemoryBlock &block = blocks_[allocation.BlockIndex];
+  VkDeviceSize begin = allocation.Offset + offset;
+  VkDeviceSize end = (size == VK_WHOLE_SIZE)
+                         ? allocation.Offset + allocation.Size
+                         : begin + size;
+  begin = AlignDown(begin, non_coherent_atom_size_);
+  end = std::min(AlignUp(end, non_coherent_atom_size_), block.Size);
+
+  VkMappedMemoryRange range = {
+      VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,  // VkStructureType        sType
+      nullptr,                                // const void            *pNext
+      allocation.Memory,                      // VkDeviceMemory         memory
+      begin,                                  // VkDeviceSize           offset
+      end - begin                             // VkDeviceSize           size
+  };
+  return range;
+}
+
+MemoryAllocatorStatistics MemoryAllocator::GetStatistics() const {
+  MemoryAllocatorStatistics statistics;
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    const MemoryBlock &block = blocks_[i];
+    if (block.Memory == VK_NULL_HANDLE) {
+      continue;
+    }
+    ++statistics.BlockCount;
+    if (block.Dedicated) {
+      ++statistics.DedicatedBlockCount;
+    }
+    statistics.AllocationCount += block.AllocationCount;
+    statistics.BlockBytes += block.Size;
+    statistics.UsedBytes += block.UsedBytes;
+    statistics.FreeRangeCount += static_cast<uint32_t>(block.FreeRanges.size());
+    for (size_t j = 0; j < block.FreeRanges.size(); ++j) {
+      statistics.LargestFreeRange =
+          std::max(statistics.LargestFreeRange, block.FreeRanges[j].Size);
+    }
+  }
+  return statistics;
+}
+
+const VkPhysicalDeviceMemoryProperties &MemoryAllocator::GetMemoryProperties()
+    const {
+  return memory_properties_;
+}
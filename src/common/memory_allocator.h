@@ -0,0 +1,139 @@
+#ifndef MEMORY_ALLOCATOR_H_
+#define MEMORY_ALLOCATOR_H_
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+// ************************************************************ //
+// MemoryAllocation                                             //
+//                                                              //
+// Range of device memory handed out by the MemoryAllocator     //
+// ************************************************************ //
+struct MemoryAllocation {
+  VkDeviceMemory Memory;
+  VkDeviceSize Offset;
+  VkDeviceSize Size;
+  void *Mapped;
+  uint32_t MemoryTypeIndex;
+  uint32_t BlockIndex;
+
+  MemoryAllocation()
+      : Memory(VK_NULL_HANDLE),
+        Offset(0),
+        Size(0),
+        Mapped(nullptr),
+        MemoryTypeIndex(UINT32_MAX),
+        BlockIndex(UINT32_MAX) {}
+};
+
+// ************************************************************ //
+// MemoryAllocatorStatistics                                    //
+//                                                              //
+// Utilization and fragmentation of all live memory blocks      //
+// ************************************************************ //
+struct MemoryAllocatorStatistics {
+  uint32_t BlockCount;
+  uint32_t DedicatedBlockCount;
+  uint32_t AllocationCount;
+  uint32_t FreeRangeCount;
+  VkDeviceSize BlockBytes;
+  VkDeviceSize UsedBytes;
+  VkDeviceSize LargestFreeRange;
+
+  MemoryAllocatorStatistics()
+      : BlockCount(0),
+        DedicatedBlockCount(0),
+        AllocationCount(0),
+        FreeRangeCount(0),
+        BlockBytes(0),
+        UsedBytes(0),
+        LargestFreeRange(0) {}
+
+  // Share of reserved bytes which are handed out to resources
+  float GetUtilization() const;
+  // 0 when all free memory is one contiguous range, close to 1 when free
+  // memory is scattered in many small ranges
+  float GetFragmentation() const;
+};
+
+// ************************************************************ //
+// MemoryAllocator                                              //
+//                                                              //
+// Grabs large memory blocks per memory type and sub-allocates  //
+// buffers and images from them using a best-fit free list      //
+// ************************************************************ //
+class MemoryAllocator {
+ public:
+  static const VkDeviceSize DefaultBlockSize = 64 * 1024 * 1024;
+
+  MemoryAllocator();
+  ~MemoryAllocator();
+
+  bool Init(VkPhysicalDevice physical_device, VkDevice device,
+            VkDeviceSize block_size = DefaultBlockSize);
+  void Destroy();
+
+  bool Allocate(const VkMemoryRequirements &memory_requirements,
+                VkMemoryPropertyFlags required_flags,
+                VkMemoryPropertyFlags preferred_flags, bool linear,
+                MemoryAllocation *allocation);
+  bool AllocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags required_flags,
+                         VkMemoryPropertyFlags preferred_flags,
+                         MemoryAllocation *allocation);
+  bool AllocateForImage(VkImage image, VkMemoryPropertyFlags required_flags,
+                        VkMemoryPropertyFlags preferred_flags,
+                        MemoryAllocation *allocation);
+  void Free(MemoryAllocation &allocation);
+
+  bool Flush(const MemoryAllocation &allocation, VkDeviceSize offset = 0,
+             VkDeviceSize size = VK_WHOLE_SIZE);
+  // Makes GPU writes to non-coherent memory visible to the CPU
+  bool Invalidate(const MemoryAllocation &allocation, VkDeviceSize offset = 0,
+                  VkDeviceSize size = VK_WHOLE_SIZE);
+  bool IsHostCoherent(const MemoryAllocation &allocation) const;
+
+  MemoryAllocatorStatistics GetStatistics() const;
+  const VkPhysicalDeviceMemoryProperties &GetMemoryProperties() const;
+
+ private:
+  struct FreeRange {
+    VkDeviceSize Offset;
+    VkDeviceSize Size;
+  };
+
+  struct MemoryBlock {
+    VkDeviceMemory Memory;
+    VkDeviceSize Size;
+    uint32_t MemoryTypeIndex;
+    bool Linear;
+    bool Dedicated;
+    void *Mapped;
+    uint32_t AllocationCount;
+    VkDeviceSize UsedBytes;
+    // Sorted by offset, adjacent ranges are always merged
+    std::vector<FreeRange> FreeRanges;
+  };
+
+  bool FindMemoryType(uint32_t memory_type_bits, VkMemoryPropertyFlags flags,
+                      uint32_t *memory_type_index) const;
+  VkMappedMemoryRange GetMappedRange(const MemoryAllocation &allocation,
+                                     VkDeviceSize offset,
+                                     VkDeviceSize size) const;
+  bool AllocateFromBlock(MemoryBlock &block, VkDeviceSize size,
+                         VkDeviceSize alignment, VkDeviceSize *offset);
+  bool CreateBlock(uint32_t memory_type_index, VkDeviceSize size, bool linear,
+                   bool dedicated, uint32_t *block_index);
+  void DestroyBlock(MemoryBlock &block);
+
+  VkDevice device_;
+  VkPhysicalDeviceMemoryProperties memory_properties_;
+  VkDeviceSize buffer_image_granularity_;
+  VkDeviceSize non_coherent_atom_size_;
+  uint32_t max_memory_allocation_count_;
+  VkDeviceSize block_size_;
+  uint32_t device_memory_count_;
+  std::vector<MemoryBlock> blocks_;
+};
+
+#endif
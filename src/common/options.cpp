@@ -0,0 +1,158 @@
+#include "options.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+void PrintUsage(const char *program) {
+  std::cout << "Usage: " << program << " [options]" << std::endl
+            << "  --headless          render into offscreen images, no window"
+            << std::endl
+            << "  --headless-surface  render through VK_EXT_headless_surface "
+               "if available"
+            << std::endl
+            << "  --frames <count>    exit after rendering <count> frames"
+            << std::endl
+            << "  --duration <secs>   exit after <secs> seconds" << std::endl
+            << "  --bench-json <file> write frame time percentiles to <file>"
+            << std::endl
+            << "  --bench-csv <file>  write per frame timings to <file>"
+            << std::endl
+            << "  --frames-in-flight <count>  frames recorded ahead of the GPU"
+            << std::endl
+            << "  --fps-cap <fps>     limit the frame rate to <fps>"
+            << std::endl
+            << "  --low-latency       wait for the previous frame before "
+               "starting a new one"
+            << std::endl
+            << "  --threads <count>   record command buffers on <count> threads"
+            << std::endl
+            << "  --draws <count>     split the scene into <count> draws"
+            << std::endl
+            << "  --instanced         render the <count> objects with one "
+               "instanced draw"
+            << std::endl
+            << "  --indirect          issue the <count> objects with one "
+               "indirect draw"
+            << std::endl
+            << "  --cull              cull the <count> objects on the GPU "
+               "before drawing them indirectly"
+            << std::endl
+            << "  --device <id>       use the physical device with this index "
+               "or UUID"
+            << std::endl
+            << "  --present-mode <mode>  immediate, mailbox, fifo or "
+               "fifo-relaxed"
+            << std::endl
+            << "  --swapchain-images <count>  number of swap chain images"
+            << std::endl;
+}
+
+}  // namespace
+
+bool ParseApplicationOptions(int argc, char **argv,
+                             ApplicationOptions *options) {
+  const char *device = getenv("LEARNVULKAN_DEVICE");
+  if (device != nullptr) {
+    options->Device = device;
+  }
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--headless") == 0) {
+      options->Headless = true;
+    } else if (strcmp(argv[i], "--headless-surface") == 0) {
+      options->Headless = true;
+      options->HeadlessSurface = true;
+    } else if ((strcmp(argv[i], "--frames") == 0) && (i + 1 < argc)) {
+      char *end = nullptr;
+      unsigned long frame_count = strtoul(argv[++i], &end, 10);
+      if ((end == argv[i]) || (*end != '\0')) {
+        std::cout << "Invalid frame count \"" << argv[i] << "\"!" << std::endl;
+        return false;
+      }
+      options->FrameCount = static_cast<uint32_t>(frame_count);
+    } else if ((strcmp(argv[i], "--duration") == 0) && (i + 1 < argc)) {
+      char *end = nullptr;
+      double duration = strtod(argv[++i], &end);
+      if ((end == argv[i]) || (*end != '\0') || (duration < 0.0)) {
+        std::cout << "Invalid duration \"" << argv[i] << "\"!" << std::endl;
+        return false;
+      }
+      options->Duration = duration;
+    } else if ((strcmp(argv[i], "--bench-json") == 0) && (i + 1 < argc)) {
+      options->BenchJson = argv[++i];
+    } else if ((strcmp(argv[i], "--bench-csv") == 0) && (i + 1 < argc)) {
+      options->BenchCsv = argv[++i];
+    } else if ((strcmp(argv[i], "--frames-in-flight") == 0) &&
+               (i + 1 < argc)) {
+      char *end = nullptr;
+      unsigned long frames_in_flight = strtoul(argv[++i], &end, 10);
+      if ((end == argv[i]) || (*end != '\0') || (frames_in_flight == 0)) {
+        std::cout << "Invalid number of frames in flight \"" << argv[i]
+                  << "\"!" << std::endl;
+        return false;
+      }
+      options->FramesInFlight = static_cast<uint32_t>(frames_in_flight);
+    } else if ((strcmp(argv[i], "--fps-cap") == 0) && (i + 1 < argc)) {
+      char *end = nullptr;
+      double fps_cap = strtod(argv[++i], &end);
+      if ((end == argv[i]) || (*end != '\0') || (fps_cap < 0.0)) {
+        std::cout << "Invalid FPS cap \"" << argv[i] << "\"!" << std::endl;
+        return false;
+      }
+      options->FpsCap = fps_cap;
+    } else if (strcmp(argv[i], "--low-latency") == 0) {
+      options->LowLatency = true;
+    } else if ((strcmp(argv[i], "--threads") == 0) && (i + 1 < argc)) {
+      char *end = nullptr;
+      unsigned long thread_count = strtoul(argv[++i], &end, 10);
+      if ((end == argv[i]) || (*end != '\0')) {
+        std::cout << "Invalid thread count \"" << argv[i] << "\"!"
+                  << std::endl;
+        return false;
+      }
+      options->RecordingThreads = static_cast<uint32_t>(thread_count);
+    } else if ((strcmp(argv[i], "--draws") == 0) && (i + 1 < argc)) {
+      char *end = nullptr;
+      unsigned long draw_count = strtoul(argv[++i], &end, 10);
+      if ((end == argv[i]) || (*end != '\0') || (draw_count == 0)) {
+        std::cout << "Invalid draw count \"" << argv[i] << "\"!" << std::endl;
+        return false;
+      }
+      options->DrawCount = static_cast<uint32_t>(draw_count);
+    } else if (strcmp(argv[i], "--instanced") == 0) {
+      options->Instanced = true;
+    } else if (strcmp(argv[i], "--indirect") == 0) {
+      options->Indirect = true;
+    } else if (strcmp(argv[i], "--cull") == 0) {
+      options->Cull = true;
+    } else if ((strcmp(argv[i], "--device") == 0) && (i + 1 < argc)) {
+      options->Device = argv[++i];
+    } else if ((strcmp(argv[i], "--present-mode") == 0) && (i + 1 < argc)) {
+      options->PresentMode = argv[++i];
+    } else if ((strcmp(argv[i], "--swapchain-images") == 0) &&
+               (i + 1 < argc)) {
+      char *end = nullptr;
+      unsigned long image_count = strtoul(argv[++i], &end, 10);
+      if ((end == argv[i]) || (*end != '\0')) {
+        std::cout << "Invalid swap chain image count \"" << argv[i] << "\"!"
+                  << std::endl;
+        return false;
+      }
+      options->SwapChainImages = static_cast<uint32_t>(image_count);
+    } else {
+      std::cout << "Unknown option \"" << argv[i] << "\"!" << std::endl;
+      PrintUsage(argv[0]);
+      return false;
+    }
+  }
+
+  // Nobody can close a window which does not exist
+  if (options->Headless && (options->FrameCount == 0) &&
+      (options->Duration == 0.0)) {
+    options->FrameCount = ApplicationOptions::DefaultHeadlessFrameCount;
+  }
+  return true;
+}
@@ -0,0 +1,79 @@
+#ifndef OPTIONS_H_
+#define OPTIONS_H_
+
+#include <stdint.h>
+
+#include <string>
+
+// ************************************************************ //
+// ApplicationOptions                                           //
+//                                                              //
+// Command line options shared by all samples                   //
+// ************************************************************ //
+struct ApplicationOptions {
+  // Render without a window: into offscreen images or, with HeadlessSurface,
+  // into a swap chain of a VK_EXT_headless_surface surface
+  bool Headless;
+  bool HeadlessSurface;
+  // Number of frames to render; 0 renders until the window gets closed
+  uint32_t FrameCount;
+  // Stop after this many seconds; 0 means no time limit
+  double Duration;
+  // Benchmark mode - per frame timings are written to these files
+  std::string BenchJson;
+  std::string BenchCsv;
+  // Number of frames the CPU may record ahead of the GPU
+  uint32_t FramesInFlight;
+  // Upper limit of frames per second; 0 means no limit
+  double FpsCap;
+  // Wait for the previous frame before starting a new one
+  bool LowLatency;
+  // Threads recording secondary command buffers; 0 records on the main thread
+  uint32_t RecordingThreads;
+  // Number of draws samples split their geometry into
+  uint32_t DrawCount;
+  // Draw all DrawCount objects with one instanced draw
+  bool Instanced;
+  // Draw all DrawCount objects with one indirect draw from a GPU buffer
+  bool Indirect;
+  // Cull the DrawCount objects against the view frustum on the GPU before
+  // drawing the survivors indirectly
+  bool Cull;
+  // Index or UUID of the physical device to use; empty picks the best scored
+  // one. Defaults to the LEARNVULKAN_DEVICE environment variable
+  std::string Device;
+  // Present mode: immediate, mailbox, fifo or fifo-relaxed; empty prefers
+  // mailbox
+  std::string PresentMode;
+  // Number of swap chain images; 0 picks one matching the present mode
+  uint32_t SwapChainImages;
+
+  static const uint32_t DefaultHeadlessFrameCount = 100;
+  static const uint32_t DefaultFramesInFlight = 3;
+
+  ApplicationOptions()
+      : Headless(false),
+        HeadlessSurface(false),
+        FrameCount(0),
+        Duration(0.0),
+        BenchJson(),
+        BenchCsv(),
+        FramesInFlight(DefaultFramesInFlight),
+        FpsCap(0.0),
+        LowLatency(false),
+        RecordingThreads(0),
+        DrawCount(1),
+        Instanced(false),
+        Indirect(false),
+        Cull(false),
+        Device(),
+        PresentMode(),
+        SwapChainImages(0) {}
+
+  bool IsBenchmark() const { return !BenchJson.empty() || !BenchCsv.empty(); }
+};
+
+bool ParseApplicationOptions(int argc, char **argv,
+                             ApplicationOptions *options);
+
+#endif
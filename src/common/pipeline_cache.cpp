@@ -0,0 +1,218 @@
+#include "pipeline_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+// "LVPC" - LearnVulkan Pipeline Cache
+const uint32_t FileMagic = 0x4350564c;
+const uint32_t FileVersion = 1;
+
+// Header which every driver places in front of its pipeline cache data
+const size_t DriverHeaderSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+
+}  // namespace
+
+int64_t PipelineCacheStatistics::GetSavedMicroseconds() const {
+  if (!Loaded) {
+    return 0;
+  }
+  return static_cast<int64_t>(ColdCreationMicroseconds) -
+         static_cast<int64_t>(CreationMicroseconds);
+}
+
+PipelineCache::PipelineCache()
+    : device_(VK_NULL_HANDLE),
+      handle_(VK_NULL_HANDLE),
+      device_properties_(),
+      file_name_(),
+      statistics_() {}
+
+PipelineCache::~PipelineCache() { Destroy(); }
+
+bool PipelineCache::Init(VkPhysicalDevice physical_device, VkDevice device,
+                         const std::string &file_name) {
+  if (handle_ != VK_NULL_HANDLE) {
+    return true;
+  }
+
+  device_ = device;
+  file_name_ = file_name;
+  vkGetPhysicalDeviceProperties(physical_device, &device_properties_);
+
+  std::vector<char> data;
+  if (ReadFile(data)) {
+    if (IsCompatible(data)) {
+      statistics_.Loaded = true;
+      statistics_.LoadedBytes = data.size();
+    } else {
+      std::cout << "Pipeline cache \"" << file_name_
+                << "\" was created for a different device or driver, "
+                   "discarding it"
+                << std::endl;
+      data.clear();
+    }
+  }
+
+  VkPipelineCacheCreateInfo pipeline_cache_create_info = {
+      VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,  // VkStructureType sType
+      nullptr,      // const void                  *pNext
+      0,            // VkPipelineCacheCreateFlags   flags
+      data.size(),  // size_t                       initialDataSize
+      data.empty() ? nullptr : data.data()  // const void *pInitialData
+  };
+
+  if (vkCreatePipelineCache(device_, &pipeline_cache_create_info, nullptr,
+                            &handle_) != VK_SUCCESS) {
+    std::cout << "Could not create a pipeline cache!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool PipelineCache::Save() {
+  if (handle_ == VK_NULL_HANDLE) {
+    return true;
+  }
+
+  size_t data_size = 0;
+  if (vkGetPipelineCacheData(device_, handle_, &data_size, nullptr) !=
+      VK_SUCCESS) {
+    std::cout << "Could not get pipeline cache data size!" << std::endl;
+    return false;
+  }
+  std::vector<char> data(data_size);
+  if ((data_size > 0) &&
+      (vkGetPipelineCacheData(device_, handle_, &data_size, data.data()) !=
+       VK_SUCCESS)) {
+    std::cout << "Could not get pipeline cache data!" << std::endl;
+    return false;
+  }
+
+  // A warm run keeps the reference time measured without cached data
+  FileHeader header = {};
+  header.Magic = FileMagic;
+  header.Version = FileVersion;
+  header.ColdCreationMicroseconds = statistics_.Loaded
+                                        ? statistics_.ColdCreationMicroseconds
+                                        : statistics_.CreationMicroseconds;
+  header.DataSize = data_size;
+
+  std::string temporary_file_name = file_name_ + ".tmp";
+  {
+    std::ofstream file(temporary_file_name,
+                       std::ios::binary | std::ios::trunc);
+    if (!file) {
+      std::cout << "Could not open file \"" << temporary_file_name << "\"!"
+                << std::endl;
+      return false;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(data.data(), data_size);
+    if (!file) {
+      std::cout << "Could not write pipeline cache to \""
+                << temporary_file_name << "\"!" << std::endl;
+      std::remove(temporary_file_name.c_str());
+      return false;
+    }
+  }
+
+  // rename() does not replace existing files on every platform
+  if (std::rename(temporary_file_name.c_str(), file_name_.c_str()) != 0) {
+    std::remove(file_name_.c_str());
+    if (std::rename(temporary_file_name.c_str(), file_name_.c_str()) != 0) {
+      std::cout << "Could not replace pipeline cache file \"" << file_name_
+                << "\"!" << std::endl;
+      std::remove(temporary_file_name.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+void PipelineCache::Destroy() {
+  if (handle_ == VK_NULL_HANDLE) {
+    return;
+  }
+  Save();
+  vkDestroyPipelineCache(device_, handle_, nullptr);
+  handle_ = VK_NULL_HANDLE;
+}
+
+VkPipelineCache PipelineCache::GetHandle() const { return handle_; }
+
+void PipelineCache::AddCreationTime(uint64_t microseconds) {
+  ++statistics_.PipelineCount;
+  statistics_.CreationMicroseconds += microseconds;
+}
+
+const PipelineCacheStatistics &PipelineCache::GetStatistics() const {
+  return statistics_;
+}
+
+bool PipelineCache::ReadFile(std::vector<char> &data) {
+  std::ifstream file(file_name_, std::ios::binary);
+  if (!file) {
+    // No cache yet, this is a cold run
+    return false;
+  }
+
+  FileHeader header = {};
+  file.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!file || (header.Magic != FileMagic) ||
+      (header.Version != FileVersion)) {
+    std::cout << "Pipeline cache \"" << file_name_
+              << "\" has an unknown format, discarding it" << std::endl;
+    return false;
+  }
+
+  // The size comes from disk, so check it against what the file really holds
+  // before allocating anything
+  std::streamoff data_offset = file.tellg();
+  file.seekg(0, std::ios::end);
+  std::streamoff file_size = file.tellg();
+  file.seekg(data_offset, std::ios::beg);
+  if (!file || (header.DataSize >
+                static_cast<uint64_t>(file_size - data_offset))) {
+    std::cout << "Pipeline cache \"" << file_name_
+              << "\" is truncated, discarding it" << std::endl;
+    return false;
+  }
+
+  data.resize(static_cast<size_t>(header.DataSize));
+  file.read(data.data(), data.size());
+  if (!file) {
+    std::cout << "Pipeline cache \"" << file_name_
+              << "\" is truncated, discarding it" << std::endl;
+    data.clear();
+    return false;
+  }
+
+  statistics_.ColdCreationMicroseconds = header.ColdCreationMicroseconds;
+  return true;
+}
+
+bool PipelineCache::IsCompatible(const std::vector<char> &data) const {
+  if (data.size() < DriverHeaderSize) {
+    return false;
+  }
+
+  uint32_t header_size = 0;
+  uint32_t header_version = 0;
+  uint32_t vendor_id = 0;
+  uint32_t device_id = 0;
+  memcpy(&header_size, data.data(), sizeof(uint32_t));
+  memcpy(&header_version, data.data() + 4, sizeof(uint32_t));
+  memcpy(&vendor_id, data.data() + 8, sizeof(uint32_t));
+  memcpy(&device_id, data.data() + 12, sizeof(uint32_t));
+
+  return (header_size >= DriverHeaderSize) && (header_size <= data.size()) &&
+         (header_version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE) &&
+         (vendor_id == device_properties_.vendorID) &&
+         (device_id == device_properties_.deviceID) &&
+         (memcmp(data.data() + 16, device_properties_.pipelineCacheUUID,
+                 VK_UUID_SIZE) == 0);
+}
@@ -0,0 +1,72 @@
+#ifndef PIPELINE_CACHE_H_
+#define PIPELINE_CACHE_H_
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+
+// ************************************************************ //
+// PipelineCacheStatistics                                      //
+//                                                              //
+// Time spent creating pipelines in this run compared with the  //
+// run which started without any cached data                    //
+// ************************************************************ //
+struct PipelineCacheStatistics {
+  bool Loaded;
+  size_t LoadedBytes;
+  uint32_t PipelineCount;
+  uint64_t CreationMicroseconds;
+  uint64_t ColdCreationMicroseconds;
+
+  PipelineCacheStatistics()
+      : Loaded(false),
+        LoadedBytes(0),
+        PipelineCount(0),
+        CreationMicroseconds(0),
+        ColdCreationMicroseconds(0) {}
+
+  // Startup time saved thanks to the data loaded from disk
+  int64_t GetSavedMicroseconds() const;
+};
+
+// ************************************************************ //
+// PipelineCache                                                //
+//                                                              //
+// VkPipelineCache backed by a file; data written by another    //
+// driver or device is discarded and the file is replaced       //
+// atomically so an interrupted save never leaves it truncated  //
+// ************************************************************ //
+class PipelineCache {
+ public:
+  PipelineCache();
+  ~PipelineCache();
+
+  bool Init(VkPhysicalDevice physical_device, VkDevice device,
+            const std::string &file_name);
+  bool Save();
+  void Destroy();
+
+  VkPipelineCache GetHandle() const;
+  void AddCreationTime(uint64_t microseconds);
+  const PipelineCacheStatistics &GetStatistics() const;
+
+ private:
+  struct FileHeader {
+    uint32_t Magic;
+    uint32_t Version;
+    uint64_t ColdCreationMicroseconds;
+    uint64_t DataSize;
+  };
+
+  bool ReadFile(std::vector<char> &data);
+  bool IsCompatible(const std::vector<char> &data) const;
+
+  VkDevice device_;
+  VkPipelineCache handle_;
+  VkPhysicalDeviceProperties device_properties_;
+  std::string file_name_;
+  PipelineCacheStatistics statistics_;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <iostream>
+#include <system_error>
+
+ThreadPool::ThreadPool()
+    : threads_(),
+      mutex_(),
+      work_available_(),
+      work_finished_(),
+      job_(nullptr),
+      job_count_(0),
+      next_job_(0),
+      busy_threads_(0),
+      generation_(0),
+      stopping_(false) {}
+
+ThreadPool::~ThreadPool() { Destroy(); }
+
+bool ThreadPool::Init(uint32_t thread_count) {
+  Destroy();
+
+  if (thread_count == 0) {
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  stopping_ = false;
+  try {
+    for (uint32_t i = 0; i < thread_count; ++i) {
+      threads_.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+    }
+  } catch (const std::system_error &error) {
+    std::cout << "Could not start worker threads: " << error.what()
+              << std::endl;
+    Destroy();
+    return false;
+  }
+  return true;
+}
+
+void ThreadPool::Destroy() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i].join();
+  }
+  threads_.clear();
+
+  // Workers of the next Init() start waiting for generation 1 again
+  job_ = nullptr;
+  job_count_ = 0;
+  next_job_ = 0;
+  busy_threads_ = 0;
+  generation_ = 0;
+}
+
+uint32_t ThreadPool::GetThreadCount() const {
+  return static_cast<uint32_t>(threads_.size());
+}
+
+void ThreadPool::Run(uint32_t job_count, const Job &job) {
+  if (threads_.empty()) {
+    for (uint32_t i = 0; i < job_count; ++i) {
+      job(i);
+    }
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  job_ = &job;
+  job_count_ = job_count;
+  next_job_ = 0;
+  busy_threads_ = static_cast<uint32_t>(threads_.size());
+  ++generation_;
+  work_available_.notify_all();
+
+  work_finished_.wait(lock, [this]() { return busy_threads_ == 0; });
+  job_ = nullptr;
+}
+
+void ThreadPool::WorkerLoop() {
+  uint64_t seen_generation = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    work_available_.wait(lock, [this, seen_generation]() {
+      return stopping_ || (generation_ != seen_generation);
+    });
+    if (stopping_) {
+      return;
+    }
+    seen_generation = generation_;
+    if (job_ == nullptr) {
+      // No batch is pending, and busy_threads_ does not count this thread
+      continue;
+    }
+    const Job &job = *job_;
+    uint32_t job_count = job_count_;
+
+    // Jobs are taken one by one, so faster threads pick up more of them
+    lock.unlock();
+    for (uint32_t i = next_job_++; i < job_count; i = next_job_++) {
+      job(i);
+    }
+    lock.lock();
+
+    if (--busy_threads_ == 0) {
+      work_finished_.notify_one();
+    }
+  }
+}
@@ -0,0 +1,50 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ************************************************************ //
+// ThreadPool                                                   //
+//                                                              //
+// Fixed set of worker threads running batches of jobs; the     //
+// caller blocks until the whole batch is finished              //
+// ************************************************************ //
+class ThreadPool {
+ public:
+  typedef std::function<void(uint32_t job_index)> Job;
+
+  ThreadPool();
+  ~ThreadPool();
+
+  // thread_count of 0 uses one thread per hardware core
+  bool Init(uint32_t thread_count);
+  void Destroy();
+
+  uint32_t GetThreadCount() const;
+  // Calls job once for each index in [0, job_count); a job index is never
+  // processed by two threads at the same time
+  void Run(uint32_t job_count, const Job &job);
+
+ private:
+  void WorkerLoop();
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable work_finished_;
+  const Job *job_;
+  uint32_t job_count_;
+  std::atomic<uint32_t> next_job_;
+  uint32_t busy_threads_;
+  uint64_t generation_;
+  bool stopping_;
+};
+
+#endif
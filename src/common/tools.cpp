@@ -17,13 +17,130 @@
 #include "tools.h"
 
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "vector_math.h"
 #define STB_IMAGE_IMPLEMENTATION
+// Failure strings are stored in a global, which races when images are decoded
+// on several threads at once
+#define STBI_NO_FAILURE_STRINGS
 #include "stb_image.h"
 
 namespace Tools {
 
+// ************************************************************ //
+// FileView                                                     //
+//                                                              //
+// Read-only view of a whole file; memory-mapped where the      //
+// platform allows it, read into an owned buffer otherwise      //
+// ************************************************************ //
+FileView::FileView() : Data(nullptr), Size(0), Mapped(false), Buffer() {}
+
+FileView::FileView(FileView &&other)
+    : Data(nullptr), Size(0), Mapped(false), Buffer() {
+  *this = std::move(other);
+}
+
+FileView::~FileView() { Close(); }
+
+FileView &FileView::operator=(FileView &&other) {
+  if (this != &other) {
+    Close();
+    Mapped = other.Mapped;
+    Size = other.Size;
+    Buffer = std::move(other.Buffer);
+    Data = Mapped ? other.Data : Buffer.data();
+    other.Data = nullptr;
+    other.Size = 0;
+    other.Mapped = false;
+  }
+  return *this;
+}
+
+bool FileView::Open(std::string const &filename, bool use_mapping) {
+  Close();
+
+#if !defined(_WIN32)
+  if (use_mapping) {
+    int file = open(filename.c_str(), O_RDONLY);
+    if (file < 0) {
+      std::cout << "Could not open \"" << filename << "\" file!" << std::endl;
+      return false;
+    }
+
+    // Empty files cannot be mapped, they take the buffered path below
+    struct stat file_stat;
+    if ((fstat(file, &file_stat) == 0) && (file_stat.st_size > 0)) {
+      void *address = mmap(nullptr, static_cast<size_t>(file_stat.st_size),
+                           PROT_READ, MAP_PRIVATE, file, 0);
+      if (address != MAP_FAILED) {
+        // The whole file is consumed front to back right after opening
+        madvise(address, static_cast<size_t>(file_stat.st_size),
+                MADV_SEQUENTIAL);
+        madvise(address, static_cast<size_t>(file_stat.st_size),
+                MADV_WILLNEED);
+        Data = static_cast<const char *>(address);
+        Size = static_cast<size_t>(file_stat.st_size);
+        Mapped = true;
+      }
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(file);
+    if (Mapped) {
+      return true;
+    }
+  }
+#else
+  (void)use_mapping;
+#endif
+
+  return ReadBuffered(filename);
+}
+
+void FileView::Close() {
+#if !defined(_WIN32)
+  if (Mapped) {
+    munmap(const_cast<char *>(Data), Size);
+  }
+#endif
+  Data = nullptr;
+  Size = 0;
+  Mapped = false;
+  Buffer.clear();
+  Buffer.shrink_to_fit();
+}
+
+bool FileView::ReadBuffered(std::string const &filename) {
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  if (file.fail()) {
+    std::cout << "Could not open \"" << filename << "\" file!" << std::endl;
+    return false;
+  }
+
+  Buffer.resize(static_cast<size_t>(file.tellg()));
+  file.seekg(0, std::ios::beg);
+  if (!Buffer.empty() &&
+      !file.read(Buffer.data(), static_cast<std::streamsize>(Buffer.size()))) {
+    std::cout << "Could not read \"" << filename << "\" file!" << std::endl;
+    Buffer.clear();
+    return false;
+  }
+
+  // An empty file still gives a valid, empty view
+  static const char empty = '\0';
+  Data = Buffer.empty() ? &empty : Buffer.data();
+  Size = Buffer.size();
+  return true;
+}
+
 // ************************************************************ //
 // GetBinaryFileContents                                        //
 //                                                              //
@@ -50,34 +167,27 @@ std::vector<char> GetBinaryFileContents(std::string const &filename) {
 }
 
 // ************************************************************ //
-// GetImageData                                                 //
+// GetImageInfo                                                 //
 //                                                              //
-// Function loading image (texture) data from a specified file  //
+// Function reading image dimensions and the size of decoded    //
+// data from the file header, without decoding the pixels       //
 // ************************************************************ //
-std::vector<char> GetImageData(std::string const &filename,
-                               int requested_components, int *width,
-                               int *height, int *components, int *data_size) {
-  std::vector<char> file_data = GetBinaryFileContents(filename);
-  if (file_data.size() == 0) {
-    return std::vector<char>();
-  }
-
+bool GetImageInfo(FileView const &file, int requested_components, int *width,
+                  int *height, int *components, int *data_size) {
   int tmp_width = 0, tmp_height = 0, tmp_components = 0;
-  unsigned char *image_data =
-      stbi_load_from_memory(reinterpret_cast<unsigned char *>(&file_data[0]),
-                            static_cast<int>(file_data.size()), &tmp_width,
-                            &tmp_height, &tmp_components, requested_components);
-  if ((image_data == nullptr) || (tmp_width <= 0) || (tmp_height <= 0) ||
-      (tmp_components <= 0)) {
-    std::cout << "Could not read image data!" << std::endl;
-    return std::vector<char>();
+  if (!stbi_info_from_memory(
+          reinterpret_cast<const unsigned char *>(file.GetData()),
+          static_cast<int>(file.GetSize()), &tmp_width, &tmp_height,
+          &tmp_components) ||
+      (tmp_width <= 0) || (tmp_height <= 0) || (tmp_components <= 0)) {
+    std::cout << "Could not read image info!" << std::endl;
+    return false;
   }
 
-  int size =
-      (tmp_width) * (tmp_height) *
-      (requested_components <= 0 ? tmp_components : requested_components);
   if (data_size) {
-    *data_size = size;
+    *data_size =
+        (tmp_width) * (tmp_height) *
+        (requested_components <= 0 ? tmp_components : requested_components);
   }
   if (width) {
     *width = tmp_width;
@@ -88,11 +198,73 @@ std::vector<char> GetImageData(std::string const &filename,
   if (components) {
     *components = tmp_components;
   }
+  return true;
+}
 
-  std::vector<char> output(size);
-  memcpy(&output[0], image_data, size);
+// ************************************************************ //
+// LoadImageData                                                //
+//                                                              //
+// Function decoding an image into caller provided memory, i.e. //
+// a mapped staging buffer region of GetImageInfo()'s data_size //
+// ************************************************************ //
+bool LoadImageData(FileView const &file, int requested_components,
+                   void *destination, size_t destination_size) {
+  // stb always decodes into its own allocation; copying out of it directly
+  // into the destination is the only copy of the pixels
+  int tmp_width = 0, tmp_height = 0, tmp_components = 0;
+  unsigned char *image_data = stbi_load_from_memory(
+      reinterpret_cast<const unsigned char *>(file.GetData()),
+      static_cast<int>(file.GetSize()), &tmp_width, &tmp_height,
+      &tmp_components, requested_components);
+  if ((image_data == nullptr) || (tmp_width <= 0) || (tmp_height <= 0) ||
+      (tmp_components <= 0)) {
+    std::cout << "Could not read image data!" << std::endl;
+    stbi_image_free(image_data);
+    return false;
+  }
+
+  size_t size =
+      static_cast<size_t>(tmp_width) * tmp_height *
+      (requested_components <= 0 ? tmp_components : requested_components);
+  if (size > destination_size) {
+    std::cout << "Decoded image does not fit into the destination!"
+              << std::endl;
+    stbi_image_free(image_data);
+    return false;
+  }
 
+  std::memcpy(destination, image_data, size);
   stbi_image_free(image_data);
+  return true;
+}
+
+// ************************************************************ //
+// GetImageData                                                 //
+//                                                              //
+// Function loading image (texture) data from a specified file  //
+// ************************************************************ //
+std::vector<char> GetImageData(std::string const &filename,
+                               int requested_components, int *width,
+                               int *height, int *components, int *data_size) {
+  FileView file;
+  if (!file.Open(filename) || (file.GetSize() == 0)) {
+    return std::vector<char>();
+  }
+
+  int size = 0;
+  if (!GetImageInfo(file, requested_components, width, height, components,
+                    &size)) {
+    return std::vector<char>();
+  }
+
+  std::vector<char> output(size);
+  if (!LoadImageData(file, requested_components, output.data(),
+                     output.size())) {
+    return std::vector<char>();
+  }
+  if (data_size) {
+    *data_size = size;
+  }
   return output;
 }
 
@@ -105,28 +277,8 @@ std::array<float, 16> GetPerspectiveProjectionMatrix(float const aspect_ratio,
                                                      float const field_of_view,
                                                      float const near_clip,
                                                      float const far_clip) {
-  float f = 1.0f / std::tan(field_of_view * 0.5f *
-                            0.01745329251994329576923690768489f);
-
-  return {f / aspect_ratio,
-          0.0f,
-          0.0f,
-          0.0f,
-
-          0.0f,
-          -f,
-          0.0f,
-          0.0f,
-
-          0.0f,
-          0.0f,
-          far_clip / (near_clip - far_clip),
-          -1.0f,
-
-          0.0f,
-          0.0f,
-          (near_clip * far_clip) / (near_clip - far_clip),
-          0.0f};
+  return Math::Perspective(aspect_ratio, field_of_view, near_clip, far_clip)
+      .ToArray();
 }
 
 // ************************************************************ //
@@ -137,24 +289,40 @@ std::array<float, 16> GetPerspectiveProjectionMatrix(float const aspect_ratio,
 std::array<float, 16> GetOrthographicProjectionMatrix(
     float const left_plane, float const right_plane, float const top_plane,
     float const bottom_plane, float const near_plane, float const far_plane) {
-  return {2.0f / (right_plane - left_plane),
-          0.0f,
-          0.0f,
-          0.0f,
-
-          0.0f,
-          2.0f / (bottom_plane - top_plane),
-          0.0f,
-          0.0f,
-
-          0.0f,
-          0.0f,
-          1.0f / (near_plane - far_plane),
-          0.0f,
-
-          -(right_plane + left_plane) / (right_plane - left_plane),
-          -(bottom_plane + top_plane) / (bottom_plane - top_plane),
-          near_plane / (near_plane - far_plane),
-          1.0f};
+  return Math::Orthographic(left_plane, right_plane, top_plane, bottom_plane,
+                            near_plane, far_plane)
+      .ToArray();
+}
+
+// ************************************************************ //
+// GetFrustumPlanes                                             //
+//                                                              //
+// Function extracting the six planes of the view frustum from  //
+// a projection matrix                                          //
+// ************************************************************ //
+std::array<float, 24> GetFrustumPlanes(
+    std::array<float, 16> const& projection_matrix) {
+  // Rows of the column-major matrix; a point is inside when its clip space
+  // coordinates satisfy -w <= x, y <= w and 0 <= z <= w
+  Math::Mat4 matrix = Math::Transpose(Math::Mat4::FromArray(projection_matrix));
+  Math::Vec4 row_x(matrix.m[0], matrix.m[1], matrix.m[2], matrix.m[3]);
+  Math::Vec4 row_y(matrix.m[4], matrix.m[5], matrix.m[6], matrix.m[7]);
+  Math::Vec4 row_z(matrix.m[8], matrix.m[9], matrix.m[10], matrix.m[11]);
+  Math::Vec4 row_w(matrix.m[12], matrix.m[13], matrix.m[14], matrix.m[15]);
+
+  Math::Vec4 planes[] = {row_w + row_x, row_w - row_x, row_w + row_y,
+                         row_w - row_y, row_z,         row_w - row_z};
+
+  std::array<float, 24> result;
+  for (size_t i = 0; i < 6; ++i) {
+    float length =
+        std::sqrt(planes[i].x * planes[i].x + planes[i].y * planes[i].y +
+                  planes[i].z * planes[i].z);
+    result[4 * i + 0] = planes[i].x / length;
+    result[4 * i + 1] = planes[i].y / length;
+    result[4 * i + 2] = planes[i].z / length;
+    result[4 * i + 3] = planes[i].w / length;
+  }
+  return result;
 }
 }  // namespace Tools
\ No newline at end of file
@@ -20,9 +20,12 @@
 #include <vulkan/vulkan.h>
 
 #include <array>
+#include <cstddef>
 #include <string>
 #include <vector>
 
+#include "common/deletion_queue.h"
+
 namespace Tools {
 
 // ************************************************************ //
@@ -30,22 +33,36 @@ namespace Tools {
 //                                                              //
 // Auto-deleter helper template class responsible for calling   //
 // provided function which deletes given object of type T       //
+// In deferred mode the object goes to a deletion queue instead //
+// and is deleted once the GPU reached its last use             //
 // ************************************************************ //
 template <class T, class F>
 class AutoDeleter {
  public:
   AutoDeleter()
-      : Object(VK_NULL_HANDLE), Deleter(nullptr), Device(VK_NULL_HANDLE) {}
+      : Object(VK_NULL_HANDLE),
+        Deleter(nullptr),
+        Device(VK_NULL_HANDLE),
+        Queue(nullptr),
+        TimelineValue(0) {}
 
   AutoDeleter(T object, F deleter, VkDevice device)
-      : Object(object), Deleter(deleter), Device(device) {}
+      : Object(object),
+        Deleter(deleter),
+        Device(device),
+        Queue(nullptr),
+        TimelineValue(0) {}
 
   AutoDeleter(AutoDeleter&& other) { *this = std::move(other); }
 
   ~AutoDeleter() {
     if ((Object != VK_NULL_HANDLE) && (Deleter != nullptr) &&
         (Device != VK_NULL_HANDLE)) {
-      Deleter(Device, Object, nullptr);
+      if (Queue != nullptr) {
+        Queue->Enqueue(TimelineValue, Device, Object, Deleter);
+      } else {
+        Deleter(Device, Object, nullptr);
+      }
     }
   }
 
@@ -54,6 +71,8 @@ class AutoDeleter {
       Object = other.Object;
       Deleter = other.Deleter;
       Device = other.Device;
+      Queue = other.Queue;
+      TimelineValue = other.TimelineValue;
       other.Object = VK_NULL_HANDLE;
     }
     return *this;
@@ -61,6 +80,13 @@ class AutoDeleter {
 
   T Get() { return Object; }
 
+  // Switches to deferred mode; call again whenever the object gets used by a
+  // later submission
+  void Defer(DeletionQueue* queue, uint64_t timeline_value) {
+    Queue = queue;
+    TimelineValue = timeline_value;
+  }
+
   bool operator!() const { return Object == VK_NULL_HANDLE; }
 
  private:
@@ -69,6 +95,42 @@ class AutoDeleter {
   T Object;
   F Deleter;
   VkDevice Device;
+  DeletionQueue* Queue;
+  uint64_t TimelineValue;
+};
+
+// ************************************************************ //
+// FileView                                                     //
+//                                                              //
+// Read-only view of a whole file; memory-mapped where the      //
+// platform allows it, read into an owned buffer otherwise      //
+// ************************************************************ //
+class FileView {
+ public:
+  FileView();
+  FileView(FileView&& other);
+  ~FileView();
+
+  FileView& operator=(FileView&& other);
+
+  // use_mapping = false forces the buffered fallback
+  bool Open(std::string const& filename, bool use_mapping = true);
+  void Close();
+
+  const char* GetData() const { return Data; }
+  size_t GetSize() const { return Size; }
+  bool IsMapped() const { return Mapped; }
+  bool operator!() const { return Data == nullptr; }
+
+ private:
+  FileView(const FileView&);
+  FileView& operator=(const FileView&);
+  bool ReadBuffered(std::string const& filename);
+
+  const char* Data;
+  size_t Size;
+  bool Mapped;
+  std::vector<char> Buffer;
 };
 
 // ************************************************************ //
@@ -78,6 +140,24 @@ class AutoDeleter {
 // ************************************************************ //
 std::vector<char> GetBinaryFileContents(std::string const& filename);
 
+// ************************************************************ //
+// GetImageInfo                                                 //
+//                                                              //
+// Function reading image dimensions and the size of decoded    //
+// data from the file header, without decoding the pixels       //
+// ************************************************************ //
+bool GetImageInfo(FileView const& file, int requested_components, int* width,
+                  int* height, int* components, int* data_size);
+
+// ************************************************************ //
+// LoadImageData                                                //
+//                                                              //
+// Function decoding an image into caller provided memory, i.e. //
+// a mapped staging buffer region of GetImageInfo()'s data_size //
+// ************************************************************ //
+bool LoadImageData(FileView const& file, int requested_components,
+                   void* destination, size_t destination_size);
+
 // ************************************************************ //
 // GetImageData                                                 //
 //                                                              //
@@ -105,6 +185,16 @@ std::array<float, 16> GetPerspectiveProjectionMatrix(float const aspect_ratio,
 std::array<float, 16> GetOrthographicProjectionMatrix(
     float const left_plane, float const right_plane, float const top_plane,
     float const bottom_plane, float const near_plane, float const far_plane);
+
+// ************************************************************ //
+// GetFrustumPlanes                                             //
+//                                                              //
+// Function extracting the six planes of the view frustum from  //
+// a projection matrix: left, right, top, bottom, near and far, //
+// each as a normalized inward normal (xyz) and distance (w)    //
+// ************************************************************ //
+std::array<float, 24> GetFrustumPlanes(
+    std::array<float, 16> const& projection_matrix);
 }  // namespace Tools
 
 #endif  // TOOLS_HEADER
\ No newline at end of file
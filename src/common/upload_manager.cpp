@@ -0,0 +1,416 @@
+#include "upload_manager.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// Keeps staging offsets usable for buffer to image copies as well
+const VkDeviceSize StagingAlignment = 16;
+
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+double UploadStatistics::GetBandwidth() const {
+  if (Seconds <= 0.0) {
+    return 0.0;
+  }
+  return static_cast<double>(Bytes) / (1024.0 * 1024.0) / Seconds;
+}
+
+UploadManager::UploadManager()
+    : device_(VK_NULL_HANDLE),
+      memory_allocator_(nullptr),
+      queue_(VK_NULL_HANDLE),
+      command_pool_(VK_NULL_HANDLE),
+      staging_buffer_(VK_NULL_HANDLE),
+      staging_memory_(),
+      staging_size_(0),
+      head_(0),
+      used_(0),
+      pending_destination_(VK_NULL_HANDLE),
+      pending_destination_offset_(0),
+      pending_staging_offset_(0),
+      pending_size_(0),
+      pending_consumed_(0),
+      batches_(),
+      current_batch_(0),
+      oldest_batch_(0),
+      statistics_() {}
+
+UploadManager::~UploadManager() { Destroy(); }
+
+bool UploadManager::Init(VkDevice device, MemoryAllocator *memory_allocator,
+                         VkQueue queue, uint32_t queue_family_index,
+                         VkDeviceSize staging_size) {
+  device_ = device;
+  memory_allocator_ = memory_allocator;
+  queue_ = queue;
+  staging_size_ = staging_size;
+
+  VkBufferCreateInfo buffer_create_info = {
+      VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // VkStructureType        sType
+      nullptr,                               // const void            *pNext
+      0,                                     // VkBufferCreateFlags    flags
+      staging_size_,                         // VkDeviceSize           size
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,      // VkBufferUsageFlags     usage
+      VK_SHARING_MODE_EXCLUSIVE,  // VkSharingMode          sharingMode
+      0,       // uint32_t               queueFamilyIndexCount
+      nullptr  // const uint32_t        *pQueueFamilyIndices
+  };
+
+  if (vkCreateBuffer(device_, &buffer_create_info, nullptr,
+                     &staging_buffer_) != VK_SUCCESS) {
+    std::cout << "Could not create a staging buffer!" << std::endl;
+    return false;
+  }
+
+  // Coherent memory spares us a flush after every staging write
+  if (!memory_allocator_->AllocateForBuffer(
+          staging_buffer_, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging_memory_)) {
+    std::cout << "Could not allocate memory for a staging buffer!"
+              << std::endl;
+    return false;
+  }
+
+  if (vkBindBufferMemory(device_, staging_buffer_, staging_memory_.Memory,
+                         staging_memory_.Offset) != VK_SUCCESS) {
+    std::cout << "Could not bind memory for a staging buffer!" << std::endl;
+    return false;
+  }
+
+  VkCommandPoolCreateInfo command_pool_create_info = {
+      VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,  // VkStructureType sType
+      nullptr,  // const void                  *pNext
+      VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |
+          VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,  // VkCommandPoolCreateFlags
+                                                 // flags
+      queue_family_index  // uint32_t                     queueFamilyIndex
+  };
+
+  if (vkCreateCommandPool(device_, &command_pool_create_info, nullptr,
+                          &command_pool_) != VK_SUCCESS) {
+    std::cout << "Could not create a command pool for uploads!" << std::endl;
+    return false;
+  }
+
+  std::vector<VkCommandBuffer> command_buffers(BatchCount);
+  VkCommandBufferAllocateInfo command_buffer_allocate_info = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,  // VkStructureType sType
+      nullptr,                          // const void            *pNext
+      command_pool_,                    // VkCommandPool          commandPool
+      VK_COMMAND_BUFFER_LEVEL_PRIMARY,  // VkCommandBufferLevel   level
+      BatchCount  // uint32_t               bufferCount
+  };
+
+  if (vkAllocateCommandBuffers(device_, &command_buffer_allocate_info,
+                               command_buffers.data()) != VK_SUCCESS) {
+    std::cout << "Could not allocate command buffers for uploads!"
+              << std::endl;
+    return false;
+  }
+
+  batches_.resize(BatchCount);
+  for (uint32_t i = 0; i < BatchCount; ++i) {
+    Batch &batch = batches_[i];
+    batch.CommandBuffer = command_buffers[i];
+    batch.Fence = VK_NULL_HANDLE;
+    batch.Recording = false;
+    batch.Submitted = false;
+    batch.StagingBytes = 0;
+    batch.UploadedBytes = 0;
+    batch.Copies = 0;
+
+    VkFenceCreateInfo fence_create_info = {
+        VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,  // VkStructureType        sType
+        nullptr,                              // const void            *pNext
+        0                                     // VkFenceCreateFlags     flags
+    };
+
+    if (vkCreateFence(device_, &fence_create_info, nullptr, &batch.Fence) !=
+        VK_SUCCESS) {
+      std::cout << "Could not create a fence for uploads!" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+void UploadManager::Destroy() {
+  if (device_ == VK_NULL_HANDLE) {
+    return;
+  }
+
+  Flush();
+  WaitIdle();
+
+  for (size_t i = 0; i < batches_.size(); ++i) {
+    if (batches_[i].Fence != VK_NULL_HANDLE) {
+      vkDestroyFence(device_, batches_[i].Fence, nullptr);
+    }
+  }
+  batches_.clear();
+
+  if (command_pool_ != VK_NULL_HANDLE) {
+    vkDestroyCommandPool(device_, command_pool_, nullptr);
+    command_pool_ = VK_NULL_HANDLE;
+  }
+  if (staging_buffer_ != VK_NULL_HANDLE) {
+    vkDestroyBuffer(device_, staging_buffer_, nullptr);
+    staging_buffer_ = VK_NULL_HANDLE;
+  }
+  if (staging_memory_.Memory != VK_NULL_HANDLE) {
+    memory_allocator_->Free(staging_memory_);
+  }
+  device_ = VK_NULL_HANDLE;
+}
+
+bool UploadManager::UploadToBuffer(VkBuffer destination,
+                                   VkDeviceSize destination_offset,
+                                   const void *data, VkDeviceSize size) {
+  const char *source = static_cast<const char *>(data);
+
+  // Data larger than the ring buffer is split into several copies
+  while (size > 0) {
+    VkDeviceSize chunk_size = std::min(size, staging_size_);
+
+    void *staging =
+        BeginBufferUpload(destination, destination_offset, chunk_size);
+    if (staging == nullptr) {
+      return false;
+    }
+    memcpy(staging, source, static_cast<size_t>(chunk_size));
+    if (!EndBufferUpload()) {
+      return false;
+    }
+
+    source += chunk_size;
+    destination_offset += chunk_size;
+    size -= chunk_size;
+  }
+  return true;
+}
+
+void *UploadManager::BeginBufferUpload(VkBuffer destination,
+                                       VkDeviceSize destination_offset,
+                                       VkDeviceSize size) {
+  if (pending_destination_ != VK_NULL_HANDLE) {
+    std::cout << "Previous upload was not finished!" << std::endl;
+    return nullptr;
+  }
+  if ((size == 0) || (size > staging_size_)) {
+    std::cout << "Upload of " << size
+              << " bytes does not fit into the staging buffer!" << std::endl;
+    return nullptr;
+  }
+
+  VkDeviceSize staging_offset = 0;
+  VkDeviceSize consumed = 0;
+  if (!Reserve(size, StagingAlignment, &staging_offset, &consumed)) {
+    return nullptr;
+  }
+  if (!batches_[current_batch_].Recording && !BeginBatch()) {
+    return nullptr;
+  }
+
+  pending_destination_ = destination;
+  pending_destination_offset_ = destination_offset;
+  pending_staging_offset_ = staging_offset;
+  pending_size_ = size;
+  pending_consumed_ = consumed;
+  return static_cast<char *>(staging_memory_.Mapped) + staging_offset;
+}
+
+bool UploadManager::EndBufferUpload() {
+  if (pending_destination_ == VK_NULL_HANDLE) {
+    std::cout << "No upload was started!" << std::endl;
+    return false;
+  }
+  VkBuffer destination = pending_destination_;
+  pending_destination_ = VK_NULL_HANDLE;
+
+  if (!memory_allocator_->Flush(staging_memory_, pending_staging_offset_,
+                                pending_size_)) {
+    std::cout << "Could not flush staging buffer memory!" << std::endl;
+    return false;
+  }
+
+  Batch &batch = batches_[current_batch_];
+  VkBufferCopy buffer_copy = {
+      pending_staging_offset_,      // VkDeviceSize           srcOffset
+      pending_destination_offset_,  // VkDeviceSize           dstOffset
+      pending_size_                 // VkDeviceSize           size
+  };
+  vkCmdCopyBuffer(batch.CommandBuffer, staging_buffer_, destination, 1,
+                  &buffer_copy);
+
+  batch.StagingBytes += pending_consumed_;
+  batch.UploadedBytes += pending_size_;
+  ++batch.Copies;
+  return true;
+}
+
+VkDeviceSize UploadManager::GetStagingSize() const { return staging_size_; }
+
+bool UploadManager::Flush() {
+  Batch &batch = batches_[current_batch_];
+  if (!batch.Recording) {
+    return true;
+  }
+  batch.Recording = false;
+
+  if (vkEndCommandBuffer(batch.CommandBuffer) != VK_SUCCESS) {
+    std::cout << "Could not record upload command buffer!" << std::endl;
+    return false;
+  }
+
+  VkSubmitInfo submit_info = {
+      VK_STRUCTURE_TYPE_SUBMIT_INFO,  // VkStructureType              sType
+      nullptr,                        // const void                  *pNext
+      0,        // uint32_t                     waitSemaphoreCount
+      nullptr,  // const VkSemaphore           *pWaitSemaphores
+      nullptr,  // const VkPipelineStageFlags  *pWaitDstStageMask;
+      1,        // uint32_t                     commandBufferCount
+      &batch.CommandBuffer,  // const VkCommandBuffer       *pCommandBuffers
+      0,       // uint32_t                     signalSemaphoreCount
+      nullptr  // const VkSemaphore           *pSignalSemaphores
+  };
+
+  if (vkQueueSubmit(queue_, 1, &submit_info, batch.Fence) != VK_SUCCESS) {
+    std::cout << "Could not submit upload command buffer!" << std::endl;
+    return false;
+  }
+  batch.Submitted = true;
+  current_batch_ = (current_batch_ + 1) % BatchCount;
+  return true;
+}
+
+bool UploadManager::WaitIdle() {
+  if (!Flush()) {
+    return false;
+  }
+  while (batches_[oldest_batch_].Submitted) {
+    if (!Reclaim(true)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const UploadStatistics &UploadManager::GetStatistics() const {
+  return statistics_;
+}
+
+bool UploadManager::Reserve(VkDeviceSize size, VkDeviceSize alignment,
+                            VkDeviceSize *offset, VkDeviceSize *consumed) {
+  Reclaim(false);
+
+  for (;;) {
+    VkDeviceSize aligned_head = AlignUp(head_, alignment);
+    VkDeviceSize required = aligned_head + size - head_;
+    if (aligned_head + size > staging_size_) {
+      // Skip the tail of the ring and start again from its beginning
+      aligned_head = 0;
+      required = staging_size_ - head_ + size;
+    }
+
+    if (used_ + required <= staging_size_) {
+      *offset = aligned_head;
+      *consumed = required;
+      head_ = aligned_head + size;
+      used_ += required;
+      return true;
+    }
+
+    // The ring is full: submit pending copies and wait for the oldest ones
+    if (!Flush()) {
+      return false;
+    }
+    if (!batches_[oldest_batch_].Submitted) {
+      std::cout << "Staging buffer is too small for the requested upload!"
+                << std::endl;
+      return false;
+    }
+    if (!Reclaim(true)) {
+      return false;
+    }
+  }
+}
+
+bool UploadManager::BeginBatch() {
+  Batch &batch = batches_[current_batch_];
+
+  // All batches are in flight, the one to reuse is the oldest
+  while (batch.Submitted) {
+    if (!Reclaim(true)) {
+      return false;
+    }
+  }
+
+  if (vkResetFences(device_, 1, &batch.Fence) != VK_SUCCESS) {
+    std::cout << "Could not reset upload fence!" << std::endl;
+    return false;
+  }
+
+  VkCommandBufferBeginInfo command_buffer_begin_info = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,  // VkStructureType sType
+      nullptr,  // const void                            *pNext
+      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,  // VkCommandBufferUsageFlags
+                                                    // flags
+      nullptr  // const VkCommandBufferInheritanceInfo  *pInheritanceInfo
+  };
+
+  if (vkBeginCommandBuffer(batch.CommandBuffer, &command_buffer_begin_info) !=
+      VK_SUCCESS) {
+    std::cout << "Could not begin upload command buffer!" << std::endl;
+    return false;
+  }
+
+  batch.Recording = true;
+  batch.StagingBytes = 0;
+  batch.UploadedBytes = 0;
+  batch.Copies = 0;
+  batch.StartTime = std::chrono::steady_clock::now();
+  return true;
+}
+
+bool UploadManager::Reclaim(bool wait_for_oldest) {
+  while (batches_[oldest_batch_].Submitted) {
+    Batch &batch = batches_[oldest_batch_];
+    if (wait_for_oldest) {
+      if (vkWaitForFences(device_, 1, &batch.Fence, VK_FALSE, UINT64_MAX) !=
+          VK_SUCCESS) {
+        std::cout << "Waiting for upload fence failed!" << std::endl;
+        return false;
+      }
+      wait_for_oldest = false;
+    } else if (vkGetFenceStatus(device_, batch.Fence) != VK_SUCCESS) {
+      break;
+    }
+    CompleteBatch(batch);
+    oldest_batch_ = (oldest_batch_ + 1) % BatchCount;
+  }
+  return true;
+}
+
+void UploadManager::CompleteBatch(Batch &batch) {
+  std::chrono::duration<double> duration =
+      std::chrono::steady_clock::now() - batch.StartTime;
+
+  batch.Submitted = false;
+  used_ -= batch.StagingBytes;
+  if (used_ == 0) {
+    // Nothing in flight, so the next upload may start from the beginning
+    head_ = 0;
+  }
+
+  statistics_.Bytes += batch.UploadedBytes;
+  statistics_.Copies += batch.Copies;
+  ++statistics_.Batches;
+  statistics_.Seconds += duration.count();
+}
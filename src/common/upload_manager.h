@@ -0,0 +1,109 @@
+#ifndef UPLOAD_MANAGER_H_
+#define UPLOAD_MANAGER_H_
+
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <vector>
+
+#include "common/memory_allocator.h"
+
+// ************************************************************ //
+// UploadStatistics                                             //
+//                                                              //
+// Amount of data uploaded through the staging buffer and the   //
+// time it took from the first staging write until the GPU      //
+// finished copying it                                          //
+// ************************************************************ //
+struct UploadStatistics {
+  uint64_t Bytes;
+  uint32_t Copies;
+  uint32_t Batches;
+  double Seconds;
+
+  UploadStatistics() : Bytes(0), Copies(0), Batches(0), Seconds(0.0) {}
+
+  // Upload bandwidth in MiB per second
+  double GetBandwidth() const;
+};
+
+// ************************************************************ //
+// UploadManager                                                //
+//                                                              //
+// Fills device local resources through a persistently mapped   //
+// ring buffer; copies are batched into one command buffer per  //
+// submission on the transfer queue                             //
+// When the transfer family differs from the graphics family,   //
+// destination buffers must be shared concurrently or have      //
+// their ownership transferred after the upload, see            //
+// VulkanCommon::TransferBufferOwnership(); WaitIdle() must be  //
+// called before they are read                                  //
+// ************************************************************ //
+class UploadManager {
+ public:
+  static const VkDeviceSize DefaultStagingSize = 8 * 1024 * 1024;
+  static const uint32_t BatchCount = 4;
+
+  UploadManager();
+  ~UploadManager();
+
+  bool Init(VkDevice device, MemoryAllocator *memory_allocator,
+            VkQueue queue, uint32_t queue_family_index,
+            VkDeviceSize staging_size = DefaultStagingSize);
+  void Destroy();
+
+  bool UploadToBuffer(VkBuffer destination, VkDeviceSize destination_offset,
+                      const void *data, VkDeviceSize size);
+  // Two step upload for data produced in place (i.e. decoded images):
+  // BeginBufferUpload() returns staging memory for size bytes, which must be
+  // completely written before EndBufferUpload() records the copy; no other
+  // upload may happen in between, and size cannot exceed the staging size
+  void *BeginBufferUpload(VkBuffer destination,
+                          VkDeviceSize destination_offset, VkDeviceSize size);
+  bool EndBufferUpload();
+  VkDeviceSize GetStagingSize() const;
+  bool Flush();
+  bool WaitIdle();
+
+  const UploadStatistics &GetStatistics() const;
+
+ private:
+  struct Batch {
+    VkCommandBuffer CommandBuffer;
+    VkFence Fence;
+    bool Recording;
+    bool Submitted;
+    VkDeviceSize StagingBytes;
+    VkDeviceSize UploadedBytes;
+    uint32_t Copies;
+    std::chrono::steady_clock::time_point StartTime;
+  };
+
+  bool Reserve(VkDeviceSize size, VkDeviceSize alignment,
+               VkDeviceSize *offset, VkDeviceSize *consumed);
+  bool BeginBatch();
+  bool Reclaim(bool wait_for_oldest);
+  void CompleteBatch(Batch &batch);
+
+  VkDevice device_;
+  MemoryAllocator *memory_allocator_;
+  VkQueue queue_;
+  VkCommandPool command_pool_;
+  VkBuffer staging_buffer_;
+  MemoryAllocation staging_memory_;
+  VkDeviceSize staging_size_;
+  VkDeviceSize head_;
+  VkDeviceSize used_;
+  // Upload started with BeginBufferUpload()
+  VkBuffer pending_destination_;
+  VkDeviceSize pending_destination_offset_;
+  VkDeviceSize pending_staging_offset_;
+  VkDeviceSize pending_size_;
+  VkDeviceSize pending_consumed_;
+  std::vector<Batch> batches_;
+  uint32_t current_batch_;
+  uint32_t oldest_batch_;
+  UploadStatistics statistics_;
+};
+
+#endif
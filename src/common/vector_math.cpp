@@ -0,0 +1,408 @@
+#include "vector_math.h"
+
+#include <cmath>
+
+#if defined(LEARNVULKAN_MATH_AVX2)
+#include <immintrin.h>
+#elif defined(LEARNVULKAN_MATH_SSE)
+#include <emmintrin.h>
+#elif defined(LEARNVULKAN_MATH_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace Math {
+
+namespace {
+
+const float DegreesToRadians = 0.01745329251994329576923690768489f;
+
+#if defined(LEARNVULKAN_MATH_SSE)
+// Column-major, so a matrix-vector product is a sum of scaled columns
+inline __m128 TransformColumns(const __m128 columns[4], __m128 v) {
+  __m128 x = _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0));
+  __m128 y = _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1));
+  __m128 z = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2));
+  __m128 w = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+  return _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(columns[0], x), _mm_mul_ps(columns[1], y)),
+      _mm_add_ps(_mm_mul_ps(columns[2], z), _mm_mul_ps(columns[3], w)));
+}
+
+inline void LoadColumns(const Mat4 &m, __m128 columns[4]) {
+  for (int i = 0; i < 4; ++i) {
+    columns[i] = _mm_load_ps(&m.m[i * 4]);
+  }
+}
+#elif defined(LEARNVULKAN_MATH_NEON)
+inline float32x4_t TransformColumns(const float32x4_t columns[4],
+                                    float32x4_t v) {
+  float32x4_t result = vmulq_lane_f32(columns[0], vget_low_f32(v), 0);
+  result = vmlaq_lane_f32(result, columns[1], vget_low_f32(v), 1);
+  result = vmlaq_lane_f32(result, columns[2], vget_high_f32(v), 0);
+  result = vmlaq_lane_f32(result, columns[3], vget_high_f32(v), 1);
+  return result;
+}
+
+inline void LoadColumns(const Mat4 &m, float32x4_t columns[4]) {
+  for (int i = 0; i < 4; ++i) {
+    columns[i] = vld1q_f32(&m.m[i * 4]);
+  }
+}
+#endif
+
+#if defined(LEARNVULKAN_MATH_AVX2)
+// Two vectors per register, each 128 bit lane against the same columns
+inline __m256 TransformColumns2(const __m256 columns[4], __m256 v) {
+  __m256 result = _mm256_mul_ps(columns[0], _mm256_permute_ps(v, 0x00));
+  result = _mm256_fmadd_ps(columns[1], _mm256_permute_ps(v, 0x55), result);
+  result = _mm256_fmadd_ps(columns[2], _mm256_permute_ps(v, 0xAA), result);
+  result = _mm256_fmadd_ps(columns[3], _mm256_permute_ps(v, 0xFF), result);
+  return result;
+}
+
+inline void LoadColumns2(const Mat4 &m, __m256 columns[4]) {
+  for (int i = 0; i < 4; ++i) {
+    columns[i] = _mm256_broadcast_ps(
+        reinterpret_cast<const __m128 *>(&m.m[i * 4]));
+  }
+}
+#endif
+
+// Writes straight into the destination, so batches skip temporaries
+inline void MultiplyInto(const Mat4 &a, const Mat4 &b, Mat4 *out) {
+#if defined(LEARNVULKAN_MATH_SSE)
+  __m128 columns[4];
+  LoadColumns(a, columns);
+  for (int i = 0; i < 4; ++i) {
+    _mm_store_ps(&out->m[i * 4],
+                 TransformColumns(columns, _mm_load_ps(&b.m[i * 4])));
+  }
+#elif defined(LEARNVULKAN_MATH_NEON)
+  float32x4_t columns[4];
+  LoadColumns(a, columns);
+  for (int i = 0; i < 4; ++i) {
+    vst1q_f32(&out->m[i * 4],
+              TransformColumns(columns, vld1q_f32(&b.m[i * 4])));
+  }
+#else
+  *out = Scalar::Multiply(a, b);
+#endif
+}
+
+}  // namespace
+
+// ************************************************************ //
+// Vec4                                                         //
+// ************************************************************ //
+Vec4 operator+(const Vec4 &a, const Vec4 &b) {
+  return Vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
+}
+
+Vec4 operator-(const Vec4 &a, const Vec4 &b) {
+  return Vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
+}
+
+Vec4 operator*(const Vec4 &a, float s) {
+  return Vec4(a.x * s, a.y * s, a.z * s, a.w * s);
+}
+
+float Dot(const Vec4 &a, const Vec4 &b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+Vec4 Cross(const Vec4 &a, const Vec4 &b) {
+  return Vec4(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+              a.x * b.y - a.y * b.x, 0.0f);
+}
+
+Vec4 Normalize(const Vec4 &v) {
+  float length = std::sqrt(Dot(v, v));
+  return (length > 0.0f) ? v * (1.0f / length) : v;
+}
+
+// ************************************************************ //
+// Mat4                                                         //
+// ************************************************************ //
+Mat4::Mat4()
+    : m{1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f} {}
+
+Mat4 Mat4::FromArray(const std::array<float, 16> &values) {
+  Mat4 result;
+  for (int i = 0; i < 16; ++i) {
+    result.m[i] = values[i];
+  }
+  return result;
+}
+
+std::array<float, 16> Mat4::ToArray() const {
+  std::array<float, 16> result;
+  for (int i = 0; i < 16; ++i) {
+    result[i] = m[i];
+  }
+  return result;
+}
+
+Mat4 operator*(const Mat4 &a, const Mat4 &b) {
+  Mat4 result;
+  MultiplyInto(a, b, &result);
+  return result;
+}
+
+Vec4 operator*(const Mat4 &m, const Vec4 &v) {
+#if defined(LEARNVULKAN_MATH_SSE)
+  __m128 columns[4];
+  LoadColumns(m, columns);
+  Vec4 result;
+  _mm_store_ps(&result.x, TransformColumns(columns, _mm_load_ps(&v.x)));
+  return result;
+#elif defined(LEARNVULKAN_MATH_NEON)
+  float32x4_t columns[4];
+  LoadColumns(m, columns);
+  Vec4 result;
+  vst1q_f32(&result.x, TransformColumns(columns, vld1q_f32(&v.x)));
+  return result;
+#else
+  return Scalar::Transform(m, v);
+#endif
+}
+
+Mat4 Transpose(const Mat4 &m) {
+  Mat4 result;
+  for (int column = 0; column < 4; ++column) {
+    for (int row = 0; row < 4; ++row) {
+      result.m[column * 4 + row] = m.m[row * 4 + column];
+    }
+  }
+  return result;
+}
+
+Mat4 Translation(float x, float y, float z) {
+  Mat4 result;
+  result.m[12] = x;
+  result.m[13] = y;
+  result.m[14] = z;
+  return result;
+}
+
+Mat4 Scaling(float x, float y, float z) {
+  Mat4 result;
+  result.m[0] = x;
+  result.m[5] = y;
+  result.m[10] = z;
+  return result;
+}
+
+Mat4 Perspective(float aspect_ratio, float field_of_view, float near_clip,
+                 float far_clip) {
+  float f = 1.0f / std::tan(field_of_view * 0.5f * DegreesToRadians);
+
+  return Mat4::FromArray({f / aspect_ratio,
+                          0.0f,
+                          0.0f,
+                          0.0f,
+
+                          0.0f,
+                          -f,
+                          0.0f,
+                          0.0f,
+
+                          0.0f,
+                          0.0f,
+                          far_clip / (near_clip - far_clip),
+                          -1.0f,
+
+                          0.0f,
+                          0.0f,
+                          (near_clip * far_clip) / (near_clip - far_clip),
+                          0.0f});
+}
+
+Mat4 Orthographic(float left_plane, float right_plane, float top_plane,
+                  float bottom_plane, float near_plane, float far_plane) {
+  return Mat4::FromArray(
+      {2.0f / (right_plane - left_plane),
+       0.0f,
+       0.0f,
+       0.0f,
+
+       0.0f,
+       2.0f / (bottom_plane - top_plane),
+       0.0f,
+       0.0f,
+
+       0.0f,
+       0.0f,
+       1.0f / (near_plane - far_plane),
+       0.0f,
+
+       -(right_plane + left_plane) / (right_plane - left_plane),
+       -(bottom_plane + top_plane) / (bottom_plane - top_plane),
+       near_plane / (near_plane - far_plane),
+       1.0f});
+}
+
+// ************************************************************ //
+// Quat                                                         //
+// ************************************************************ //
+Quat Quat::FromAxisAngle(const Vec4 &axis, float angle) {
+  Vec4 normalized = Normalize(Vec4(axis.x, axis.y, axis.z, 0.0f));
+  float half_angle = angle * 0.5f * DegreesToRadians;
+  float s = std::sin(half_angle);
+  return Quat(normalized.x * s, normalized.y * s, normalized.z * s,
+              std::cos(half_angle));
+}
+
+Quat operator*(const Quat &a, const Quat &b) {
+  return Quat(a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+              a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+              a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+              a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z);
+}
+
+Quat Normalize(const Quat &q) {
+  float length = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+  if (length <= 0.0f) {
+    return Quat();
+  }
+  float inverse = 1.0f / length;
+  return Quat(q.x * inverse, q.y * inverse, q.z * inverse, q.w * inverse);
+}
+
+Mat4 ToMatrix(const Quat &q) {
+  float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+  float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+  float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+  return Mat4::FromArray({1.0f - 2.0f * (yy + zz),
+                          2.0f * (xy + wz),
+                          2.0f * (xz - wy),
+                          0.0f,
+
+                          2.0f * (xy - wz),
+                          1.0f - 2.0f * (xx + zz),
+                          2.0f * (yz + wx),
+                          0.0f,
+
+                          2.0f * (xz + wy),
+                          2.0f * (yz - wx),
+                          1.0f - 2.0f * (xx + yy),
+                          0.0f,
+
+                          0.0f,
+                          0.0f,
+                          0.0f,
+                          1.0f});
+}
+
+Vec4 Rotate(const Quat &q, const Vec4 &v) {
+  Quat result = q * Quat(v.x, v.y, v.z, 0.0f) * Quat(-q.x, -q.y, -q.z, q.w);
+  return Vec4(result.x, result.y, result.z, v.w);
+}
+
+// ************************************************************ //
+// Batched operations                                           //
+// ************************************************************ //
+void MultiplyArray(const Mat4 *a, const Mat4 *b, Mat4 *out, size_t count) {
+#if defined(LEARNVULKAN_MATH_AVX2)
+  for (size_t i = 0; i < count; ++i) {
+    __m256 columns[4];
+    LoadColumns2(a[i], columns);
+    // Columns 0-1 and 2-3 of b in one register each; matrices are only 16
+    // byte aligned, so the loads and stores are unaligned
+    _mm256_storeu_ps(&out[i].m[0],
+                     TransformColumns2(columns, _mm256_loadu_ps(&b[i].m[0])));
+    _mm256_storeu_ps(&out[i].m[8],
+                     TransformColumns2(columns, _mm256_loadu_ps(&b[i].m[8])));
+  }
+#elif defined(LEARNVULKAN_MATH_SSE) || defined(LEARNVULKAN_MATH_NEON)
+  for (size_t i = 0; i < count; ++i) {
+    MultiplyInto(a[i], b[i], &out[i]);
+  }
+#else
+  Scalar::MultiplyArray(a, b, out, count);
+#endif
+}
+
+void TransformArray(const Mat4 &m, const Vec4 *in, Vec4 *out, size_t count) {
+#if defined(LEARNVULKAN_MATH_AVX2)
+  __m256 columns[4];
+  LoadColumns2(m, columns);
+  size_t i = 0;
+  for (; i + 2 <= count; i += 2) {
+    _mm256_storeu_ps(&out[i].x,
+                     TransformColumns2(columns, _mm256_loadu_ps(&in[i].x)));
+  }
+  for (; i < count; ++i) {
+    out[i] = m * in[i];
+  }
+#elif defined(LEARNVULKAN_MATH_SSE)
+  __m128 columns[4];
+  LoadColumns(m, columns);
+  for (size_t i = 0; i < count; ++i) {
+    _mm_store_ps(&out[i].x, TransformColumns(columns, _mm_load_ps(&in[i].x)));
+  }
+#elif defined(LEARNVULKAN_MATH_NEON)
+  float32x4_t columns[4];
+  LoadColumns(m, columns);
+  for (size_t i = 0; i < count; ++i) {
+    vst1q_f32(&out[i].x, TransformColumns(columns, vld1q_f32(&in[i].x)));
+  }
+#else
+  Scalar::TransformArray(m, in, out, count);
+#endif
+}
+
+const char *GetInstructionSet() {
+#if defined(LEARNVULKAN_MATH_AVX2)
+  return "AVX2";
+#elif defined(LEARNVULKAN_MATH_SSE)
+  return "SSE2";
+#elif defined(LEARNVULKAN_MATH_NEON)
+  return "NEON";
+#else
+  return "scalar";
+#endif
+}
+
+// ************************************************************ //
+// Scalar                                                       //
+// ************************************************************ //
+namespace Scalar {
+
+Mat4 Multiply(const Mat4 &a, const Mat4 &b) {
+  Mat4 result;
+  for (int column = 0; column < 4; ++column) {
+    for (int row = 0; row < 4; ++row) {
+      float sum = 0.0f;
+      for (int k = 0; k < 4; ++k) {
+        sum += a.m[k * 4 + row] * b.m[column * 4 + k];
+      }
+      result.m[column * 4 + row] = sum;
+    }
+  }
+  return result;
+}
+
+Vec4 Transform(const Mat4 &m, const Vec4 &v) {
+  return Vec4(m.m[0] * v.x + m.m[4] * v.y + m.m[8] * v.z + m.m[12] * v.w,
+              m.m[1] * v.x + m.m[5] * v.y + m.m[9] * v.z + m.m[13] * v.w,
+              m.m[2] * v.x + m.m[6] * v.y + m.m[10] * v.z + m.m[14] * v.w,
+              m.m[3] * v.x + m.m[7] * v.y + m.m[11] * v.z + m.m[15] * v.w);
+}
+
+void MultiplyArray(const Mat4 *a, const Mat4 *b, Mat4 *out, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = Multiply(a[i], b[i]);
+  }
+}
+
+void TransformArray(const Mat4 &m, const Vec4 *in, Vec4 *out, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = Transform(m, in[i]);
+  }
+}
+
+}  // namespace Scalar
+
+}  // namespace Math
@@ -0,0 +1,106 @@
+#ifndef VECTOR_MATH_H_
+#define VECTOR_MATH_H_
+
+#include <stddef.h>
+
+#include <array>
+
+// The instruction set is picked at compile time from the target flags;
+// LEARNVULKAN_MATH_SCALAR forces the portable implementation
+#if !defined(LEARNVULKAN_MATH_SCALAR)
+#if defined(__AVX2__) && defined(__FMA__)
+#define LEARNVULKAN_MATH_AVX2
+#define LEARNVULKAN_MATH_SSE
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define LEARNVULKAN_MATH_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LEARNVULKAN_MATH_NEON
+#endif
+#endif
+
+namespace Math {
+
+// ************************************************************ //
+// Vec4                                                         //
+//                                                              //
+// Four component vector, aligned for SIMD loads                //
+// ************************************************************ //
+struct alignas(16) Vec4 {
+  float x, y, z, w;
+
+  Vec4() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) {}
+  Vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+};
+
+Vec4 operator+(const Vec4 &a, const Vec4 &b);
+Vec4 operator-(const Vec4 &a, const Vec4 &b);
+Vec4 operator*(const Vec4 &a, float s);
+float Dot(const Vec4 &a, const Vec4 &b);
+// Cross product of the xyz parts, w is 0
+Vec4 Cross(const Vec4 &a, const Vec4 &b);
+Vec4 Normalize(const Vec4 &v);
+
+// ************************************************************ //
+// Mat4                                                         //
+//                                                              //
+// 4x4 matrix in column-major order, the layout used by the     //
+// projection helpers and by shaders                            //
+// ************************************************************ //
+struct alignas(16) Mat4 {
+  float m[16];
+
+  Mat4();  // identity
+
+  static Mat4 FromArray(const std::array<float, 16> &values);
+  std::array<float, 16> ToArray() const;
+};
+
+Mat4 operator*(const Mat4 &a, const Mat4 &b);
+Vec4 operator*(const Mat4 &m, const Vec4 &v);
+Mat4 Transpose(const Mat4 &m);
+Mat4 Translation(float x, float y, float z);
+Mat4 Scaling(float x, float y, float z);
+Mat4 Perspective(float aspect_ratio, float field_of_view, float near_clip,
+                 float far_clip);
+Mat4 Orthographic(float left_plane, float right_plane, float top_plane,
+                  float bottom_plane, float near_plane, float far_plane);
+
+// ************************************************************ //
+// Quat                                                         //
+//                                                              //
+// Rotation quaternion, w is the scalar part                    //
+// ************************************************************ //
+struct alignas(16) Quat {
+  float x, y, z, w;
+
+  Quat() : x(0.0f), y(0.0f), z(0.0f), w(1.0f) {}
+  Quat(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+
+  // angle in degrees, like the field of view of Perspective()
+  static Quat FromAxisAngle(const Vec4 &axis, float angle);
+};
+
+Quat operator*(const Quat &a, const Quat &b);
+Quat Normalize(const Quat &q);
+Mat4 ToMatrix(const Quat &q);
+Vec4 Rotate(const Quat &q, const Vec4 &v);
+
+// Batched versions for per-object transform work; out may not alias inputs
+void MultiplyArray(const Mat4 *a, const Mat4 *b, Mat4 *out, size_t count);
+void TransformArray(const Mat4 &m, const Vec4 *in, Vec4 *out, size_t count);
+
+// Name of the instruction set the functions above were compiled for
+const char *GetInstructionSet();
+
+// Portable implementations, available regardless of the instruction set
+namespace Scalar {
+Mat4 Multiply(const Mat4 &a, const Mat4 &b);
+Vec4 Transform(const Mat4 &m, const Vec4 &v);
+void MultiplyArray(const Mat4 *a, const Mat4 *b, Mat4 *out, size_t count);
+void TransformArray(const Mat4 &m, const Vec4 *in, Vec4 *out, size_t count);
+}  // namespace Scalar
+
+}  // namespace Math
+
+#endif
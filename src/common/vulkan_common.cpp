@@ -4,18 +4,124 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
+
+namespace {
+
+const char *GetPhysicalDeviceTypeName(VkPhysicalDeviceType type) {
+  switch (type) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      return "discrete GPU";
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      return "integrated GPU";
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+      return "virtual GPU";
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      return "CPU";
+    default:
+      return "other";
+  }
+}
+
+// Size of the largest device local heap; integrated GPUs report the part of
+// system memory they may use
+VkDeviceSize GetDeviceLocalMemorySize(VkPhysicalDevice physical_device) {
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+  VkDeviceSize size = 0;
+  for (uint32_t i = 0; i < memory_properties.memoryHeapCount; ++i) {
+    if (memory_properties.memoryHeaps[i].flags &
+        VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+      size = std::max(size, memory_properties.memoryHeaps[i].size);
+    }
+  }
+  return size;
+}
+
+const char *GetPresentModeName(VkPresentModeKHR present_mode) {
+  switch (present_mode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+      return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+      return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+      return "fifo-relaxed";
+    default:
+      return "default";
+  }
+}
 
-VulkanCommon::VulkanCommon() {}
+// Preference is either a device index or its UUID, with or without dashes
+bool MatchesDevicePreference(const std::string &preference, uint32_t index,
+                             const std::string &uuid) {
+  if (preference.find_first_not_of("0123456789") == std::string::npos) {
+    return strtoul(preference.c_str(), nullptr, 10) == index;
+  }
+
+  std::string normalized_preference;
+  std::string normalized_uuid;
+  for (size_t i = 0; i < preference.size(); ++i) {
+    if (preference[i] != '-') {
+      normalized_preference += static_cast<char>(tolower(preference[i]));
+    }
+  }
+  for (size_t i = 0; i < uuid.size(); ++i) {
+    if (uuid[i] != '-') {
+      normalized_uuid += uuid[i];
+    }
+  }
+  return !normalized_uuid.empty() && (normalized_preference == normalized_uuid);
+}
+
+}  // namespace
+
+VulkanCommon::VulkanCommon()
+    : can_render_(false),
+      headless_(false),
+      use_headless_surface_(false),
+      default_extent_({640, 480}),
+      device_preference_(),
+      get_physical_device_properties2_(nullptr),
+      enabled_features_(),
+      draw_indirect_count_(nullptr),
+      requested_present_mode_(VK_PRESENT_MODE_MAX_ENUM_KHR),
+      requested_swap_chain_images_(0),
+      offscreen_image_index_(0),
+      offscreen_memory_(),
+      frame_contexts_(),
+      thread_pool_(),
+      next_frame_context_(0),
+      last_frame_value_(0),
+      fps_cap_(0.0),
+      low_latency_(false),
+      next_frame_time_(),
+      frame_input_time_(),
+      image_input_times_(),
+      latency_statistics_(),
+      retired_swap_chains_() {}
 
 VulkanCommon::~VulkanCommon() {
   if (vulkan_.Device != VK_NULL_HANDLE) {
     vkDeviceWaitIdle(vulkan_.Device);
 
+    DestroyFrameContexts();
+    RetireSwapChains(0);
+    deletion_queue_.Flush();
+    framebuffer_cache_.Clear();
+
     for (size_t i = 0; i < vulkan_.SwapChain.Images.size(); ++i) {
       if (vulkan_.SwapChain.Images[i].View != VK_NULL_HANDLE) {
         vkDestroyImageView(GetDevice(), vulkan_.SwapChain.Images[i].View,
@@ -23,9 +129,23 @@ VulkanCommon::~VulkanCommon() {
       }
     }
 
+    // Offscreen images are owned by us, unlike swap chain images
+    for (size_t i = 0; i < offscreen_memory_.size(); ++i) {
+      if (vulkan_.SwapChain.Images[i].Handle != VK_NULL_HANDLE) {
+        vkDestroyImage(GetDevice(), vulkan_.SwapChain.Images[i].Handle,
+                       nullptr);
+      }
+      memory_allocator_.Free(offscreen_memory_[i]);
+    }
+
     if (vulkan_.SwapChain.Handle != VK_NULL_HANDLE) {
       vkDestroySwapchainKHR(vulkan_.Device, vulkan_.SwapChain.Handle, nullptr);
     }
+    gpu_profiler_.Destroy();
+    pipeline_cache_.Destroy();
+    upload_manager_.Destroy();
+    memory_allocator_.Destroy();
+    timeline_.Destroy();
     vkDestroyDevice(vulkan_.Device, nullptr);
   }
 
@@ -58,6 +178,28 @@ std::vector<const char *> VulkanCommon::GetRequiredExtensions() {
   return extensions;
 }
 
+std::vector<const char *> VulkanCommon::GetHeadlessExtensions(
+    const std::vector<VkExtensionProperties> &available_extensions) {
+  std::vector<const char *> extensions;
+  if (!use_headless_surface_) {
+    return extensions;
+  }
+
+  if (CheckExtensionAvailability(VK_KHR_SURFACE_EXTENSION_NAME,
+                                 available_extensions) &&
+      CheckExtensionAvailability(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME,
+                                 available_extensions)) {
+    extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+    extensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+  } else {
+    std::cout << VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME
+              << " is not available, rendering into offscreen images"
+              << std::endl;
+    use_headless_surface_ = false;
+  }
+  return extensions;
+}
+
 bool VulkanCommon::CreateInstance() {
   uint32_t extensions_count = 0;
   if ((vkEnumerateInstanceExtensionProperties(nullptr, &extensions_count,
@@ -77,7 +219,9 @@ bool VulkanCommon::CreateInstance() {
     return false;
   }
 
-  std::vector<const char *> extensions = GetRequiredExtensions();
+  std::vector<const char *> extensions =
+      headless_ ? GetHeadlessExtensions(available_extensions)
+                : GetRequiredExtensions();
 
   for (std::size_t i = 0; i < extensions.size(); ++i) {
     if (!CheckExtensionAvailability(extensions[i], available_extensions)) {
@@ -87,6 +231,32 @@ bool VulkanCommon::CreateInstance() {
     }
   }
 
+  // Optional - provides UUIDs which identify physical devices across runs.
+  // On a Vulkan 1.0 instance the ID properties are defined by the external
+  // memory, semaphore and fence capabilities extensions, any one will do
+  const char *id_extensions[] = {
+      VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME,
+      VK_KHR_EXTERNAL_SEMAPHORE_CAPABILITIES_EXTENSION_NAME,
+      VK_KHR_EXTERNAL_FENCE_CAPABILITIES_EXTENSION_NAME};
+  const char *id_extension = nullptr;
+  for (std::size_t i = 0; i < sizeof(id_extensions) / sizeof(id_extensions[0]);
+       ++i) {
+    if (CheckExtensionAvailability(id_extensions[i], available_extensions)) {
+      id_extension = id_extensions[i];
+      break;
+    }
+  }
+  bool properties2_enabled =
+      (id_extension != nullptr) &&
+      CheckExtensionAvailability(
+          VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+          available_extensions);
+  if (properties2_enabled) {
+    extensions.push_back(
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    extensions.push_back(id_extension);
+  }
+
   VkApplicationInfo application_info = {};
   application_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
   application_info.pApplicationName = "LearnVulkan";
@@ -106,13 +276,22 @@ bool VulkanCommon::CreateInstance() {
     std::cout << "Could not create Vulkan instance!" << std::endl;
     return false;
   }
+
+  if (properties2_enabled) {
+    get_physical_device_properties2_ =
+        reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(
+            vkGetInstanceProcAddr(vulkan_.Instance,
+                                  "vkGetPhysicalDeviceProperties2KHR"));
+  }
   return true;
 }
 
 bool VulkanCommon::CheckPhysicalDeviceProperties(
     VkPhysicalDevice physical_device,
     uint32_t &selected_graphics_queue_family_index,
-    uint32_t &selected_present_queue_family_index) {
+    uint32_t &selected_present_queue_family_index,
+    uint32_t &selected_transfer_queue_family_index,
+    uint32_t &selected_compute_queue_family_index) {
   uint32_t extensions_count = 0;
   if ((vkEnumerateDeviceExtensionProperties(physical_device, nullptr,
                                             &extensions_count,
@@ -132,8 +311,11 @@ bool VulkanCommon::CheckPhysicalDeviceProperties(
     return false;
   }
 
-  std::vector<const char *> device_extensions = {
-      VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  // Offscreen images need no swap chain
+  std::vector<const char *> device_extensions;
+  if (vulkan_.PresentationSurface != VK_NULL_HANDLE) {
+    device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  }
 
   for (std::size_t i = 0; i < device_extensions.size(); ++i) {
     if (!CheckExtensionAvailability(device_extensions[i],
@@ -178,11 +360,55 @@ bool VulkanCommon::CheckPhysicalDeviceProperties(
 
   uint32_t graphics_queue_family_index = UINT32_MAX;
   uint32_t present_queue_family_index = UINT32_MAX;
+  uint32_t transfer_queue_family_index = UINT32_MAX;
+  uint32_t compute_queue_family_index = UINT32_MAX;
+
+  // Queue family which supports only transfer operations is usually backed by
+  // dedicated copy engines that work in parallel with rendering - prefer it
+  // for uploads
+  for (uint32_t i = 0; i < queue_families_count; ++i) {
+    if ((queue_family_properties[i].queueCount > 0) &&
+        (queue_family_properties[i].queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+        !(queue_family_properties[i].queueFlags &
+          (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+      transfer_queue_family_index = i;
+      break;
+    }
+  }
+
+  // Likewise compute without graphics runs asynchronously to rendering.
+  // Graphics families are not required to support compute, so the fallback
+  // is the first family which does
+  uint32_t fallback_compute_queue_family_index = UINT32_MAX;
+  for (uint32_t i = 0; i < queue_families_count; ++i) {
+    if ((queue_family_properties[i].queueCount == 0) ||
+        !(queue_family_properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+      continue;
+    }
+    if (fallback_compute_queue_family_index == UINT32_MAX) {
+      fallback_compute_queue_family_index = i;
+    }
+    if ((compute_queue_family_index == UINT32_MAX) &&
+        !(queue_family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+      compute_queue_family_index = i;
+    }
+  }
+  if (fallback_compute_queue_family_index == UINT32_MAX) {
+    std::cout << "Could not find a queue family with compute support on "
+                 "physical device "
+              << physical_device << "!" << std::endl;
+    return false;
+  }
 
   for (uint32_t i = 0; i < queue_families_count; ++i) {
-    vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i,
-                                         vulkan_.PresentationSurface,
-                                         &queue_present_support[i]);
+    if (vulkan_.PresentationSurface != VK_NULL_HANDLE) {
+      vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i,
+                                           vulkan_.PresentationSurface,
+                                           &queue_present_support[i]);
+    } else {
+      // Offscreen "presentation" is a submission on the graphics queue
+      queue_present_support[i] = VK_TRUE;
+    }
 
     if ((queue_family_properties[i].queueCount > 0) &&
         (queue_family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
@@ -195,6 +421,21 @@ bool VulkanCommon::CheckPhysicalDeviceProperties(
       if (queue_present_support[i]) {
         selected_graphics_queue_family_index = i;
         selected_present_queue_family_index = i;
+        // Graphics queues always support transfer operations
+        selected_transfer_queue_family_index =
+            (transfer_queue_family_index != UINT32_MAX)
+                ? transfer_queue_family_index
+                : i;
+        // Without a compute only family this one is preferred, if it can
+        if (compute_queue_family_index != UINT32_MAX) {
+          selected_compute_queue_family_index = compute_queue_family_index;
+        } else if (queue_family_properties[i].queueFlags &
+                   VK_QUEUE_COMPUTE_BIT) {
+          selected_compute_queue_family_index = i;
+        } else {
+          selected_compute_queue_family_index =
+              fallback_compute_queue_family_index;
+        }
         return true;
       }
     }
@@ -221,9 +462,120 @@ bool VulkanCommon::CheckPhysicalDeviceProperties(
 
   selected_graphics_queue_family_index = graphics_queue_family_index;
   selected_present_queue_family_index = present_queue_family_index;
+  selected_transfer_queue_family_index =
+      (transfer_queue_family_index != UINT32_MAX)
+          ? transfer_queue_family_index
+          : graphics_queue_family_index;
+  if (compute_queue_family_index != UINT32_MAX) {
+    selected_compute_queue_family_index = compute_queue_family_index;
+  } else if (queue_family_properties[graphics_queue_family_index].queueFlags &
+             VK_QUEUE_COMPUTE_BIT) {
+    selected_compute_queue_family_index = graphics_queue_family_index;
+  } else {
+    selected_compute_queue_family_index = fallback_compute_queue_family_index;
+  }
   return true;
 }
 
+uint32_t VulkanCommon::ScorePhysicalDevice(
+    VkPhysicalDevice physical_device, uint32_t graphics_queue_family_index,
+    uint32_t present_queue_family_index, uint32_t transfer_queue_family_index,
+    uint32_t compute_queue_family_index) {
+  VkPhysicalDeviceProperties device_properties;
+  VkPhysicalDeviceFeatures device_features;
+  vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+  vkGetPhysicalDeviceFeatures(physical_device, &device_features);
+
+  // Device type dominates, so a discrete GPU always beats an integrated one
+  uint32_t score = 0;
+  switch (device_properties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      score += 10000;
+      break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      score += 5000;
+      break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+      score += 2000;
+      break;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      break;
+    default:
+      score += 1000;
+      break;
+  }
+
+  // One point per 64 MiB of device local memory, up to 64 GiB
+  VkDeviceSize memory_size = GetDeviceLocalMemorySize(physical_device);
+  score += static_cast<uint32_t>(
+      std::min<VkDeviceSize>(memory_size / (64 * 1024 * 1024), 1024));
+
+  // Dedicated copy and compute engines work in parallel with rendering
+  if (transfer_queue_family_index != graphics_queue_family_index) {
+    score += 200;
+  }
+  if (compute_queue_family_index != graphics_queue_family_index) {
+    score += 200;
+  }
+  // Presenting from the graphics queue needs no ownership transfers
+  if (graphics_queue_family_index == present_queue_family_index) {
+    score += 100;
+  }
+
+  VkBool32 features[] = {device_features.multiDrawIndirect,
+                         device_features.drawIndirectFirstInstance,
+                         device_features.samplerAnisotropy,
+                         device_features.textureCompressionBC};
+  for (size_t i = 0; i < sizeof(features) / sizeof(features[0]); ++i) {
+    if (features[i]) {
+      score += 50;
+    }
+  }
+
+  uint32_t extensions_count = 0;
+  vkEnumerateDeviceExtensionProperties(physical_device, nullptr,
+                                       &extensions_count, nullptr);
+  std::vector<VkExtensionProperties> available_extensions(extensions_count);
+  if (vkEnumerateDeviceExtensionProperties(
+          physical_device, nullptr, &extensions_count,
+          available_extensions.data()) == VK_SUCCESS) {
+    const char *extensions[] = {VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME,
+                                VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME};
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); ++i) {
+      if (CheckExtensionAvailability(extensions[i], available_extensions)) {
+        score += 50;
+      }
+    }
+  }
+  return score;
+}
+
+std::string VulkanCommon::GetPhysicalDeviceUuid(
+    VkPhysicalDevice physical_device) const {
+  // Without the extensions devices can only be pinned by their index
+  if (get_physical_device_properties2_ == nullptr) {
+    return std::string();
+  }
+
+  VkPhysicalDeviceIDPropertiesKHR id_properties = {};
+  id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES_KHR;
+  VkPhysicalDeviceProperties2KHR device_properties = {};
+  device_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+  device_properties.pNext = &id_properties;
+  get_physical_device_properties2_(physical_device, &device_properties);
+
+  // Formatted like 8-4-4-4-12 hexadecimal digits
+  std::ostringstream uuid;
+  uuid << std::hex << std::setfill('0');
+  for (uint32_t i = 0; i < VK_UUID_SIZE; ++i) {
+    if ((i == 4) || (i == 6) || (i == 8) || (i == 10)) {
+      uuid << '-';
+    }
+    uuid << std::setw(2) << static_cast<uint32_t>(id_properties.deviceUUID[i]);
+  }
+  return uuid.str();
+}
+
 bool VulkanCommon::CreateDevice() {
   uint32_t num_devices = 0;
   if ((vkEnumeratePhysicalDevices(vulkan_.Instance, &num_devices, nullptr) !=
@@ -244,57 +596,219 @@ bool VulkanCommon::CreateDevice() {
 
   uint32_t selected_graphics_queue_family_index = UINT32_MAX;
   uint32_t selected_present_queue_family_index = UINT32_MAX;
-
+  uint32_t selected_transfer_queue_family_index = UINT32_MAX;
+  uint32_t selected_compute_queue_family_index = UINT32_MAX;
+
+  // Every suitable device gets scored and the best one wins, unless the user
+  // pinned a device
+  uint32_t selected_device_index = UINT32_MAX;
+  uint32_t selected_score = 0;
+  bool pinned_device_found = false;
   for (uint32_t i = 0; i < num_devices; ++i) {
-    if (CheckPhysicalDeviceProperties(physical_devices[i],
-                                      selected_graphics_queue_family_index,
-                                      selected_present_queue_family_index)) {
-      vulkan_.PhysicalDevice = physical_devices[i];
-      break;
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties(physical_devices[i], &device_properties);
+    std::string uuid = GetPhysicalDeviceUuid(physical_devices[i]);
+    bool pinned = !device_preference_.empty() &&
+                  MatchesDevicePreference(device_preference_, i, uuid);
+    pinned_device_found = pinned_device_found || pinned;
+
+    uint32_t graphics_queue_family_index = UINT32_MAX;
+    uint32_t present_queue_family_index = UINT32_MAX;
+    uint32_t transfer_queue_family_index = UINT32_MAX;
+    uint32_t compute_queue_family_index = UINT32_MAX;
+    bool suitable = CheckPhysicalDeviceProperties(
+        physical_devices[i], graphics_queue_family_index,
+        present_queue_family_index, transfer_queue_family_index,
+        compute_queue_family_index);
+    uint32_t score =
+        suitable ? ScorePhysicalDevice(
+                       physical_devices[i], graphics_queue_family_index,
+                       present_queue_family_index, transfer_queue_family_index,
+                       compute_queue_family_index)
+                 : 0;
+
+    std::cout << "Physical device " << i << ": "
+              << device_properties.deviceName << " ("
+              << GetPhysicalDeviceTypeName(device_properties.deviceType)
+              << ", "
+              << GetDeviceLocalMemorySize(physical_devices[i]) / (1024 * 1024)
+              << " MiB";
+    if (!uuid.empty()) {
+      std::cout << ", UUID " << uuid;
+    }
+    std::cout << ") ";
+    if (suitable) {
+      std::cout << "score " << score << std::endl;
+    } else {
+      std::cout << "unsuitable" << std::endl;
+    }
+
+    if (!suitable) {
+      continue;
+    }
+    bool better = device_preference_.empty()
+                      ? ((selected_device_index == UINT32_MAX) ||
+                         (score > selected_score))
+                      : pinned;
+    if (better) {
+      selected_device_index = i;
+      selected_score = score;
+      selected_graphics_queue_family_index = graphics_queue_family_index;
+      selected_present_queue_family_index = present_queue_family_index;
+      selected_transfer_queue_family_index = transfer_queue_family_index;
+      selected_compute_queue_family_index = compute_queue_family_index;
     }
   }
-  if (vulkan_.PhysicalDevice == VK_NULL_HANDLE) {
-    std::cout
-        << "Could not select physical device based on the chosen properties!"
-        << std::endl;
+
+  if (selected_device_index == UINT32_MAX) {
+    if (!device_preference_.empty() && !pinned_device_found) {
+      std::cout << "Could not find physical device \"" << device_preference_
+                << "\"!" << std::endl;
+    } else if (!device_preference_.empty()) {
+      std::cout << "Physical device \"" << device_preference_
+                << "\" doesn't support required properties!" << std::endl;
+    } else {
+      std::cout
+          << "Could not select physical device based on the chosen properties!"
+          << std::endl;
+    }
     return false;
   }
-
+  vulkan_.PhysicalDevice = physical_devices[selected_device_index];
+  std::cout << "Selected physical device " << selected_device_index << " ("
+            << (device_preference_.empty() ? "highest score"
+                                           : "pinned by device preference")
+            << ")" << std::endl;
+
+  // One queue per distinct family; queues of dedicated compute and transfer
+  // families get a lower priority than rendering and presentation, so the
+  // frame is not delayed by background work where the driver honors it
+  uint32_t queue_family_indices[] = {selected_graphics_queue_family_index,
+                                     selected_present_queue_family_index,
+                                     selected_compute_queue_family_index,
+                                     selected_transfer_queue_family_index};
+  static const float queue_priorities[] = {1.0f, 1.0f, 0.5f, 0.5f};
   std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
-  std::vector<float> queue_priorities = {1.0f};
-  VkDeviceQueueCreateInfo graphic_create_info = {};
-  graphic_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-  graphic_create_info.queueFamilyIndex = selected_graphics_queue_family_index;
-  graphic_create_info.queueCount = queue_priorities.size();
-  graphic_create_info.pQueuePriorities = queue_priorities.data();
-  queue_create_infos.push_back(graphic_create_info);
-
-  if (selected_graphics_queue_family_index !=
-      selected_present_queue_family_index) {
-    VkDeviceQueueCreateInfo present_create_info = {};
-    present_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    present_create_info.queueFamilyIndex = selected_present_queue_family_index;
-    present_create_info.queueCount = queue_priorities.size();
-    present_create_info.pQueuePriorities = queue_priorities.data();
-    queue_create_infos.push_back(present_create_info);
-  }
-
-  std::vector<const char *> extensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  for (uint32_t i = 0; i < 4; ++i) {
+    bool created = false;
+    for (size_t j = 0; j < queue_create_infos.size(); ++j) {
+      created = created || (queue_create_infos[j].queueFamilyIndex ==
+                            queue_family_indices[i]);
+    }
+    if (created) {
+      continue;
+    }
+    VkDeviceQueueCreateInfo queue_create_info = {};
+    queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_create_info.queueFamilyIndex = queue_family_indices[i];
+    queue_create_info.queueCount = 1;
+    queue_create_info.pQueuePriorities = &queue_priorities[i];
+    queue_create_infos.push_back(queue_create_info);
+  }
+
+  std::vector<const char *> extensions;
+  if (vulkan_.PresentationSurface != VK_NULL_HANDLE) {
+    extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  }
+  uint32_t extensions_count = 0;
+  vkEnumerateDeviceExtensionProperties(vulkan_.PhysicalDevice, nullptr,
+                                       &extensions_count, nullptr);
+  std::vector<VkExtensionProperties> available_extensions(extensions_count);
+  vkEnumerateDeviceExtensionProperties(vulkan_.PhysicalDevice, nullptr,
+                                       &extensions_count,
+                                       available_extensions.data());
+
+  // Indirect draws of whole draw lists: several commands per call, commands
+  // selecting their instances and a draw count read from GPU memory
+  VkPhysicalDeviceFeatures supported_features;
+  vkGetPhysicalDeviceFeatures(vulkan_.PhysicalDevice, &supported_features);
+  enabled_features_ = VkPhysicalDeviceFeatures();
+  enabled_features_.multiDrawIndirect = supported_features.multiDrawIndirect;
+  enabled_features_.drawIndirectFirstInstance =
+      supported_features.drawIndirectFirstInstance;
+  bool use_draw_indirect_count = CheckExtensionAvailability(
+      VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME, available_extensions);
+  if (use_draw_indirect_count) {
+    extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+  }
+
+  // Frames and all queues synchronize through a timeline semaphore where
+  // available, otherwise through fences
+  VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_features = {};
+  timeline_features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+  bool use_timeline_semaphore = false;
+  if (get_physical_device_properties2_ != nullptr) {
+    PFN_vkGetPhysicalDeviceFeatures2KHR get_physical_device_features2 =
+        reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+            vkGetInstanceProcAddr(vulkan_.Instance,
+                                  "vkGetPhysicalDeviceFeatures2KHR"));
+    if ((get_physical_device_features2 != nullptr) &&
+        CheckExtensionAvailability(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME,
+                                   available_extensions)) {
+      VkPhysicalDeviceFeatures2KHR features = {};
+      features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+      features.pNext = &timeline_features;
+      get_physical_device_features2(vulkan_.PhysicalDevice, &features);
+      use_timeline_semaphore = timeline_features.timelineSemaphore == VK_TRUE;
+    }
+  }
+  if (use_timeline_semaphore) {
+    extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    timeline_features.pNext = nullptr;
+    timeline_features.timelineSemaphore = VK_TRUE;
+  }
+  std::cout << "Synchronizing with "
+            << (use_timeline_semaphore ? "a timeline semaphore" : "fences")
+            << std::endl;
+
   VkDeviceCreateInfo device_create_info = {};
   device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  device_create_info.pNext = use_timeline_semaphore ? &timeline_features
+                                                     : nullptr;
   device_create_info.queueCreateInfoCount = queue_create_infos.size();
   device_create_info.pQueueCreateInfos = queue_create_infos.data();
   device_create_info.enabledExtensionCount = extensions.size();
   device_create_info.ppEnabledExtensionNames = extensions.data();
+  device_create_info.pEnabledFeatures = &enabled_features_;
 
   if (vkCreateDevice(vulkan_.PhysicalDevice, &device_create_info, nullptr,
                      &vulkan_.Device) != VK_SUCCESS) {
     std::cout << "Could not create Vulkan device!" << std::endl;
     return false;
   }
+  if (use_draw_indirect_count) {
+    draw_indirect_count_ =
+        reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+            vkGetDeviceProcAddr(vulkan_.Device,
+                                "vkCmdDrawIndexedIndirectCountKHR"));
+  }
+  if (!timeline_.Init(vulkan_.Device, use_timeline_semaphore)) {
+    return false;
+  }
+  deletion_queue_.Init(&timeline_);
 
   vulkan_.GraphicsQueue.FamilyIndex = selected_graphics_queue_family_index;
   vulkan_.PresentQueue.FamilyIndex = selected_present_queue_family_index;
+  vulkan_.TransferQueue.FamilyIndex = selected_transfer_queue_family_index;
+  vulkan_.ComputeQueue.FamilyIndex = selected_compute_queue_family_index;
+
+  uint32_t queue_families_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(vulkan_.PhysicalDevice,
+                                           &queue_families_count, nullptr);
+  std::vector<VkQueueFamilyProperties> queue_family_properties(
+      queue_families_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(vulkan_.PhysicalDevice,
+                                           &queue_families_count,
+                                           queue_family_properties.data());
+  vulkan_.GraphicsQueue.Flags =
+      queue_family_properties[selected_graphics_queue_family_index].queueFlags;
+  vulkan_.PresentQueue.Flags =
+      queue_family_properties[selected_present_queue_family_index].queueFlags;
+  vulkan_.TransferQueue.Flags =
+      queue_family_properties[selected_transfer_queue_family_index].queueFlags;
+  vulkan_.ComputeQueue.Flags =
+      queue_family_properties[selected_compute_queue_family_index].queueFlags;
   return true;
 }
 
@@ -303,16 +817,38 @@ bool VulkanCommon::GetDeviceQueue() {
                    &vulkan_.GraphicsQueue.Handle);
   vkGetDeviceQueue(vulkan_.Device, vulkan_.PresentQueue.FamilyIndex, 0,
                    &vulkan_.PresentQueue.Handle);
+  vkGetDeviceQueue(vulkan_.Device, vulkan_.TransferQueue.FamilyIndex, 0,
+                   &vulkan_.TransferQueue.Handle);
+  vkGetDeviceQueue(vulkan_.Device, vulkan_.ComputeQueue.FamilyIndex, 0,
+                   &vulkan_.ComputeQueue.Handle);
   return true;
 }
 
 uint32_t VulkanCommon::GetSwapChainNumImages(
-    VkSurfaceCapabilitiesKHR &surface_capabilities) {
+    VkSurfaceCapabilitiesKHR &surface_capabilities,
+    VkPresentModeKHR present_mode) {
   // Set of images defined in a swap chain may not always be available for
   // application to render to: One may be displayed and one may wait in a queue
   // to be presented If application wants to use more images at the same time it
   // must ask for more images
-  uint32_t image_count = surface_capabilities.minImageCount + 2;
+  // Every queued image adds a frame of latency: IMMEDIATE needs no spare
+  // images, MAILBOX needs one to replace, and FIFO gets two so the GPU never
+  // waits for the display
+  uint32_t image_count = requested_swap_chain_images_;
+  if (image_count == 0) {
+    switch (present_mode) {
+      case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        image_count = surface_capabilities.minImageCount;
+        break;
+      case VK_PRESENT_MODE_MAILBOX_KHR:
+        image_count = std::max(surface_capabilities.minImageCount + 1, 3u);
+        break;
+      default:
+        image_count = surface_capabilities.minImageCount + 2;
+        break;
+    }
+  }
+  image_count = std::max(image_count, surface_capabilities.minImageCount);
   if ((surface_capabilities.maxImageCount > 0) &&
       (image_count > surface_capabilities.maxImageCount)) {
     image_count = surface_capabilities.maxImageCount;
@@ -346,7 +882,7 @@ VkExtent2D VulkanCommon::GetSwapChainExtent(
   // If this is so we define the size by ourselves but it must fit within
   // defined confines
   if (surface_capabilities.currentExtent.width == -1) {
-    VkExtent2D swap_chain_extent = {640, 480};
+    VkExtent2D swap_chain_extent = default_extent_;
     if (swap_chain_extent.width < surface_capabilities.minImageExtent.width) {
       swap_chain_extent.width = surface_capabilities.minImageExtent.width;
     }
@@ -441,25 +977,45 @@ const SwapChainParameters &VulkanCommon::GetSwapChain() const {
 
 VkPresentModeKHR VulkanCommon::GetSwapChainPresentMode(
     std::vector<VkPresentModeKHR> &present_modes) {
-  // MAILBOX is the lowest latency V-Sync enabled mode (something like
-  // triple-buffering) so use it if available
-  for (VkPresentModeKHR &present_mode : present_modes) {
-    if (present_mode == VK_PRESENT_MODE_MAILBOX_KHR) {
-      return present_mode;
-    }
-  }
-  // IMMEDIATE mode allows us to display frames in a V-Sync independent manner
-  // so it can introduce screen tearing But this mode is the best for
-  // benchmarking purposes if we want to check the real number of FPS
-  for (VkPresentModeKHR &present_mode : present_modes) {
-    if (present_mode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-      return present_mode;
-    }
+  // Requested mode first, then the closest ones in latency; FIFO present mode
+  // is always available
+  std::vector<VkPresentModeKHR> preferred_modes;
+  switch (requested_present_mode_) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      preferred_modes = {VK_PRESENT_MODE_IMMEDIATE_KHR,
+                         VK_PRESENT_MODE_MAILBOX_KHR,
+                         VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+      break;
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+      preferred_modes = {VK_PRESENT_MODE_MAILBOX_KHR,
+                         VK_PRESENT_MODE_IMMEDIATE_KHR};
+      break;
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+      preferred_modes = {VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+      break;
+    case VK_PRESENT_MODE_FIFO_KHR:
+      break;
+    default:
+      // MAILBOX is the lowest latency V-Sync enabled mode (something like
+      // triple-buffering) so use it if available IMMEDIATE mode allows us to
+      // display frames in a V-Sync independent manner so it can introduce
+      // screen tearing But this mode is the best for benchmarking purposes if
+      // we want to check the real number of FPS
+      preferred_modes = {VK_PRESENT_MODE_MAILBOX_KHR,
+                         VK_PRESENT_MODE_IMMEDIATE_KHR};
+      break;
   }
-  // FIFO present mode is always available
-  for (VkPresentModeKHR &present_mode : present_modes) {
-    if (present_mode == VK_PRESENT_MODE_FIFO_KHR) {
-      return present_mode;
+  preferred_modes.push_back(VK_PRESENT_MODE_FIFO_KHR);
+
+  for (size_t i = 0; i < preferred_modes.size(); ++i) {
+    for (VkPresentModeKHR &present_mode : present_modes) {
+      if (present_mode == preferred_modes[i]) {
+        std::cout << "Present mode: " << GetPresentModeName(present_mode)
+                  << " (requested "
+                  << GetPresentModeName(requested_present_mode_) << ")"
+                  << std::endl;
+        return present_mode;
+      }
     }
   }
   std::cout << "FIFO present mode is not supported by the swap chain!"
@@ -470,18 +1026,19 @@ VkPresentModeKHR VulkanCommon::GetSwapChainPresentMode(
 bool VulkanCommon::CreateSwapChain() {
   can_render_ = false;
 
-  if (vulkan_.Device != VK_NULL_HANDLE) {
-    vkDeviceWaitIdle(vulkan_.Device);
-  }
-
+  // Frames in flight may still render into the current images, so instead of
+  // waiting for the device their views and the framebuffers referencing them
+  // are retired and destroyed later
+  RetiredSwapChain retired;
+  framebuffer_cache_.Detach(&retired.Framebuffers);
   for (std::size_t i = 0; i < vulkan_.SwapChain.Images.size(); ++i) {
     if (vulkan_.SwapChain.Images[i].View != VK_NULL_HANDLE) {
-      vkDestroyImageView(GetDevice(), vulkan_.SwapChain.Images[i].View,
-                         nullptr);
-      vulkan_.SwapChain.Images[i].View = VK_NULL_HANDLE;
+      retired.Views.push_back(vulkan_.SwapChain.Images[i].View);
     }
   }
+  retired_swap_chains_.push_back(retired);
   vulkan_.SwapChain.Images.clear();
+  image_input_times_.clear();
 
   VkSurfaceCapabilitiesKHR surface_capabilities;
   if (vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
@@ -534,16 +1091,16 @@ bool VulkanCommon::CreateSwapChain() {
     return false;
   }
 
+  VkPresentModeKHR desired_present_mode =
+      GetSwapChainPresentMode(present_modes);
   uint32_t desired_number_of_images =
-      GetSwapChainNumImages(surface_capabilities);
+      GetSwapChainNumImages(surface_capabilities, desired_present_mode);
   VkSurfaceFormatKHR desired_format = GetSwapChainFormat(surface_formats);
   VkExtent2D desired_extent = GetSwapChainExtent(surface_capabilities);
   VkImageUsageFlags desired_usage =
       GetSwapChainUsageFlags(surface_capabilities);
   VkSurfaceTransformFlagBitsKHR desired_transform =
       GetSwapChainTransform(surface_capabilities);
-  VkPresentModeKHR desired_present_mode =
-      GetSwapChainPresentMode(present_modes);
   VkSwapchainKHR old_swap_chain = vulkan_.SwapChain.Handle;
 
   if (static_cast<int>(desired_usage) == -1) {
@@ -581,7 +1138,9 @@ bool VulkanCommon::CreateSwapChain() {
     return false;
   }
   if (old_swap_chain != VK_NULL_HANDLE) {
-    vkDestroySwapchainKHR(vulkan_.Device, old_swap_chain, nullptr);
+    // The old swap chain is retired by oldSwapchain but its last presents may
+    // still be queued
+    retired_swap_chains_.back().Handle = old_swap_chain;
   }
 
   vulkan_.SwapChain.Format = desired_format.format;
@@ -610,6 +1169,25 @@ bool VulkanCommon::CreateSwapChain() {
   return CreateSwapChainImageViews();
 }
 
+void VulkanCommon::RetireSwapChains(uint64_t timeline_value) {
+  VkDevice device = vulkan_.Device;
+  for (size_t i = 0; i < retired_swap_chains_.size(); ++i) {
+    RetiredSwapChain retired = retired_swap_chains_[i];
+    deletion_queue_.Enqueue(timeline_value, [device, retired]() {
+      for (size_t j = 0; j < retired.Framebuffers.size(); ++j) {
+        vkDestroyFramebuffer(device, retired.Framebuffers[j], nullptr);
+      }
+      for (size_t j = 0; j < retired.Views.size(); ++j) {
+        vkDestroyImageView(device, retired.Views[j], nullptr);
+      }
+      if (retired.Handle != VK_NULL_HANDLE) {
+        vkDestroySwapchainKHR(device, retired.Handle, nullptr);
+      }
+    });
+  }
+  retired_swap_chains_.clear();
+}
+
 bool VulkanCommon::CreateSwapChainImageViews() {
   for (std::size_t i = 0; i < vulkan_.SwapChain.Images.size(); ++i) {
     VkImageViewCreateInfo image_view_create_info = {};
@@ -634,18 +1212,50 @@ bool VulkanCommon::CreateSwapChainImageViews() {
 }
 
 bool VulkanCommon::PrepareVulkan(GLFWwindow *window) {
+  headless_ = false;
   if (!CreateInstance()) {
     return false;
   }
   if (!CreatePresentationSurface(window)) {
     return false;
   }
+  return PrepareDevice();
+}
+
+bool VulkanCommon::PrepareVulkanHeadless(uint32_t width, uint32_t height,
+                                         bool use_headless_surface) {
+  headless_ = true;
+  use_headless_surface_ = use_headless_surface;
+  default_extent_ = {width, height};
+  if (!CreateInstance()) {
+    return false;
+  }
+  // Extension may be unavailable, then offscreen images are used instead
+  if (use_headless_surface_ && !CreateHeadlessSurface()) {
+    return false;
+  }
+  return PrepareDevice();
+}
+
+bool VulkanCommon::PrepareDevice() {
   if (!CreateDevice()) {
     return false;
   }
   if (!GetDeviceQueue()) {
     return false;
   }
+  framebuffer_cache_.Init(vulkan_.Device);
+  if (!memory_allocator_.Init(vulkan_.PhysicalDevice, vulkan_.Device)) {
+    return false;
+  }
+  if (!upload_manager_.Init(vulkan_.Device, &memory_allocator_,
+                            vulkan_.TransferQueue.Handle,
+                            vulkan_.TransferQueue.FamilyIndex)) {
+    return false;
+  }
+  if (vulkan_.PresentationSurface == VK_NULL_HANDLE) {
+    return CreateOffscreenImages();
+  }
   if (!CreateSwapChain()) {
     return false;
   }
@@ -661,6 +1271,849 @@ bool VulkanCommon::CreatePresentationSurface(GLFWwindow *window) {
   return true;
 }
 
+bool VulkanCommon::CreateHeadlessSurface() {
+  PFN_vkCreateHeadlessSurfaceEXT create_headless_surface =
+      reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(vkGetInstanceProcAddr(
+          vulkan_.Instance, "vkCreateHeadlessSurfaceEXT"));
+  if (create_headless_surface == nullptr) {
+    std::cout << "Could not load vkCreateHeadlessSurfaceEXT!" << std::endl;
+    return false;
+  }
+
+  VkHeadlessSurfaceCreateInfoEXT surface_create_info = {
+      VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT,  // VkStructureType
+                                                           // sType
+      nullptr,  // const void                        *pNext
+      0         // VkHeadlessSurfaceCreateFlagsEXT    flags
+  };
+
+  if (create_headless_surface(vulkan_.Instance, &surface_create_info, nullptr,
+                              &vulkan_.PresentationSurface) != VK_SUCCESS) {
+    std::cout << "Could not create a headless surface!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool VulkanCommon::CreateOffscreenImages() {
+  // Same count as a typical swap chain so frames can be pipelined
+  const uint32_t image_count = 3;
+
+  vulkan_.SwapChain.Format = VK_FORMAT_R8G8B8A8_UNORM;
+  vulkan_.SwapChain.Extent = default_extent_;
+  // Images are not presented, leave them ready to be copied out
+  vulkan_.SwapChain.PresentLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  vulkan_.SwapChain.Images.resize(image_count);
+  offscreen_memory_.resize(image_count);
+
+  for (uint32_t i = 0; i < image_count; ++i) {
+    VkImageCreateInfo image_create_info = {
+        VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,  // VkStructureType sType
+        nullptr,                   // const void                    *pNext
+        0,                         // VkImageCreateFlags             flags
+        VK_IMAGE_TYPE_2D,          // VkImageType                    imageType
+        vulkan_.SwapChain.Format,  // VkFormat                       format
+        {
+            // VkExtent3D                     extent
+            default_extent_.width,   // uint32_t                       width
+            default_extent_.height,  // uint32_t                       height
+            1                        // uint32_t                       depth
+        },
+        1,                        // uint32_t                       mipLevels
+        1,                        // uint32_t                       arrayLayers
+        VK_SAMPLE_COUNT_1_BIT,    // VkSampleCountFlagBits          samples
+        VK_IMAGE_TILING_OPTIMAL,  // VkImageTiling                  tiling
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+            VK_IMAGE_USAGE_TRANSFER_SRC_BIT,  // VkImageUsageFlags usage
+        VK_SHARING_MODE_EXCLUSIVE,  // VkSharingMode                  sharingMode
+        0,          // uint32_t                       queueFamilyIndexCount
+        nullptr,    // const uint32_t                *pQueueFamilyIndices
+        VK_IMAGE_LAYOUT_UNDEFINED  // VkImageLayout initialLayout
+    };
+
+    if (vkCreateImage(vulkan_.Device, &image_create_info, nullptr,
+                      &vulkan_.SwapChain.Images[i].Handle) != VK_SUCCESS) {
+      std::cout << "Could not create an offscreen image!" << std::endl;
+      return false;
+    }
+
+    if (!memory_allocator_.AllocateForImage(
+            vulkan_.SwapChain.Images[i].Handle,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &offscreen_memory_[i])) {
+      std::cout << "Could not allocate memory for an offscreen image!"
+                << std::endl;
+      return false;
+    }
+
+    if (vkBindImageMemory(vulkan_.Device, vulkan_.SwapChain.Images[i].Handle,
+                          offscreen_memory_[i].Memory,
+                          offscreen_memory_[i].Offset) != VK_SUCCESS) {
+      std::cout << "Could not bind memory to an offscreen image!" << std::endl;
+      return false;
+    }
+  }
+
+  return CreateSwapChainImageViews();
+}
+
+bool VulkanCommon::IsHeadless() const { return headless_; }
+
+VkResult VulkanCommon::AcquireNextImage(VkSemaphore image_available_semaphore,
+                                        uint32_t *image_index) {
+  FrameRecorder::Clock::time_point start = FrameRecorder::Clock::now();
+  if (vulkan_.SwapChain.Handle != VK_NULL_HANDLE) {
+    VkResult result = vkAcquireNextImageKHR(
+        vulkan_.Device, vulkan_.SwapChain.Handle, UINT64_MAX,
+        image_available_semaphore, VK_NULL_HANDLE, image_index);
+    frame_recorder_.AddPhaseTime(FramePhase::Acquire, start);
+    if ((result == VK_SUCCESS) || (result == VK_SUBOPTIMAL_KHR)) {
+      AddLatencySample(*image_index);
+    }
+    return result;
+  }
+
+  *image_index = offscreen_image_index_;
+  offscreen_image_index_ =
+      (offscreen_image_index_ + 1) % vulkan_.SwapChain.Images.size();
+
+  // No presentation engine holds offscreen images; the semaphore signal still
+  // waits for all earlier work on the queue, so the image is free to reuse
+  VkSubmitInfo submit_info = {
+      VK_STRUCTURE_TYPE_SUBMIT_INFO,  // VkStructureType              sType
+      nullptr,                        // const void                  *pNext
+      0,        // uint32_t                     waitSemaphoreCount
+      nullptr,  // const VkSemaphore           *pWaitSemaphores
+      nullptr,  // const VkPipelineStageFlags  *pWaitDstStageMask;
+      0,        // uint32_t                     commandBufferCount
+      nullptr,  // const VkCommandBuffer       *pCommandBuffers
+      1,        // uint32_t                     signalSemaphoreCount
+      &image_available_semaphore  // const VkSemaphore *pSignalSemaphores
+  };
+  VkResult result = vkQueueSubmit(vulkan_.GraphicsQueue.Handle, 1,
+                                  &submit_info, VK_NULL_HANDLE);
+  frame_recorder_.AddPhaseTime(FramePhase::Acquire, start);
+  return result;
+}
+
+VkResult VulkanCommon::PresentImage(VkSemaphore rendering_finished_semaphore,
+                                    uint32_t image_index) {
+  FrameRecorder::Clock::time_point start = FrameRecorder::Clock::now();
+  if (vulkan_.SwapChain.Handle != VK_NULL_HANDLE) {
+    VkPresentInfoKHR present_info = {
+        VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,  // VkStructureType sType
+        nullptr,  // const void                  *pNext
+        1,        // uint32_t                     waitSemaphoreCount
+        &rendering_finished_semaphore,  // const VkSemaphore *pWaitSemaphores
+        1,                          // uint32_t                     swapchainCount
+        &vulkan_.SwapChain.Handle,  // const VkSwapchainKHR        *pSwapchains
+        &image_index,               // const uint32_t              *pImageIndices
+        nullptr                     // VkResult                    *pResults
+    };
+    VkResult result =
+        vkQueuePresentKHR(vulkan_.PresentQueue.Handle, &present_info);
+    frame_recorder_.AddPhaseTime(FramePhase::Present, start);
+    if ((result == VK_SUCCESS) || (result == VK_SUBOPTIMAL_KHR)) {
+      if (image_input_times_.size() != vulkan_.SwapChain.Images.size()) {
+        image_input_times_.assign(vulkan_.SwapChain.Images.size(),
+                                  FrameRecorder::Clock::time_point());
+      }
+      image_input_times_[image_index] = frame_input_time_;
+    }
+    return result;
+  }
+
+  // Consume the semaphore so it can be signaled again by the next frame
+  VkPipelineStageFlags wait_dst_stage_mask =
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+  VkSubmitInfo submit_info = {
+      VK_STRUCTURE_TYPE_SUBMIT_INFO,  // VkStructureType              sType
+      nullptr,                        // const void                  *pNext
+      1,  // uint32_t                     waitSemaphoreCount
+      &rendering_finished_semaphore,  // const VkSemaphore *pWaitSemaphores
+      &wait_dst_stage_mask,  // const VkPipelineStageFlags  *pWaitDstStageMask;
+      0,                     // uint32_t                     commandBufferCount
+      nullptr,               // const VkCommandBuffer       *pCommandBuffers
+      0,                     // uint32_t                     signalSemaphoreCount
+      nullptr                // const VkSemaphore           *pSignalSemaphores
+  };
+  VkResult result = vkQueueSubmit(vulkan_.GraphicsQueue.Handle, 1,
+                                  &submit_info, VK_NULL_HANDLE);
+  frame_recorder_.AddPhaseTime(FramePhase::Present, start);
+  return result;
+}
+
+VkResult VulkanCommon::WaitForTimeline(uint64_t value, uint64_t timeout) {
+  FrameRecorder::Clock::time_point start = FrameRecorder::Clock::now();
+  VkResult result = timeline_.Wait(value, timeout);
+  frame_recorder_.AddPhaseTime(FramePhase::GpuWait, start);
+  return result;
+}
+
+GpuTimeline &VulkanCommon::GetTimeline() { return timeline_; }
+
+DeletionQueue &VulkanCommon::GetDeletionQueue() { return deletion_queue_; }
+
+VkResult VulkanCommon::SubmitToGraphicsQueue(const VkSubmitInfo &submit_info,
+                                             VkFence fence) {
+  FrameRecorder::Clock::time_point start = FrameRecorder::Clock::now();
+  VkResult result =
+      vkQueueSubmit(vulkan_.GraphicsQueue.Handle, 1, &submit_info, fence);
+  frame_recorder_.AddPhaseTime(FramePhase::Submit, start);
+  return result;
+}
+
+VkResult VulkanCommon::SubmitToQueue(const QueueParameters &queue,
+                                     const QueueSubmission &submission,
+                                     uint64_t *timeline_value) {
+  if (submission.WaitSemaphores.size() != submission.WaitStages.size()) {
+    std::cout << "Every wait semaphore needs a wait stage!" << std::endl;
+    return VK_ERROR_INITIALIZATION_FAILED;
+  }
+
+  uint32_t wait_count =
+      static_cast<uint32_t>(submission.WaitSemaphores.size());
+  uint32_t command_buffer_count =
+      static_cast<uint32_t>(submission.CommandBuffers.size());
+  uint32_t signal_count =
+      static_cast<uint32_t>(submission.SignalSemaphores.size());
+  VkSubmitInfo submit_info = {
+      VK_STRUCTURE_TYPE_SUBMIT_INFO,  // VkStructureType              sType
+      nullptr,                        // const void                  *pNext
+      wait_count,  // uint32_t                     waitSemaphoreCount
+      submission.WaitSemaphores.data(),  // const VkSemaphore *pWaitSemaphores
+      submission.WaitStages.data(),  // const VkPipelineStageFlags *pWaitDstStageMask
+      command_buffer_count,  // uint32_t                     commandBufferCount
+      submission.CommandBuffers.data(),  // const VkCommandBuffer *pCommandBuffers
+      signal_count,  // uint32_t                     signalSemaphoreCount
+      submission.SignalSemaphores.data()  // const VkSemaphore *pSignalSemaphores
+  };
+
+  // Work on the graphics queue is accounted like the frame submission
+  bool graphics = queue.Handle == vulkan_.GraphicsQueue.Handle;
+  FrameRecorder::Clock::time_point start = FrameRecorder::Clock::now();
+  VkResult result = timeline_.Submit(
+      queue.Handle, submit_info, submission.WaitTimelineValue,
+      submission.WaitTimelineStage, timeline_value);
+  if (graphics) {
+    frame_recorder_.AddPhaseTime(FramePhase::Submit, start);
+  }
+  return result;
+}
+
+bool VulkanCommon::CreateQueueSemaphore(VkSemaphore *semaphore) {
+  VkSemaphoreCreateInfo semaphore_create_info = {
+      VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,  // VkStructureType sType
+      nullptr,                                  // const void*              pNext
+      0  // VkSemaphoreCreateFlags   flags
+  };
+
+  if (vkCreateSemaphore(vulkan_.Device, &semaphore_create_info, nullptr,
+                        semaphore) != VK_SUCCESS) {
+    std::cout << "Could not create a semaphore!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void VulkanCommon::ReleaseBufferOwnership(VkCommandBuffer command_buffer,
+                                          VkBuffer buffer,
+                                          const QueueParameters &source,
+                                          const QueueParameters &destination,
+                                          VkAccessFlags source_access,
+                                          VkPipelineStageFlags source_stage) {
+  if (source.FamilyIndex == destination.FamilyIndex) {
+    return;
+  }
+
+  VkBufferMemoryBarrier barrier = {
+      VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,  // VkStructureType sType
+      nullptr,                   // const void                *pNext
+      source_access,             // VkAccessFlags              srcAccessMask
+      0,                         // VkAccessFlags              dstAccessMask
+      source.FamilyIndex,        // uint32_t                   srcQueueFamilyIndex
+      destination.FamilyIndex,   // uint32_t                   dstQueueFamilyIndex
+      buffer,                    // VkBuffer                   buffer
+      0,                         // VkDeviceSize               offset
+      VK_WHOLE_SIZE              // VkDeviceSize               size
+  };
+  vkCmdPipelineBarrier(command_buffer, source_stage,
+                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1,
+                       &barrier, 0, nullptr);
+}
+
+void VulkanCommon::AcquireBufferOwnership(
+    VkCommandBuffer command_buffer, VkBuffer buffer,
+    const QueueParameters &source, const QueueParameters &destination,
+    VkAccessFlags destination_access, VkPipelineStageFlags destination_stage) {
+  bool transfer = source.FamilyIndex != destination.FamilyIndex;
+
+  VkBufferMemoryBarrier barrier = {
+      VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,  // VkStructureType sType
+      nullptr,  // const void                *pNext
+      transfer ? 0u
+               : static_cast<VkAccessFlags>(
+                     VK_ACCESS_MEMORY_WRITE_BIT),  // VkAccessFlags
+                                                   // srcAccessMask
+      destination_access,  // VkAccessFlags              dstAccessMask
+      transfer ? source.FamilyIndex
+               : VK_QUEUE_FAMILY_IGNORED,  // uint32_t srcQueueFamilyIndex
+      transfer ? destination.FamilyIndex
+               : VK_QUEUE_FAMILY_IGNORED,  // uint32_t dstQueueFamilyIndex
+      buffer,         // VkBuffer                   buffer
+      0,              // VkDeviceSize               offset
+      VK_WHOLE_SIZE   // VkDeviceSize               size
+  };
+  // A transfer starts at the stage the semaphore wait of its submission
+  // blocks, which has to be destination_stage as well
+  vkCmdPipelineBarrier(command_buffer,
+                       transfer ? destination_stage
+                                : static_cast<VkPipelineStageFlags>(
+                                      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT),
+                       destination_stage, 0, 0, nullptr, 1, &barrier, 0,
+                       nullptr);
+}
+
+void VulkanCommon::ReleaseImageOwnership(
+    VkCommandBuffer command_buffer, VkImage image,
+    const VkImageSubresourceRange &range, VkImageLayout old_layout,
+    VkImageLayout new_layout, const QueueParameters &source,
+    const QueueParameters &destination, VkAccessFlags source_access,
+    VkPipelineStageFlags source_stage) {
+  if (source.FamilyIndex == destination.FamilyIndex) {
+    return;
+  }
+
+  VkImageMemoryBarrier barrier = {
+      VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,  // VkStructureType sType
+      nullptr,                  // const void                *pNext
+      source_access,            // VkAccessFlags              srcAccessMask
+      0,                        // VkAccessFlags              dstAccessMask
+      old_layout,               // VkImageLayout              oldLayout
+      new_layout,               // VkImageLayout              newLayout
+      source.FamilyIndex,       // uint32_t                   srcQueueFamilyIndex
+      destination.FamilyIndex,  // uint32_t                   dstQueueFamilyIndex
+      image,                    // VkImage                    image
+      range                     // VkImageSubresourceRange    subresourceRange
+  };
+  vkCmdPipelineBarrier(command_buffer, source_stage,
+                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+}
+
+void VulkanCommon::AcquireImageOwnership(
+    VkCommandBuffer command_buffer, VkImage image,
+    const VkImageSubresourceRange &range, VkImageLayout old_layout,
+    VkImageLayout new_layout, const QueueParameters &source,
+    const QueueParameters &destination, VkAccessFlags destination_access,
+    VkPipelineStageFlags destination_stage) {
+  bool transfer = source.FamilyIndex != destination.FamilyIndex;
+
+  VkImageMemoryBarrier barrier = {
+      VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,  // VkStructureType sType
+      nullptr,  // const void                *pNext
+      transfer ? 0u
+               : static_cast<VkAccessFlags>(
+                     VK_ACCESS_MEMORY_WRITE_BIT),  // VkAccessFlags
+                                                   // srcAccessMask
+      destination_access,  // VkAccessFlags              dstAccessMask
+      old_layout,          // VkImageLayout              oldLayout
+      new_layout,          // VkImageLayout              newLayout
+      transfer ? source.FamilyIndex
+               : VK_QUEUE_FAMILY_IGNORED,  // uint32_t srcQueueFamilyIndex
+      transfer ? destination.FamilyIndex
+               : VK_QUEUE_FAMILY_IGNORED,  // uint32_t dstQueueFamilyIndex
+      image,  // VkImage                    image
+      range   // VkImageSubresourceRange    subresourceRange
+  };
+  // A transfer starts at the stage the semaphore wait of its submission
+  // blocks, which has to be destination_stage as well
+  vkCmdPipelineBarrier(command_buffer,
+                       transfer ? destination_stage
+                                : static_cast<VkPipelineStageFlags>(
+                                      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT),
+                       destination_stage, 0, 0, nullptr, 0, nullptr, 1,
+                       &barrier);
+}
+
+bool VulkanCommon::TransferBufferOwnership(
+    const std::vector<VkBuffer> &buffers, const QueueParameters &source,
+    const QueueParameters &destination, VkAccessFlags source_access,
+    VkPipelineStageFlags source_stage, VkAccessFlags destination_access,
+    VkPipelineStageFlags destination_stage) {
+  if ((source.FamilyIndex == destination.FamilyIndex) || buffers.empty()) {
+    return true;
+  }
+
+  // The release is submitted to the source queue, the acquire to the
+  // destination queue
+  const QueueParameters *queues[] = {&source, &destination};
+  VkCommandPool command_pools[] = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+  VkCommandBuffer command_buffers[] = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+  VkSemaphore semaphore = VK_NULL_HANDLE;
+  VkCommandBufferBeginInfo command_buffer_begin_info = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,  // VkStructureType sType
+      nullptr,  // const void                            *pNext
+      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,  // VkCommandBufferUsageFlags
+                                                    // flags
+      nullptr  // const VkCommandBufferInheritanceInfo  *pInheritanceInfo
+  };
+
+  bool result = CreateQueueSemaphore(&semaphore);
+  for (uint32_t i = 0; result && (i < 2); ++i) {
+    VkCommandPoolCreateInfo command_pool_create_info = {
+        VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,  // VkStructureType sType
+        nullptr,  // const void                    *pNext
+        VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,  // VkCommandPoolCreateFlags flags
+        queues[i]->FamilyIndex  // uint32_t             queueFamilyIndex
+    };
+
+    result = (vkCreateCommandPool(vulkan_.Device, &command_pool_create_info,
+                                  nullptr, &command_pools[i]) == VK_SUCCESS);
+    if (result) {
+      VkCommandBufferAllocateInfo command_buffer_allocate_info = {
+          VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,  // VkStructureType
+                                                           // sType
+          nullptr,           // const void                    *pNext
+          command_pools[i],  // VkCommandPool                  commandPool
+          VK_COMMAND_BUFFER_LEVEL_PRIMARY,  // VkCommandBufferLevel level
+          1  // uint32_t                       bufferCount
+      };
+      result = (vkAllocateCommandBuffers(vulkan_.Device,
+                                         &command_buffer_allocate_info,
+                                         &command_buffers[i]) == VK_SUCCESS) &&
+               (vkBeginCommandBuffer(command_buffers[i],
+                                     &command_buffer_begin_info) == VK_SUCCESS);
+    }
+  }
+
+  if (result) {
+    for (size_t i = 0; i < buffers.size(); ++i) {
+      ReleaseBufferOwnership(command_buffers[0], buffers[i], source,
+                             destination, source_access, source_stage);
+      AcquireBufferOwnership(command_buffers[1], buffers[i], source,
+                             destination, destination_access,
+                             destination_stage);
+    }
+
+    QueueSubmission release;
+    release.CommandBuffers.push_back(command_buffers[0]);
+    release.SignalSemaphores.push_back(semaphore);
+
+    QueueSubmission acquire;
+    acquire.CommandBuffers.push_back(command_buffers[1]);
+    acquire.WaitSemaphores.push_back(semaphore);
+    acquire.WaitStages.push_back(destination_stage);
+
+    result = (vkEndCommandBuffer(command_buffers[0]) == VK_SUCCESS) &&
+             (vkEndCommandBuffer(command_buffers[1]) == VK_SUCCESS) &&
+             (SubmitToQueue(source, release) == VK_SUCCESS) &&
+             (SubmitToQueue(destination, acquire) == VK_SUCCESS);
+  }
+  if (!result) {
+    std::cout << "Could not transfer buffer ownership between queue families!"
+              << std::endl;
+  }
+
+  // Nothing waits on the CPU; the objects go once everything submitted so
+  // far has finished
+  VkDevice device = vulkan_.Device;
+  VkCommandPool source_pool = command_pools[0];
+  VkCommandPool destination_pool = command_pools[1];
+  deletion_queue_.Enqueue(
+      timeline_.GetLastSignaledValue(),
+      [device, source_pool, destination_pool, semaphore]() {
+        vkDestroyCommandPool(device, source_pool, nullptr);
+        vkDestroyCommandPool(device, destination_pool, nullptr);
+        vkDestroySemaphore(device, semaphore, nullptr);
+      });
+  return result;
+}
+
+bool VulkanCommon::CreateFrameContexts(uint32_t frames_in_flight,
+                                       uint32_t recording_threads,
+                                       VkDeviceSize transient_buffer_size) {
+  if (frames_in_flight == 0) {
+    std::cout << "At least one frame in flight is required!" << std::endl;
+    return false;
+  }
+  if (!frame_contexts_.empty()) {
+    vkDeviceWaitIdle(vulkan_.Device);
+    DestroyFrameContexts();
+  }
+
+  if (recording_threads > 0) {
+    if (!thread_pool_.Init(recording_threads)) {
+      return false;
+    }
+  } else {
+    thread_pool_.Destroy();
+  }
+
+  frame_contexts_.resize(frames_in_flight);
+  next_frame_context_ = 0;
+  last_frame_value_ = 0;
+
+  VkSemaphoreCreateInfo semaphore_create_info = {
+      VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,  // VkStructureType sType
+      nullptr,  // const void*                    pNext
+      0         // VkSemaphoreCreateFlags         flags
+  };
+
+  for (uint32_t i = 0; i < frames_in_flight; ++i) {
+    FrameContext &frame = frame_contexts_[i];
+    frame.Index = i;
+
+    if (!CreateFrameCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                                  &frame.CommandPool, &frame.CommandBuffer)) {
+      return false;
+    }
+    if ((vkCreateSemaphore(vulkan_.Device, &semaphore_create_info, nullptr,
+                           &frame.ImageAvailableSemaphore) != VK_SUCCESS) ||
+        (vkCreateSemaphore(vulkan_.Device, &semaphore_create_info, nullptr,
+                           &frame.FinishedRenderingSemaphore) != VK_SUCCESS)) {
+      std::cout << "Could not create semaphores!" << std::endl;
+      return false;
+    }
+    if (!CreateWorkerCommandBuffers(frame, thread_pool_.GetThreadCount())) {
+      return false;
+    }
+    if ((transient_buffer_size > 0) &&
+        !CreateTransientBuffer(frame, transient_buffer_size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool VulkanCommon::CreateWorkerCommandBuffers(FrameContext &frame,
+                                              uint32_t count) {
+  frame.WorkerCommandPools.resize(count, VK_NULL_HANDLE);
+  frame.WorkerCommandBuffers.resize(count, VK_NULL_HANDLE);
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!CreateFrameCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                                  &frame.WorkerCommandPools[i],
+                                  &frame.WorkerCommandBuffers[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool VulkanCommon::CreateFrameCommandBuffer(VkCommandBufferLevel level,
+                                            VkCommandPool *pool,
+                                            VkCommandBuffer *command_buffer) {
+  // No RESET_COMMAND_BUFFER_BIT - the whole pool is reset at once when its
+  // frame comes around again, and the command buffer is kept for reuse
+  VkCommandPoolCreateInfo command_pool_create_info = {
+      VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,  // VkStructureType sType
+      nullptr,  // const void                    *pNext
+      VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,  // VkCommandPoolCreateFlags flags
+      vulkan_.GraphicsQueue.FamilyIndex  // uint32_t queueFamilyIndex
+  };
+
+  if (vkCreateCommandPool(vulkan_.Device, &command_pool_create_info, nullptr,
+                          pool) != VK_SUCCESS) {
+    std::cout << "Could not create command pool!" << std::endl;
+    return false;
+  }
+
+  VkCommandBufferAllocateInfo command_buffer_allocate_info = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,  // VkStructureType sType
+      nullptr,  // const void                    *pNext
+      *pool,    // VkCommandPool                  commandPool
+      level,    // VkCommandBufferLevel           level
+      1         // uint32_t                       bufferCount
+  };
+
+  if (vkAllocateCommandBuffers(vulkan_.Device, &command_buffer_allocate_info,
+                               command_buffer) != VK_SUCCESS) {
+    std::cout << "Could not allocate command buffer!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+uint32_t VulkanCommon::GetFramesInFlight() const {
+  return static_cast<uint32_t>(frame_contexts_.size());
+}
+
+const FrameContext &VulkanCommon::GetFrameContext(uint32_t index) const {
+  return frame_contexts_[index];
+}
+
+uint32_t VulkanCommon::GetRecordingThreadCount() const {
+  return thread_pool_.GetThreadCount();
+}
+
+ThreadPool &VulkanCommon::GetThreadPool() { return thread_pool_; }
+
+void VulkanCommon::SetFramePacing(double fps_cap, bool low_latency) {
+  fps_cap_ = fps_cap;
+  low_latency_ = low_latency;
+  next_frame_time_ = std::chrono::steady_clock::now();
+}
+
+FrameContext *VulkanCommon::BeginFrame() {
+  if (frame_contexts_.empty()) {
+    std::cout << "Frame contexts were not created!" << std::endl;
+    return nullptr;
+  }
+
+  FrameContext &frame = frame_contexts_[next_frame_context_];
+  next_frame_context_ = (next_frame_context_ + 1) % frame_contexts_.size();
+
+  if (fps_cap_ > 0.0) {
+    // A late frame shifts the schedule instead of bursting to catch up
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    if (next_frame_time_ > now) {
+      std::this_thread::sleep_until(next_frame_time_);
+    }
+    next_frame_time_ =
+        std::max(now, next_frame_time_) +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / fps_cap_));
+  }
+
+  // Fewer queued frames mean the image on screen reflects more recent input,
+  // at the cost of the CPU and GPU no longer working in parallel
+  if (low_latency_ &&
+      (WaitForTimeline(last_frame_value_, UINT64_MAX) != VK_SUCCESS)) {
+    std::cout << "Waiting for the previous frame failed!" << std::endl;
+    return nullptr;
+  }
+
+  // A context which was never submitted has a value of 0 and does not wait
+  if (WaitForTimeline(frame.TimelineValue, 1000000000) != VK_SUCCESS) {
+    std::cout << "Waiting for frame " << frame.TimelineValue
+              << " takes too long!" << std::endl;
+    return nullptr;
+  }
+
+  // The GPU is done with everything recorded for this frame, so all of its
+  // command buffers go back to the initial state in one call
+  if (vkResetCommandPool(vulkan_.Device, frame.CommandPool, 0) != VK_SUCCESS) {
+    std::cout << "Could not reset command pool!" << std::endl;
+    return nullptr;
+  }
+  for (size_t i = 0; i < frame.WorkerCommandPools.size(); ++i) {
+    if (vkResetCommandPool(vulkan_.Device, frame.WorkerCommandPools[i], 0) !=
+        VK_SUCCESS) {
+      std::cout << "Could not reset command pool!" << std::endl;
+      return nullptr;
+    }
+  }
+
+  frame.TransientOffset = 0;
+  deletion_queue_.Collect();
+
+  // Everything the frame shows is based on input sampled from now on
+  frame_input_time_ = FrameRecorder::Clock::now();
+  return &frame;
+}
+
+VkResult VulkanCommon::SubmitFrame(FrameContext &frame,
+                                   VkCommandBuffer command_buffer) {
+  VkPipelineStageFlags wait_dst_stage_mask =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  VkSubmitInfo submit_info = {
+      VK_STRUCTURE_TYPE_SUBMIT_INFO,  // VkStructureType              sType
+      nullptr,                        // const void                  *pNext
+      1,  // uint32_t                     waitSemaphoreCount
+      &frame.ImageAvailableSemaphore,  // const VkSemaphore *pWaitSemaphores
+      &wait_dst_stage_mask,  // const VkPipelineStageFlags  *pWaitDstStageMask;
+      1,                     // uint32_t                     commandBufferCount
+      &command_buffer,       // const VkCommandBuffer       *pCommandBuffers
+      1,                     // uint32_t                     signalSemaphoreCount
+      &frame.FinishedRenderingSemaphore  // const VkSemaphore *pSignalSemaphores
+  };
+
+  // No fence to reset: a frame abandoned after BeginFrame (i.e. because of an
+  // out of date swap chain) simply keeps its previous, completed value
+  FrameRecorder::Clock::time_point start = FrameRecorder::Clock::now();
+  VkResult result = timeline_.Submit(vulkan_.GraphicsQueue.Handle, submit_info,
+                                     0, 0, &frame.TimelineValue);
+  frame_recorder_.AddPhaseTime(FramePhase::Submit, start);
+  if (result == VK_SUCCESS) {
+    last_frame_value_ = frame.TimelineValue;
+    // Once this frame finished, so did every frame rendered into swap chains
+    // retired before it
+    RetireSwapChains(frame.TimelineValue);
+  }
+  return result;
+}
+
+bool VulkanCommon::AllocateTransientBuffer(FrameContext &frame,
+                                           VkDeviceSize size,
+                                           VkDeviceSize alignment,
+                                           TransientAllocation *allocation) {
+  VkDeviceSize offset =
+      (frame.TransientOffset + alignment - 1) & ~(alignment - 1);
+  if ((frame.TransientBuffer.Memory.Mapped == nullptr) ||
+      (offset + size > frame.TransientBuffer.Size)) {
+    std::cout << "Transient buffer of frame " << frame.Index
+              << " cannot hold another " << size << " bytes!" << std::endl;
+    return false;
+  }
+
+  allocation->Buffer = frame.TransientBuffer.Handle;
+  allocation->Offset = offset;
+  allocation->Size = size;
+  allocation->Mapped =
+      static_cast<char *>(frame.TransientBuffer.Memory.Mapped) + offset;
+  frame.TransientOffset = offset + size;
+  return true;
+}
+
+bool VulkanCommon::FlushTransientBuffer(const FrameContext &frame) {
+  if ((frame.TransientOffset > 0) &&
+      !memory_allocator_.Flush(frame.TransientBuffer.Memory, 0,
+                               frame.TransientOffset)) {
+    std::cout << "Could not flush the transient buffer of frame "
+              << frame.Index << "!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool VulkanCommon::CreateTransientBuffer(FrameContext &frame,
+                                         VkDeviceSize size) {
+  frame.TransientBuffer.Size = static_cast<uint32_t>(size);
+
+  // Whatever the CPU writes per frame, from instance data to indirect commands
+  VkBufferCreateInfo buffer_create_info = {
+      VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // VkStructureType        sType
+      nullptr,                               // const void            *pNext
+      0,                                     // VkBufferCreateFlags    flags
+      size,                                  // VkDeviceSize           size
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+          VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+          VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,  // VkBufferUsageFlags usage
+      VK_SHARING_MODE_EXCLUSIVE,  // VkSharingMode          sharingMode
+      0,       // uint32_t               queueFamilyIndexCount
+      nullptr  // const uint32_t        *pQueueFamilyIndices
+  };
+
+  if (vkCreateBuffer(vulkan_.Device, &buffer_create_info, nullptr,
+                     &frame.TransientBuffer.Handle) != VK_SUCCESS) {
+    std::cout << "Could not create a transient buffer!" << std::endl;
+    return false;
+  }
+
+  // Written by the CPU every frame, so it stays mapped for its whole life
+  if (!memory_allocator_.AllocateForBuffer(
+          frame.TransientBuffer.Handle, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+          &frame.TransientBuffer.Memory) ||
+      (vkBindBufferMemory(vulkan_.Device, frame.TransientBuffer.Handle,
+                          frame.TransientBuffer.Memory.Memory,
+                          frame.TransientBuffer.Memory.Offset) != VK_SUCCESS)) {
+    std::cout << "Could not allocate memory for a transient buffer!"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void VulkanCommon::DestroyTransientBuffer(FrameContext &frame) {
+  if (frame.TransientBuffer.Handle != VK_NULL_HANDLE) {
+    vkDestroyBuffer(vulkan_.Device, frame.TransientBuffer.Handle, nullptr);
+  }
+  memory_allocator_.Free(frame.TransientBuffer.Memory);
+  frame.TransientBuffer = BufferParameters();
+  frame.TransientOffset = 0;
+}
+
+void VulkanCommon::DestroyFrameContexts() {
+  for (size_t i = 0; i < frame_contexts_.size(); ++i) {
+    FrameContext &frame = frame_contexts_[i];
+    DestroyTransientBuffer(frame);
+    if (frame.ImageAvailableSemaphore != VK_NULL_HANDLE) {
+      vkDestroySemaphore(vulkan_.Device, frame.ImageAvailableSemaphore,
+                         nullptr);
+    }
+    if (frame.FinishedRenderingSemaphore != VK_NULL_HANDLE) {
+      vkDestroySemaphore(vulkan_.Device, frame.FinishedRenderingSemaphore,
+                         nullptr);
+    }
+    // Command buffers are freed together with their pools
+    if (frame.CommandPool != VK_NULL_HANDLE) {
+      vkDestroyCommandPool(vulkan_.Device, frame.CommandPool, nullptr);
+    }
+    for (size_t j = 0; j < frame.WorkerCommandPools.size(); ++j) {
+      if (frame.WorkerCommandPools[j] != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(vulkan_.Device, frame.WorkerCommandPools[j],
+                             nullptr);
+      }
+    }
+  }
+  frame_contexts_.clear();
+}
+
+bool VulkanCommon::SetPresentPolicy(const std::string &present_mode,
+                                    uint32_t swap_chain_images) {
+  const VkPresentModeKHR present_modes[] = {
+      VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR,
+      VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+
+  requested_present_mode_ = VK_PRESENT_MODE_MAX_ENUM_KHR;
+  for (size_t i = 0; i < sizeof(present_modes) / sizeof(present_modes[0]);
+       ++i) {
+    if (present_mode == GetPresentModeName(present_modes[i])) {
+      requested_present_mode_ = present_modes[i];
+    }
+  }
+  if (!present_mode.empty() &&
+      (requested_present_mode_ == VK_PRESENT_MODE_MAX_ENUM_KHR)) {
+    std::cout << "Unknown present mode \"" << present_mode << "\"!"
+              << std::endl;
+    return false;
+  }
+  requested_swap_chain_images_ = swap_chain_images;
+  return true;
+}
+
+const LatencyStatistics &VulkanCommon::GetLatencyStatistics() const {
+  return latency_statistics_;
+}
+
+void VulkanCommon::AddLatencySample(uint32_t image_index) {
+  if ((image_index >= image_input_times_.size()) ||
+      (image_input_times_[image_index] ==
+       FrameRecorder::Clock::time_point())) {
+    return;
+  }
+
+  // The presentation engine hands an image back only after it was displayed
+  // (or, with MAILBOX, replaced by a newer one), so this is an upper bound
+  double milliseconds =
+      std::chrono::duration<double, std::milli>(
+          FrameRecorder::Clock::now() - image_input_times_[image_index])
+          .count();
+  frame_recorder_.AddPhaseTime(FramePhase::Latency,
+                               image_input_times_[image_index]);
+  image_input_times_[image_index] = FrameRecorder::Clock::time_point();
+
+  ++latency_statistics_.SampleCount;
+  latency_statistics_.TotalMilliseconds += milliseconds;
+  latency_statistics_.MaxMilliseconds =
+      std::max(latency_statistics_.MaxMilliseconds, milliseconds);
+}
+
+void VulkanCommon::SetDevicePreference(const std::string &device) {
+  device_preference_ = device;
+}
+
+std::string VulkanCommon::GetDeviceName() const {
+  if (vulkan_.PhysicalDevice == VK_NULL_HANDLE) {
+    return std::string();
+  }
+  VkPhysicalDeviceProperties device_properties;
+  vkGetPhysicalDeviceProperties(vulkan_.PhysicalDevice, &device_properties);
+  return device_properties.deviceName;
+}
+
 const QueueParameters VulkanCommon::GetGraphicsQueue() const {
   return vulkan_.GraphicsQueue;
 }
@@ -669,23 +2122,160 @@ const QueueParameters VulkanCommon::GetPresentQueue() const {
   return vulkan_.PresentQueue;
 }
 
-bool VulkanCommon::OnWindowSizeChanged() {
-  if (vulkan_.Device != VK_NULL_HANDLE) {
-    vkDeviceWaitIdle(vulkan_.Device);
-  }
+const QueueParameters VulkanCommon::GetTransferQueue() const {
+  return vulkan_.TransferQueue;
+}
 
-  ChildClear();
+const QueueParameters VulkanCommon::GetComputeQueue() const {
+  return vulkan_.ComputeQueue;
+}
 
-  if (CreateSwapChain()) {
-    if (can_render_) {
-      return ChildOnWindowSizeChanged();
-    }
+const VkPhysicalDeviceFeatures &VulkanCommon::GetEnabledFeatures() const {
+  return enabled_features_;
+}
+
+PFN_vkCmdDrawIndexedIndirectCountKHR
+VulkanCommon::GetDrawIndirectCountFunction() const {
+  return draw_indirect_count_;
+}
+
+bool VulkanCommon::OnWindowSizeChanged() {
+  VkFormat old_format = vulkan_.SwapChain.Format;
+  if (!CreateSwapChain()) {
+    return false;
+  }
+  if (!can_render_) {
     return true;
   }
 
-  return false;
+  // Render passes and pipelines depend on the image format only
+  if (vulkan_.SwapChain.Format != old_format) {
+    ChildClear();
+  }
+  return ChildOnWindowSizeChanged();
 }
 
   VkPhysicalDevice VulkanCommon::GetPhysicalDevice() const {
     return vulkan_.PhysicalDevice;
   }
+
+VkFramebuffer VulkanCommon::GetFramebuffer(VkRenderPass render_pass,
+                                           const VkImageView *attachments,
+                                           uint32_t attachment_count) {
+  return framebuffer_cache_.Get(render_pass, attachments, attachment_count,
+                                vulkan_.SwapChain.Extent);
+}
+
+const FramebufferCacheStatistics &VulkanCommon::GetFramebufferCacheStatistics()
+    const {
+  return framebuffer_cache_.GetStatistics();
+}
+
+MemoryAllocator &VulkanCommon::GetMemoryAllocator() {
+  return memory_allocator_;
+}
+
+UploadManager &VulkanCommon::GetUploadManager() { return upload_manager_; }
+
+GpuProfiler &VulkanCommon::GetGpuProfiler() { return gpu_profiler_; }
+
+FrameRecorder &VulkanCommon::GetFrameRecorder() { return frame_recorder_; }
+
+bool VulkanCommon::LoadPipelineCache(const std::string &file_name) {
+  return pipeline_cache_.Init(vulkan_.PhysicalDevice, vulkan_.Device,
+                              file_name);
+}
+
+bool VulkanCommon::CreateGraphicsPipeline(
+    const VkGraphicsPipelineCreateInfo &pipeline_create_info,
+    VkPipeline *pipeline) {
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  if (vkCreateGraphicsPipelines(vulkan_.Device, pipeline_cache_.GetHandle(), 1,
+                                &pipeline_create_info, nullptr,
+                                pipeline) != VK_SUCCESS) {
+    return false;
+  }
+  pipeline_cache_.AddCreationTime(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count());
+  return true;
+}
+
+bool VulkanCommon::CreateComputePipeline(
+    const VkComputePipelineCreateInfo &pipeline_create_info,
+    VkPipeline *pipeline) {
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  if (vkCreateComputePipelines(vulkan_.Device, pipeline_cache_.GetHandle(), 1,
+                               &pipeline_create_info, nullptr,
+                               pipeline) != VK_SUCCESS) {
+    return false;
+  }
+  pipeline_cache_.AddCreationTime(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count());
+  return true;
+}
+
+void VulkanCommon::PrintStatistics() const {
+  const FramebufferCacheStatistics &framebuffer_statistics =
+      framebuffer_cache_.GetStatistics();
+  std::cout << "Framebuffer cache: " << framebuffer_statistics.Hits
+            << " hits, " << framebuffer_statistics.Creations << " creations"
+            << std::endl;
+
+  MemoryAllocatorStatistics memory_statistics =
+      memory_allocator_.GetStatistics();
+  std::cout << "Device memory: " << memory_statistics.BlockCount << " blocks ("
+            << memory_statistics.DedicatedBlockCount << " dedicated), "
+            << memory_statistics.AllocationCount << " allocations, "
+            << memory_statistics.UsedBytes / 1024 << " of "
+            << memory_statistics.BlockBytes / 1024 << " KiB used, "
+            << std::fixed << std::setprecision(1)
+            << memory_statistics.GetUtilization() * 100.0f
+            << "% utilization, "
+            << memory_statistics.GetFragmentation() * 100.0f
+            << "% fragmentation" << std::endl;
+
+  const UploadStatistics &upload_statistics = upload_manager_.GetStatistics();
+  std::cout << "Uploads: " << upload_statistics.Bytes << " bytes in "
+            << upload_statistics.Copies << " copies, "
+            << upload_statistics.Batches << " batches, "
+            << upload_statistics.GetBandwidth() << " MiB/s" << std::endl;
+
+  const PipelineCacheStatistics &pipeline_statistics =
+      pipeline_cache_.GetStatistics();
+  std::cout << "Pipeline cache: " << pipeline_statistics.PipelineCount
+            << " pipelines created in "
+            << pipeline_statistics.CreationMicroseconds / 1000.0 << " ms";
+  if (pipeline_statistics.Loaded) {
+    std::cout << " using " << pipeline_statistics.LoadedBytes
+              << " cached bytes, "
+              << pipeline_statistics.GetSavedMicroseconds() / 1000.0
+              << " ms saved compared with a cold start";
+  }
+  std::cout << std::endl;
+
+  if (latency_statistics_.SampleCount > 0) {
+    std::cout << "Input to photon latency estimate: avg "
+              << latency_statistics_.GetAverageMilliseconds() << " ms, max "
+              << latency_statistics_.MaxMilliseconds << " ms over "
+              << latency_statistics_.SampleCount << " frames" << std::endl;
+  }
+
+  std::vector<GpuScopeStatistics> gpu_statistics =
+      gpu_profiler_.GetStatistics();
+  for (size_t i = 0; i < gpu_statistics.size(); ++i) {
+    std::cout << "GPU " << gpu_statistics[i].Name << ": min "
+              << std::setprecision(3) << gpu_statistics[i].MinMilliseconds
+              << " ms, avg " << gpu_statistics[i].AverageMilliseconds
+              << " ms, p99 " << gpu_statistics[i].P99Milliseconds
+              << " ms over " << gpu_statistics[i].SampleCount << " frames"
+              << std::endl;
+  }
+
+  ChildPrintStatistics();
+}
@@ -6,8 +6,20 @@
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan.h>
 
+#include <chrono>
+#include <string>
 #include <vector>
 
+#include "common/deletion_queue.h"
+#include "common/frame_recorder.h"
+#include "common/framebuffer_cache.h"
+#include "common/gpu_profiler.h"
+#include "common/gpu_timeline.h"
+#include "common/memory_allocator.h"
+#include "common/pipeline_cache.h"
+#include "common/thread_pool.h"
+#include "common/upload_manager.h"
+
 // ************************************************************ //
 // QueueParameters                                              //
 //                                                              //
@@ -16,8 +28,36 @@
 struct QueueParameters {
   VkQueue Handle;
   uint32_t FamilyIndex;
+  // Capabilities of the queue's family
+  VkQueueFlags Flags;
 
-  QueueParameters() : Handle(VK_NULL_HANDLE), FamilyIndex(0) {}
+  QueueParameters() : Handle(VK_NULL_HANDLE), FamilyIndex(0), Flags(0) {}
+};
+
+// ************************************************************ //
+// QueueSubmission                                              //
+//                                                              //
+// Command buffers submitted to one queue together with the     //
+// semaphores which order them against work on other queues     //
+// ************************************************************ //
+struct QueueSubmission {
+  std::vector<VkCommandBuffer> CommandBuffers;
+  // Each wait semaphore is waited on at the stage of the same index
+  std::vector<VkSemaphore> WaitSemaphores;
+  std::vector<VkPipelineStageFlags> WaitStages;
+  std::vector<VkSemaphore> SignalSemaphores;
+  // Non zero value of the GPU timeline waited for at WaitTimelineStage,
+  // i.e. the value signaled by work on another queue
+  uint64_t WaitTimelineValue;
+  VkPipelineStageFlags WaitTimelineStage;
+
+  QueueSubmission()
+      : CommandBuffers(),
+        WaitSemaphores(),
+        WaitStages(),
+        SignalSemaphores(),
+        WaitTimelineValue(0),
+        WaitTimelineStage(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT) {}
 };
 
 // ************************************************************ //
@@ -48,12 +88,15 @@ struct SwapChainParameters {
   VkFormat Format;
   std::vector<ImageParameters> Images;
   VkExtent2D Extent;
+  // Layout images must be left in by the render pass before presentation
+  VkImageLayout PresentLayout;
 
   SwapChainParameters()
       : Handle(VK_NULL_HANDLE),
         Format(VK_FORMAT_UNDEFINED),
         Images(),
-        Extent() {}
+        Extent(),
+        PresentLayout(VK_IMAGE_LAYOUT_PRESENT_SRC_KHR) {}
 };
 
   // ************************************************************ //
@@ -63,16 +106,68 @@ struct SwapChainParameters {
   // ************************************************************ //
   struct BufferParameters {
     VkBuffer                        Handle;
-    VkDeviceMemory                  Memory;
+    MemoryAllocation                Memory;
     uint32_t                        Size;
 
     BufferParameters() :
       Handle( VK_NULL_HANDLE ),
-      Memory( VK_NULL_HANDLE ),
+      Memory(),
       Size( 0 ) {
     }
   };
 
+// ************************************************************ //
+// TransientAllocation                                          //
+//                                                              //
+// Range of a frame's transient buffer, valid until the frame   //
+// context is used again                                        //
+// ************************************************************ //
+struct TransientAllocation {
+  VkBuffer Buffer;
+  VkDeviceSize Offset;
+  VkDeviceSize Size;
+  void *Mapped;
+
+  TransientAllocation()
+      : Buffer(VK_NULL_HANDLE), Offset(0), Size(0), Mapped(nullptr) {}
+};
+
+// ************************************************************ //
+// FrameContext                                                 //
+//                                                              //
+// Resources used by one of the frames in flight                //
+// ************************************************************ //
+struct FrameContext {
+  uint32_t Index;
+  // Transient pool, reset as a whole once the frame's fence is signaled
+  VkCommandPool CommandPool;
+  VkCommandBuffer CommandBuffer;
+  VkSemaphore ImageAvailableSemaphore;
+  VkSemaphore FinishedRenderingSemaphore;
+  // Timeline value signaled by the frame's last submission; 0 if never used
+  uint64_t TimelineValue;
+  // One pool and secondary command buffer per recording thread job, so no
+  // two threads ever touch the same pool
+  std::vector<VkCommandPool> WorkerCommandPools;
+  std::vector<VkCommandBuffer> WorkerCommandBuffers;
+  // Persistently mapped buffer for data the CPU writes every frame; it is
+  // handed out front to back and starts over when this context is reused
+  BufferParameters TransientBuffer;
+  VkDeviceSize TransientOffset;
+
+  FrameContext()
+      : Index(0),
+        CommandPool(VK_NULL_HANDLE),
+        CommandBuffer(VK_NULL_HANDLE),
+        ImageAvailableSemaphore(VK_NULL_HANDLE),
+        FinishedRenderingSemaphore(VK_NULL_HANDLE),
+        TimelineValue(0),
+        WorkerCommandPools(),
+        WorkerCommandBuffers(),
+        TransientBuffer(),
+        TransientOffset(0) {}
+};
+
 // ************************************************************ //
 // VulkanCommonParameters                                       //
 //                                                              //
@@ -84,6 +179,8 @@ struct VulkanCommonParameters {
   VkDevice Device;
   QueueParameters GraphicsQueue;
   QueueParameters PresentQueue;
+  QueueParameters TransferQueue;
+  QueueParameters ComputeQueue;
   VkSurfaceKHR PresentationSurface;
   SwapChainParameters SwapChain;
 
@@ -93,10 +190,33 @@ struct VulkanCommonParameters {
         Device(VK_NULL_HANDLE),
         GraphicsQueue(),
         PresentQueue(),
+        TransferQueue(),
+        ComputeQueue(),
         PresentationSurface(VK_NULL_HANDLE),
         SwapChain() {}
 };
 
+// ************************************************************ //
+// LatencyStatistics                                            //
+//                                                              //
+// Input to photon latency estimated per frame: from the end of //
+// BeginFrame(), when input is sampled, until the presentation  //
+// engine hands the frame's swap chain image back on a later    //
+// acquire                                                      //
+// ************************************************************ //
+struct LatencyStatistics {
+  uint32_t SampleCount;
+  double TotalMilliseconds;
+  double MaxMilliseconds;
+
+  LatencyStatistics()
+      : SampleCount(0), TotalMilliseconds(0.0), MaxMilliseconds(0.0) {}
+
+  double GetAverageMilliseconds() const {
+    return (SampleCount > 0) ? TotalMilliseconds / SampleCount : 0.0;
+  }
+};
+
 class VulkanCommon {
  public:
   VulkanCommon();
@@ -104,34 +224,191 @@ class VulkanCommon {
   VkDevice GetDevice() const;
   const SwapChainParameters &GetSwapChain() const;
   bool PrepareVulkan(GLFWwindow *window);
+  bool PrepareVulkanHeadless(uint32_t width, uint32_t height,
+                             bool use_headless_surface);
+  bool IsHeadless() const;
+  VkResult AcquireNextImage(VkSemaphore image_available_semaphore,
+                            uint32_t *image_index);
+  VkResult PresentImage(VkSemaphore rendering_finished_semaphore,
+                        uint32_t image_index);
+  VkResult SubmitToGraphicsQueue(const VkSubmitInfo &submit_info,
+                                 VkFence fence);
+  // Every submission signals the next value of the GPU timeline, returned in
+  // timeline_value; wait for it with GetTimeline().Wait()
+  VkResult SubmitToQueue(const QueueParameters &queue,
+                         const QueueSubmission &submission,
+                         uint64_t *timeline_value = nullptr);
+  GpuTimeline &GetTimeline();
+  // Destroys objects once the timeline value of their last use completed,
+  // checked at the start of every frame; use
+  // GetTimeline().GetLastSignaledValue() when the last use is not known
+  DeletionQueue &GetDeletionQueue();
+  // Binary semaphore ordering submissions on different queues
+  bool CreateQueueSemaphore(VkSemaphore *semaphore);
+  // Queue family ownership transfers of exclusively shared resources: the
+  // release barrier goes into a command buffer submitted to the source queue,
+  // the acquire barrier into one submitted to the destination queue after
+  // waiting on a semaphore the release submission signals. Layouts of both
+  // image barriers must match. Within one queue family the release records
+  // nothing and the acquire becomes an ordinary barrier
+  void ReleaseBufferOwnership(VkCommandBuffer command_buffer, VkBuffer buffer,
+                              const QueueParameters &source,
+                              const QueueParameters &destination,
+                              VkAccessFlags source_access,
+                              VkPipelineStageFlags source_stage);
+  void AcquireBufferOwnership(VkCommandBuffer command_buffer, VkBuffer buffer,
+                              const QueueParameters &source,
+                              const QueueParameters &destination,
+                              VkAccessFlags destination_access,
+                              VkPipelineStageFlags destination_stage);
+  void ReleaseImageOwnership(VkCommandBuffer command_buffer, VkImage image,
+                             const VkImageSubresourceRange &range,
+                             VkImageLayout old_layout, VkImageLayout new_layout,
+                             const QueueParameters &source,
+                             const QueueParameters &destination,
+                             VkAccessFlags source_access,
+                             VkPipelineStageFlags source_stage);
+  void AcquireImageOwnership(VkCommandBuffer command_buffer, VkImage image,
+                             const VkImageSubresourceRange &range,
+                             VkImageLayout old_layout, VkImageLayout new_layout,
+                             const QueueParameters &source,
+                             const QueueParameters &destination,
+                             VkAccessFlags destination_access,
+                             VkPipelineStageFlags destination_stage);
+  // Both steps of an ownership transfer of all buffers, submitted right away
+  // as one submission per queue ordered by a semaphore; later submissions to
+  // the destination queue may use the buffers
+  bool TransferBufferOwnership(const std::vector<VkBuffer> &buffers,
+                               const QueueParameters &source,
+                               const QueueParameters &destination,
+                               VkAccessFlags source_access,
+                               VkPipelineStageFlags source_stage,
+                               VkAccessFlags destination_access,
+                               VkPipelineStageFlags destination_stage);
+  std::string GetDeviceName() const;
+  // Pins the physical device by its index or UUID instead of picking the one
+  // with the highest score; must be called before PrepareVulkan*()
+  void SetDevicePreference(const std::string &device);
+  // present_mode is one of immediate, mailbox, fifo or fifo-relaxed, empty
+  // prefers mailbox; swap_chain_images of 0 picks a count matching the mode.
+  // Takes effect when the swap chain is (re)created
+  bool SetPresentPolicy(const std::string &present_mode,
+                        uint32_t swap_chain_images);
+  const LatencyStatistics &GetLatencyStatistics() const;
+
+  // recording_threads of 0 records everything on the calling thread;
+  // transient_buffer_size is the size of every frame's transient buffer
+  bool CreateFrameContexts(uint32_t frames_in_flight,
+                           uint32_t recording_threads = 0,
+                           VkDeviceSize transient_buffer_size = 0);
+  uint32_t GetFramesInFlight() const;
+  const FrameContext &GetFrameContext(uint32_t index) const;
+  uint32_t GetRecordingThreadCount() const;
+  ThreadPool &GetThreadPool();
+  // fps_cap of 0 renders as fast as possible; low latency mode starts a frame
+  // only after the GPU finished the previous one
+  void SetFramePacing(double fps_cap, bool low_latency);
+  FrameContext *BeginFrame();
+  VkResult SubmitFrame(FrameContext &frame, VkCommandBuffer command_buffer);
+  // alignment must be a power of two
+  bool AllocateTransientBuffer(FrameContext &frame, VkDeviceSize size,
+                               VkDeviceSize alignment,
+                               TransientAllocation *allocation);
+  // Makes everything allocated from the frame's transient buffer visible to
+  // the device
+  bool FlushTransientBuffer(const FrameContext &frame);
   const QueueParameters GetGraphicsQueue() const;
   const QueueParameters GetPresentQueue() const;
+  const QueueParameters GetTransferQueue() const;
+  // Compute-only queue running in parallel with graphics if the device has
+  // one, the graphics queue otherwise
+  const QueueParameters GetComputeQueue() const;
+  // Optional features are enabled whenever the device supports them
+  const VkPhysicalDeviceFeatures &GetEnabledFeatures() const;
+  // Null when VK_KHR_draw_indirect_count is not supported
+  PFN_vkCmdDrawIndexedIndirectCountKHR GetDrawIndirectCountFunction() const;
   VkPhysicalDevice GetPhysicalDevice() const;
   bool OnWindowSizeChanged();
+  VkFramebuffer GetFramebuffer(VkRenderPass render_pass,
+                               const VkImageView *attachments,
+                               uint32_t attachment_count);
+  const FramebufferCacheStatistics &GetFramebufferCacheStatistics() const;
+  MemoryAllocator &GetMemoryAllocator();
+  UploadManager &GetUploadManager();
+  GpuProfiler &GetGpuProfiler();
+  FrameRecorder &GetFrameRecorder();
+  bool LoadPipelineCache(const std::string &file_name);
+  bool CreateGraphicsPipeline(
+      const VkGraphicsPipelineCreateInfo &pipeline_create_info,
+      VkPipeline *pipeline);
+  bool CreateComputePipeline(
+      const VkComputePipelineCreateInfo &pipeline_create_info,
+      VkPipeline *pipeline);
+  void PrintStatistics() const;
   virtual bool Draw() = 0;
   virtual bool ReadyToDraw() const final { return can_render_; }
 
  private:
+  // Swap chain objects replaced by a recreation; destroyed once the first
+  // frame rendered with their successor has finished on the GPU
+  struct RetiredSwapChain {
+    VkSwapchainKHR Handle;
+    std::vector<VkImageView> Views;
+    std::vector<VkFramebuffer> Framebuffers;
+
+    RetiredSwapChain() : Handle(VK_NULL_HANDLE), Views(), Framebuffers() {}
+  };
+
   bool CheckExtensionAvailability(
       const char *extension_name,
       const std::vector<VkExtensionProperties> &available_extensions);
   bool CheckPhysicalDeviceProperties(
       VkPhysicalDevice physical_device,
       uint32_t &selected_graphics_queue_family_index,
-      uint32_t &selected_present_queue_family_index);
+      uint32_t &selected_present_queue_family_index,
+      uint32_t &selected_transfer_queue_family_index,
+      uint32_t &selected_compute_queue_family_index);
+  uint32_t ScorePhysicalDevice(VkPhysicalDevice physical_device,
+                               uint32_t graphics_queue_family_index,
+                               uint32_t present_queue_family_index,
+                               uint32_t transfer_queue_family_index,
+                               uint32_t compute_queue_family_index);
+  std::string GetPhysicalDeviceUuid(VkPhysicalDevice physical_device) const;
+  // Recreates objects referencing swap chain images, i.e. framebuffers, while
+  // older frames may still be in flight. ChildClear() is called before it
+  // only when the swap chain format changed; it should hand objects to the
+  // deletion queue instead of waiting for the device
   virtual bool ChildOnWindowSizeChanged() = 0;
   virtual void ChildClear() = 0;
+  // Sample specific lines appended to PrintStatistics()
+  virtual void ChildPrintStatistics() const {}
   bool CreateInstance();
   bool CreateDevice();
   bool CreatePresentationSurface(GLFWwindow *window);
+  bool CreateHeadlessSurface();
+  bool PrepareDevice();
   bool CreateSwapChain();
   bool CreateSwapChainImageViews();
+  // Hands retired swap chains to the deletion queue
+  void RetireSwapChains(uint64_t timeline_value);
+  bool CreateOffscreenImages();
   bool GetDeviceQueue();
-  
+  void DestroyFrameContexts();
+  bool CreateWorkerCommandBuffers(FrameContext &frame, uint32_t count);
+  bool CreateFrameCommandBuffer(VkCommandBufferLevel level, VkCommandPool *pool,
+                                VkCommandBuffer *command_buffer);
+  bool CreateTransientBuffer(FrameContext &frame, VkDeviceSize size);
+  void DestroyTransientBuffer(FrameContext &frame);
+  VkResult WaitForTimeline(uint64_t value, uint64_t timeout);
+  void AddLatencySample(uint32_t image_index);
+
   std::vector<const char *> GetRequiredExtensions();
+  std::vector<const char *> GetHeadlessExtensions(
+      const std::vector<VkExtensionProperties> &available_extensions);
 
   uint32_t GetSwapChainNumImages(
-      VkSurfaceCapabilitiesKHR &surface_capabilities);
+      VkSurfaceCapabilitiesKHR &surface_capabilities,
+      VkPresentModeKHR present_mode);
   VkSurfaceFormatKHR GetSwapChainFormat(
       std::vector<VkSurfaceFormatKHR> &surface_formats);
   VkExtent2D GetSwapChainExtent(VkSurfaceCapabilitiesKHR &surface_capabilities);
@@ -142,7 +419,39 @@ class VulkanCommon {
   VkPresentModeKHR GetSwapChainPresentMode(
       std::vector<VkPresentModeKHR> &present_modes);
   bool can_render_;
+  bool headless_;
+  bool use_headless_surface_;
+  VkExtent2D default_extent_;
+  std::string device_preference_;
+  PFN_vkGetPhysicalDeviceProperties2KHR get_physical_device_properties2_;
+  VkPhysicalDeviceFeatures enabled_features_;
+  PFN_vkCmdDrawIndexedIndirectCountKHR draw_indirect_count_;
+  VkPresentModeKHR requested_present_mode_;
+  uint32_t requested_swap_chain_images_;
+  uint32_t offscreen_image_index_;
+  std::vector<MemoryAllocation> offscreen_memory_;
+  std::vector<FrameContext> frame_contexts_;
+  ThreadPool thread_pool_;
+  uint32_t next_frame_context_;
+  uint64_t last_frame_value_;
+  double fps_cap_;
+  bool low_latency_;
+  std::chrono::steady_clock::time_point next_frame_time_;
+  // Start of the current frame and of the frames which presented each image
+  std::chrono::steady_clock::time_point frame_input_time_;
+  std::vector<std::chrono::steady_clock::time_point> image_input_times_;
+  LatencyStatistics latency_statistics_;
+  // Retired until the next frame gets submitted
+  std::vector<RetiredSwapChain> retired_swap_chains_;
   VulkanCommonParameters vulkan_;
+  FramebufferCache framebuffer_cache_;
+  MemoryAllocator memory_allocator_;
+  UploadManager upload_manager_;
+  PipelineCache pipeline_cache_;
+  GpuProfiler gpu_profiler_;
+  GpuTimeline timeline_;
+  DeletionQueue deletion_queue_;
+  FrameRecorder frame_recorder_;
 };
 
 #endif
\ No newline at end of file
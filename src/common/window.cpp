@@ -1,20 +1,31 @@
 #include "window.h"
 
+#include <chrono>
 #include <iostream>
 
-Window::Window() {
-  glfwInit();
-  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-  glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-}
+// GLFW is initialized only when a window is created, so headless runs work
+// on machines without a display
+Window::Window() {}
 Window::~Window() {
   if (window_) {
     glfwDestroyWindow(window_);
   }
-  glfwTerminate();
+  if (initialized_) {
+    glfwTerminate();
+  }
 }
 
 bool Window::Create(const char *title, int width, int height) {
+  if (!initialized_) {
+    if (glfwInit() != GLFW_TRUE) {
+      std::cout << "Failed to initialize GLFW" << std::endl;
+      return false;
+    }
+    initialized_ = true;
+  }
+  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+  glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+
   window_ = glfwCreateWindow(width, height, title, nullptr, nullptr);
   if (window_ == nullptr) {
     std::cout << "Failed to create GLFW window" << std::endl;
@@ -33,17 +44,57 @@ void Window::ProcessInput() {
     glfwSetWindowShouldClose(window_, true);
 }
 
-bool Window::RenderingLoop(VulkanCommon &vulkan_common) {
-  while (!glfwWindowShouldClose(window_)) {
-    // input
-    // -----
-    ProcessInput();
+bool Window::RenderingLoop(VulkanCommon &vulkan_common,
+                           const ApplicationOptions &options) {
+  FrameRecorder &frame_recorder = vulkan_common.GetFrameRecorder();
+  frame_recorder.SetEnabled(options.IsBenchmark());
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  uint32_t frame = 0;
+  while ((window_ == nullptr) || !glfwWindowShouldClose(window_)) {
+    frame_recorder.BeginFrame();
+    if (window_ != nullptr) {
+      // input
+      // -----
+      ProcessInput();
+    }
     // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved
     // etc.)
     // -------------------------------------------------------------------------------
-    
-    vulkan_common.Draw();
-    glfwPollEvents();
+
+    if (!vulkan_common.Draw()) {
+      // A failed frame must not end up in the results as a valid run
+      std::cout << "Could not draw frame " << frame << "!" << std::endl;
+      return false;
+    }
+    if (window_ != nullptr) {
+      glfwPollEvents();
+    }
+    frame_recorder.EndFrame();
+
+    ++frame;
+    if ((options.FrameCount > 0) && (frame >= options.FrameCount)) {
+      break;
+    }
+    if ((options.Duration > 0.0) &&
+        (std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+             .count() >= options.Duration)) {
+      break;
+    }
+  }
+
+  vulkan_common.PrintStatistics();
+
+  if (!options.BenchJson.empty() &&
+      !frame_recorder.WriteJson(options.BenchJson,
+                                vulkan_common.GetDeviceName())) {
+    return false;
+  }
+  if (!options.BenchCsv.empty() &&
+      !frame_recorder.WriteCsv(options.BenchCsv)) {
+    return false;
   }
   return true;
 }
\ No newline at end of file
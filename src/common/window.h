@@ -2,6 +2,7 @@
 #define WINDOW_H_
 #include <GLFW/glfw3.h>
 
+#include "common/options.h"
 #include "common/vulkan_common.h"
 
 class Window {
@@ -11,10 +12,14 @@ class Window {
 
   bool Create(const char *title, int width, int height);
   GLFWwindow *GetWindow();
-  bool RenderingLoop(VulkanCommon &vulkan_common);
+  // Renders until the window is closed or the frame count or duration from
+  // the options is reached; in benchmark mode writes recorded frame timings
+  bool RenderingLoop(VulkanCommon &vulkan_common,
+                     const ApplicationOptions &options);
 
  private:
   GLFWwindow *window_ = nullptr;
+  bool initialized_ = false;
   void ProcessInput();
 };
 